@@ -0,0 +1,108 @@
+/*
+ * slow_agrupamento.h
+ * Autores:
+ *  Enzo Tonon Morente - 14568476
+ *  João Pedro Alves Notari Godoy - 14582076
+ *  Letícia Barbosa Neves - 14582076
+ * Descrição: Enquadramento usado pelo agrupamento de mensagens pequenas
+ *            (modo Nagle/cork do periférico): cada registro é o tamanho em
+ *            varint (LEB128, 1 byte até 127) seguido dos bytes, e vários
+ *            registros ocupam o payload de uma única mensagem SLOW
+ */
+
+#ifndef SLOW_AGRUPAMENTO_H
+#define SLOW_AGRUPAMENTO_H
+
+#include <string>
+#include <string_view>
+#include <chrono>
+#include <cstdint>
+
+#include "slow_protocol.h"
+
+// Bytes do prefixo varint de um registro de n bytes
+inline size_t tamanhoVarint(uint64_t n) {
+    size_t b = 1;
+    while (n >= 0x80) { n >>= 7; b++; }
+    return b;
+}
+
+// Acrescenta a "saida" o registro enquadrado (prefixo + bytes)
+inline void enquadrar(std::string& saida, std::string_view registro) {
+    uint64_t n = registro.size();
+    while (n >= 0x80) {
+        saida.push_back((char)(0x80 | (n & 0x7F)));
+        n >>= 7;
+    }
+    saida.push_back((char)n);
+    saida.append(registro.data(), registro.size());
+}
+
+// Separa os registros de um payload agrupado, chamando f(string_view) para
+// cada um (trechos do próprio payload, sem cópia). Retorna false se o
+// enquadramento estiver truncado ou corrompido; os registros anteriores ao
+// erro já foram entregues.
+template <typename F>
+bool desagrupar(std::string_view payload, F f) {
+    size_t i = 0;
+    while (i < payload.size()) {
+        uint64_t n = 0;
+        int desloc = 0;
+        while (true) {
+            if (i >= payload.size() || desloc > 56) return false;
+            uint8_t b = (uint8_t)payload[i++];
+            n |= (uint64_t)(b & 0x7F) << desloc;
+            if (!(b & 0x80)) break;
+            desloc += 7;
+        }
+        if (n > payload.size() - i) return false;
+        f(payload.substr(i, (size_t)n));
+        i += (size_t)n;
+    }
+    return true;
+}
+
+// Quando o periférico descarrega o lote aberto:
+//  NAGLE: assim que não houver nada em trânsito (ou no limiar/prazo)
+//  CORK:  só no limiar de tamanho, no prazo ou num flush() explícito
+enum class ModoAgrupamento { DESLIGADO, NAGLE, CORK };
+
+// Lote aberto de registros enquadrados, a caminho de virar uma mensagem
+class Agrupador {
+public:
+    using Relogio = std::chrono::steady_clock;
+
+    bool vazio() const { return buf.empty(); }
+    size_t tamanho() const { return buf.size(); }
+    size_t registros() const { return n; }
+    Relogio::time_point inicio() const { return primeiro; }
+
+    // Tamanho do registro já enquadrado
+    static size_t enquadrado(std::string_view registro) {
+        return tamanhoVarint(registro.size()) + registro.size();
+    }
+
+    void adicionar(std::string_view registro, Relogio::time_point agora) {
+        if (buf.empty()) {
+            primeiro = agora;
+            buf.reserve(DATA_MAX);
+        }
+        enquadrar(buf, registro);
+        n++;
+    }
+
+    // Entrega o conteúdo do lote e o deixa vazio
+    std::string retirar() {
+        std::string s;
+        s.swap(buf);
+        n = 0;
+        return s;
+    }
+
+private:
+    std::string buf;
+    size_t n = 0;
+    Relogio::time_point primeiro;
+};
+
+#endif // SLOW_AGRUPAMENTO_H
@@ -0,0 +1,862 @@
+/*
+ * slow_bench.cpp
+ * Autores:
+ *  Enzo Tonon Morente - 14568476
+ *  João Pedro Alves Notari Godoy - 14582076
+ *  Letícia Barbosa Neves - 14582076
+ * Descrição: Medições do cliente SLOW em loopback contra o emulador da
+ *            central rodando numa thread do próprio processo
+ */
+
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <sstream>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <ctime>
+#include <algorithm>
+#include <random>
+#include <cstring>
+#include <poll.h>
+
+#include "slow_peripheral.h"
+#include "slow_central.h"
+
+using namespace std;
+
+// Tempo de CPU da thread atual (só o cliente; a central roda em outra thread)
+static double cpuThreadSeg() {
+    timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Parâmetros comuns das medições de transferência
+struct ParametrosTransferencia {
+    size_t totalBytes = 64u << 20;  // volume enviado por medição
+    size_t tamanhoMsg = 64 * 1024;  // tamanho de cada mensagem
+    size_t pendentesMax = 16;       // mensagens em pipeline
+    uint16_t janela = 65535;        // janela anunciada pela central
+    double perda = 0;               // perda de dados na central emulada
+    double atrasoMs = 0;            // atraso por sentido
+    double taxaMbps = 0;            // gargalo na entrada da central (0 = sem)
+};
+
+struct ResultadoTransferencia {
+    bool ok = false;
+    double segundos = 0, cpuSeg = 0;
+    EstatisticasIO io;
+};
+
+// Envia totalBytes em mensagens de tamanhoMsg com submitView(), mantendo até
+// pendentesMax mensagens na fila. "configurar" ajusta o cliente entre init e
+// connect; "finalizar" roda antes de o cliente ser destruído.
+template <typename Config, typename Fim = void (*)(UDPPeripheral&)>
+static ResultadoTransferencia transferir(const ParametrosTransferencia& p, Config configurar,
+                                         Fim finalizar = [](UDPPeripheral&) {}) {
+    ConfigCentral cc;
+    cc.porta = 0;
+    cc.janela = p.janela;
+    cc.perda = p.perda;
+    cc.atrasoMs = p.atrasoMs;
+    cc.taxaMbps = p.taxaMbps;
+    CentralEmThread central(cc);
+
+    ResultadoTransferencia res;
+    UDPPeripheral cli;
+    cli.setVerboso(false);
+    if (!cli.init("127.0.0.1", central.porta())) return res;
+    configurar(cli);
+    if (!cli.connect()) {
+        finalizar(cli);
+        return res;
+    }
+
+    string msg(p.tamanhoMsg, 'x');
+    size_t enviados = 0, pendentes = 0;
+    bool falhou = false;
+    auto t0 = chrono::steady_clock::now();
+    double c0 = cpuThreadSeg();
+    while ((enviados < p.totalBytes || pendentes > 0) && !falhou && cli.isActive()) {
+        while (enviados < p.totalBytes && pendentes < p.pendentesMax) {
+            pendentes++;
+            enviados += msg.size();
+            cli.submitView(msg, [&](uint64_t, bool ok) { pendentes--; if (!ok) falhou = true; });
+        }
+        cli.processarEventos(TIMEOUT_ESPERA_MS);
+    }
+    res.cpuSeg = cpuThreadSeg() - c0;
+    res.segundos = chrono::duration<double>(chrono::steady_clock::now() - t0).count();
+    res.ok = !falhou && cli.isActive();
+    res.io = cli.estatisticasIO();
+    cli.disconnect();
+    finalizar(cli);
+    return res;
+}
+
+static void imprimirTransferencia(const string& nome, const ParametrosTransferencia& p,
+                                  const ResultadoTransferencia& r) {
+    double mb = p.totalBytes / 1e6;
+    cout << left << setw(12) << nome << right << fixed << setprecision(1)
+         << setw(9) << (r.ok ? mb / r.segundos : 0.0) << " MB/s"
+         << setw(9) << (r.cpuSeg * 1e6 / mb) << " us CPU/MB"
+         << setw(8) << (r.ok ? r.io.datagramasEnviados / r.segundos / 1e3 : 0.0) << " kpkt/s"
+         << setw(10) << r.io.datagramasEnviados << " pkts"
+         << setw(9) << r.io.chamadasEnvio << " tx syscalls"
+         << setw(9) << r.io.chamadasRecepcao << " rx syscalls"
+         << (r.ok ? "" : "  (FALHOU)") << endl;
+}
+
+// sendto/recvfrom por pacote contra sendmmsg/recvmmsg em lote
+static void benchIO(const ParametrosTransferencia& p) {
+    cout << "== E/S por pacote x em lote (" << (p.totalBytes >> 20) << " MiB, mensagens de "
+         << p.tamanhoMsg << " B, janela " << p.janela << ") ==" << endl;
+    imprimirTransferencia("por-pacote", p, transferir(p, [](UDPPeripheral& c) { c.setLoteIO(false); }));
+    imprimirTransferencia("mmsg", p, transferir(p, [](UDPPeripheral& c) { c.setLoteIO(true); }));
+}
+
+// Caminho em lote com e sem UDP_SEGMENT: o kernel corta os segmentos
+static void benchGSO(const ParametrosTransferencia& p) {
+    cout << "== GSO (UDP_SEGMENT) (" << (p.totalBytes >> 20) << " MiB, mensagens de "
+         << p.tamanhoMsg << " B, janela " << p.janela << ") ==" << endl;
+    imprimirTransferencia("por-pacote", p, transferir(p, [](UDPPeripheral& c) { c.setLoteIO(false); }));
+    imprimirTransferencia("mmsg", p, transferir(p, [](UDPPeripheral& c) { c.setLoteIO(true); }));
+    bool suportado = true;
+    ResultadoTransferencia r = transferir(p, [&](UDPPeripheral& c) { suportado = c.setGSO(true); });
+    if (!suportado) {
+        cout << "gso         não suportado pelo kernel" << endl;
+        return;
+    }
+    imprimirTransferencia("gso", p, r);
+    cout << "            " << r.io.mensagensGSO << " envios segmentados pelo kernel" << endl;
+}
+
+// Goodput de cada controle de congestionamento com perda aleatória e com um
+// gargalo de fila curta (onde a rajada da janela anunciada inteira transborda)
+static void benchCC(const ParametrosTransferencia& base) {
+    struct Cenario { const char* nome; double perda, taxaMbps; };
+    const Cenario cenarios[] = {
+        {"sem perda", 0, 0}, {"perda 1%", 0.01, 0}, {"perda 5%", 0.05, 0},
+        {"gargalo 200Mbps", 0, 200},
+    };
+    const pair<const char*, AlgoritmoCongestionamento> algoritmos[] = {
+        {"nenhum", AlgoritmoCongestionamento::NENHUM},
+        {"newreno", AlgoritmoCongestionamento::NEWRENO},
+        {"cubic", AlgoritmoCongestionamento::CUBIC},
+    };
+    ParametrosTransferencia p = base;
+    p.totalBytes = max<size_t>(base.totalBytes / 8, 1u << 20); // a recuperação é lenta sob perda
+    if (p.atrasoMs == 0) p.atrasoMs = 2;
+    cout << "== Controle de congestionamento (" << (p.totalBytes >> 20) << " MiB, atraso "
+         << p.atrasoMs << " ms por sentido, janela " << p.janela << ") ==" << endl;
+    for (const Cenario& c : cenarios) {
+        p.perda = c.perda;
+        p.taxaMbps = c.taxaMbps;
+        for (const auto& a : algoritmos) {
+            ResultadoTransferencia r = transferir(p, [&](UDPPeripheral& cli) {
+                cli.setControleCongestionamento(a.second);
+            });
+            cout << left << setw(16) << c.nome << setw(9) << a.first << right << fixed
+                 << setprecision(2) << setw(8) << (r.ok ? p.totalBytes / 1e6 / r.segundos : 0.0)
+                 << " MB/s" << setw(8) << r.io.retransmissoes << " retransmissões"
+                 << (r.ok ? "" : "  (FALHOU)") << endl;
+        }
+    }
+}
+
+// ---- Cadência de envio (rede em memória, relógio virtual) ----
+
+struct ResultadoCadencia {
+    bool ok = false;
+    double segundos = 0;      // tempo virtual da transferência
+    EstatisticasEnlace enlace;
+    EstatisticasIO io;
+};
+
+// Transfere "total" bytes por um gargalo de taxaMbps com fila de filaBytes na
+// ida (10 ms por sentido), com ou sem cadência. No relógio virtual o
+// resultado não depende da carga da máquina.
+static ResultadoCadencia medirCadencia(double taxaMbps, uint32_t filaBytes, bool comCadencia,
+                                       size_t total) {
+    RedeVirtual rede(1);
+    ConfigCentral cfg;
+    cfg.janela = 65535;
+    CentralEmulador central(cfg);
+    central.abrir(rede);
+    ModeloEnlace ida, volta;
+    ida.atrasoMs = volta.atrasoMs = 10;
+    ida.taxaMbps = taxaMbps;
+    ida.filaBytes = filaBytes;
+    central.pontoRede()->setEnlace(volta);
+    TransporteMemoria& ponto = rede.novoPonto();
+    ponto.conectar(central.pontoRede()->endereco());
+    ponto.setEnlace(ida);
+
+    ResultadoCadencia res;
+    UDPPeripheral cli;
+    cli.setVerboso(false);
+    cli.usarTransporte(ponto, rede.relogio());
+    ConfigCadencia c;
+    c.ligada = comCadencia;
+    cli.setCadencia(c);
+    if (!cli.connect()) return res;
+
+    string msg(64 * 1024, 'p');
+    size_t enviados = 0, pendentes = 0;
+    bool falhou = false;
+    auto t0 = rede.relogio().agora();
+    while ((enviados < total || pendentes > 0) && !falhou && cli.isActive()) {
+        while (enviados < total && pendentes < 16) {
+            pendentes++;
+            enviados += msg.size();
+            cli.submitView(msg, [&](uint64_t, bool ok) { pendentes--; if (!ok) falhou = true; });
+        }
+        cli.processarEventos(TIMEOUT_ESPERA_MS);
+    }
+    res.segundos = chrono::duration<double>(rede.relogio().agora() - t0).count();
+    res.ok = !falhou && cli.isActive() && central.estatisticas().bytes == enviados;
+    res.enlace = ponto.estatisticas();
+    res.io = cli.estatisticasIO();
+    return res;
+}
+
+// Perdas na fila do gargalo e goodput com e sem cadência (NewReno, janela
+// anunciada de 64 KiB). Com "verificar", falha se alguma transferência,
+// com ou sem cadência, não terminar, ou se a com cadência for mais de 2%
+// mais lenta que sem ela ou não reduzir as perdas nas filas curtas.
+static bool benchCadencia(bool verificar) {
+    struct Cenario { double taxaMbps; uint32_t filaBytes; };
+    const Cenario cenarios[] = {
+        {20, 4 * 1024}, {20, 8 * 1024}, {20, 32 * 1024},
+        {100, 4 * 1024}, {100, 8 * 1024}, {100, 32 * 1024},
+    };
+    const size_t TOTAL = 8u << 20;
+    cout << "== Cadência (" << (TOTAL >> 20) << " MiB, gargalo na ida, 10 ms por sentido, "
+         << "relógio virtual) ==" << endl;
+    bool ok = true;
+    for (const Cenario& c : cenarios) {
+        ResultadoCadencia r[2];
+        for (int comCadencia = 0; comCadencia < 2; comCadencia++) {
+            r[comCadencia] = medirCadencia(c.taxaMbps, c.filaBytes, comCadencia, TOTAL);
+            const ResultadoCadencia& x = r[comCadencia];
+            ostringstream nome;
+            nome << c.taxaMbps << " Mbps fila " << (c.filaBytes >> 10) << " KiB";
+            cout << left << setw(22) << nome.str() << setw(14) << (comCadencia ? "com cadência" : "sem cadência")
+                 << right << fixed << setprecision(2) << setw(8) << (x.ok ? TOTAL / 1e6 / x.segundos : 0.0)
+                 << " MB/s" << setw(7) << x.enlace.perdidosFila << " perdas na fila"
+                 << setw(7) << x.io.retransmissoes << " retransmissões ("
+                 << x.io.retransmissoesRapidas << " rápidas)" << (x.ok ? "" : "  (FALHOU)") << endl;
+        }
+        // perdas na fila não justificam abandonar: as duas precisam terminar
+        ok = ok && r[0].ok && r[1].ok;
+        if (r[0].ok && r[1].ok) {
+            ok = ok && r[1].segundos <= 1.02 * r[0].segundos;
+            if (c.filaBytes < 32 * 1024) ok = ok && r[1].enlace.perdidosFila < r[0].enlace.perdidosFila;
+        }
+    }
+    if (verificar) cout << (ok ? "Verificação OK." : "Verificação FALHOU.") << endl;
+    return ok;
+}
+
+// Custo do trace no cliente: desligado, gravando no anel com a thread de
+// dreno formatando texto (descartado), e gravando sem dreno (anel cheio
+// descarta)
+static void benchTrace(const ParametrosTransferencia& p) {
+    cout << "== Trace por pacote (" << (p.totalBytes >> 20) << " MiB, mensagens de "
+         << p.tamanhoMsg << " B, janela " << p.janela << ") ==" << endl;
+    imprimirTransferencia("desligado", p, transferir(p, [](UDPPeripheral& c) { c.setVerboso(false); }));
+
+    ostream nulo(nullptr); // descarta o texto formatado
+    unique_ptr<DrenoTrace> dreno;
+    ResultadoTransferencia r = transferir(p,
+        [&](UDPPeripheral& c) {
+            c.setVerboso(true);
+            dreno = make_unique<DrenoTrace>(c.anelTrace(), nulo);
+        },
+        [&](UDPPeripheral&) { dreno.reset(); });
+    imprimirTransferencia("texto", p, r);
+
+    r = transferir(p, [](UDPPeripheral& c) { c.setVerboso(true); });
+    imprimirTransferencia("sem dreno", p, r);
+}
+
+// Percentil (0..1) de amostras já ordenadas
+static double percentil(const vector<double>& v, double q) {
+    if (v.empty()) return 0;
+    size_t i = min(v.size() - 1, (size_t)(q * (v.size() - 1) + 0.5));
+    return v[i];
+}
+
+struct ResultadoCauda {
+    bool ok = false;
+    vector<double> latenciasMs; // ordenadas
+    EstatisticasIO io;
+};
+
+// Envia "mensagens" mensagens grandes, uma de cada vez, e mede o tempo de
+// cada uma até o ACK do último fragmento
+static ResultadoCauda medirCauda(const ParametrosTransferencia& p, size_t mensagens,
+                                 uint32_t limiarDupAck) {
+    ConfigCentral cc;
+    cc.porta = 0;
+    cc.janela = p.janela;
+    cc.perda = p.perda;
+    cc.atrasoMs = p.atrasoMs;
+    CentralEmThread central(cc);
+
+    ResultadoCauda res;
+    UDPPeripheral cli;
+    cli.setVerboso(false);
+    if (!cli.init("127.0.0.1", central.porta())) return res;
+    cli.setLimiarAcksDuplicados(limiarDupAck);
+    if (!cli.connect()) return res;
+
+    string msg(p.tamanhoMsg, 'x');
+    res.ok = true;
+    for (size_t i = 0; i < mensagens && res.ok; i++) {
+        auto t0 = chrono::steady_clock::now();
+        res.ok = cli.sendData(msg);
+        res.latenciasMs.push_back(
+            chrono::duration<double, milli>(chrono::steady_clock::now() - t0).count());
+    }
+    sort(res.latenciasMs.begin(), res.latenciasMs.end());
+    res.io = cli.estatisticasIO();
+    cli.disconnect();
+    return res;
+}
+
+// Latência de cauda de mensagens grandes sob perda, com e sem retransmissão
+// rápida. Com "verificar", falha se alguma mensagem não for entregue ou se a
+// retransmissão rápida não chegar a disparar.
+static bool benchCauda(const ParametrosTransferencia& base, size_t mensagens, bool verificar) {
+    ParametrosTransferencia p = base;
+    if (p.atrasoMs == 0) p.atrasoMs = 2;
+    cout << "== Latência de cauda (" << mensagens << " mensagens de " << p.tamanhoMsg
+         << " B, atraso " << p.atrasoMs << " ms por sentido, janela " << p.janela << ") ==" << endl;
+    bool tudoOk = true;
+    for (double perda : {0.01, 0.03, 0.05}) {
+        p.perda = perda;
+        for (uint32_t limiar : {0u, 3u}) {
+            ResultadoCauda r = medirCauda(p, mensagens, limiar);
+            const vector<double>& l = r.latenciasMs;
+            cout << "perda " << setw(2) << (int)(perda * 100) << "%  " << left << setw(13)
+                 << (limiar ? "dupack=3" : "timeout") << right << fixed << setprecision(1)
+                 << " p50 " << setw(7) << percentil(l, 0.5) << " ms"
+                 << "  p99 " << setw(7) << percentil(l, 0.99) << " ms"
+                 << "  max " << setw(7) << (l.empty() ? 0.0 : l.back()) << " ms"
+                 << setw(7) << r.io.retransmissoes << " rtx (" << r.io.retransmissoesRapidas
+                 << " rápidas)" << (r.ok ? "" : "  (FALHOU)") << endl;
+            tudoOk = tudoOk && r.ok && (limiar == 0 || r.io.retransmissoesRapidas > 0);
+        }
+    }
+    if (verificar) cout << (tudoOk ? "Verificação OK." : "Verificação FALHOU.") << endl;
+    return tudoOk;
+}
+
+// ---- Codec do cabeçalho (sem rede) ----
+
+// Impede o compilador de descartar o resultado de uma medição
+static inline void naoOtimizar(const void* p) { asm volatile("" : : "g"(p) : "memory"); }
+
+// ns por operação de "f", que faz "porChamada" operações a cada chamada
+template <typename F>
+static double nsPorOp(size_t chamadas, size_t porChamada, F f) {
+    auto t0 = chrono::steady_clock::now();
+    for (size_t i = 0; i < chamadas; i++) f(i);
+    chrono::duration<double, nano> d = chrono::steady_clock::now() - t0;
+    return d.count() / (double)(chamadas * porChamada);
+}
+
+static bool mesmoHeader(const Header& a, const Header& b) {
+    return memcmp(a.sid.b, b.sid.b, 16) == 0 && a.sf == b.sf && a.seq == b.seq &&
+           a.ack == b.ack && a.wnd == b.wnd && a.fid == b.fid && a.fo == b.fo;
+}
+
+static Header headerAleatorio(mt19937& rng) {
+    Header h;
+    for (auto& b : h.sid.b) b = (uint8_t)rng();
+    h.sf = rng();
+    h.seq = rng();
+    h.ack = rng();
+    h.wnd = (uint16_t)rng();
+    h.fid = (uint8_t)rng();
+    h.fo = (uint8_t)rng();
+    return h;
+}
+
+// Confere que o codec otimizado gera exatamente os bytes/campos das versões
+// de referência (serializeBytes/deserializeBytes, memcmp)
+static bool verificarCodec(mt19937& rng) {
+    for (int i = 0; i < 100000; i++) {
+        Header h = headerAleatorio(rng);
+        uint8_t ref[HDR_SIZE], rapido[HDR_SIZE];
+        serializeBytes(h, ref);
+        serialize(h, rapido);
+        if (memcmp(ref, rapido, HDR_SIZE) != 0) return false;
+
+        for (auto& b : ref) b = (uint8_t)rng();
+        Header a, b;
+        deserializeBytes(a, ref);
+        deserialize(b, ref);
+        if (!mesmoHeader(a, b) || flagsDe(ref) != a.flags() || sttlDe(ref) != a.sttl()) return false;
+
+        SID s = h.sid;
+        if (!s.isEqual(h.sid)) return false;
+        s.b[rng() % 16] ^= (uint8_t)(1u << (rng() % 8));
+        if (s.isEqual(h.sid) != (memcmp(s.b, h.sid.b, 16) == 0)) return false;
+    }
+
+    // lote: cada cabeçalho igual ao modelo com seq/flags/fo trocados
+    for (int i = 0; i < 1000; i++) {
+        Header modelo = headerAleatorio(rng);
+        VariacaoHeader v[64];
+        for (auto& x : v) x = {(uint32_t)rng(), (uint8_t)rng(), (uint8_t)rng()};
+        uint8_t lote[64 * HDR_SIZE];
+        serializeLote(modelo, v, 64, lote);
+        for (int k = 0; k < 64; k++) {
+            Header h = modelo;
+            h.sf = (h.sf & ~FLAGS_MASK) | (v[k].flags & FLAGS_MASK);
+            h.seq = v[k].seq;
+            h.fo = v[k].fo;
+            uint8_t ref[HDR_SIZE];
+            serializeBytes(h, ref);
+            if (memcmp(ref, lote + k * HDR_SIZE, HDR_SIZE) != 0) return false;
+        }
+    }
+    return true;
+}
+
+// Texto alinhado à esquerda em "largura" colunas (setw conta bytes, não
+// caracteres acentuados em UTF-8)
+static string colunaTexto(const string& s, size_t largura) {
+    size_t visiveis = 0;
+    for (unsigned char c : s) visiveis += (c & 0xC0) != 0x80;
+    return s + string(largura > visiveis ? largura - visiveis : 0, ' ');
+}
+
+static void imprimirCodec(const char* nome, double referencia, double otimizado) {
+    cout << colunaTexto(nome, 24) << fixed << setprecision(2)
+         << setw(8) << referencia << " ns" << setw(8) << otimizado << " ns"
+         << setw(8) << setprecision(1) << referencia / otimizado << "x" << endl;
+}
+
+// Microbenchmarks do codec: referência byte a byte x otimizado. Falha se
+// as duas versões divergirem em algum cabeçalho.
+static bool benchCodec() {
+    mt19937 rng(12345);
+    bool ok = verificarCodec(rng);
+    cout << "== Codec do cabeçalho (ns por cabeçalho) ==" << endl;
+    cout << "equivalência com a referência: " << (ok ? "OK" : "FALHOU") << endl;
+
+    const size_t N = 1024, VOLTAS = 4000;  // N cabeçalhos variados, 4M operações
+    vector<Header> hs(N);
+    for (auto& h : hs) h = headerAleatorio(rng);
+    vector<uint8_t> bufs(N * HDR_SIZE);
+    for (size_t i = 0; i < N; i++) serialize(hs[i], &bufs[i * HDR_SIZE]);
+    vector<Header> saida(N);
+
+    cout << colunaTexto("", 24) << " referência  otimizado" << endl;
+    imprimirCodec("serialize",
+        nsPorOp(VOLTAS, N, [&](size_t) {
+            for (size_t i = 0; i < N; i++) serializeBytes(hs[i], &bufs[i * HDR_SIZE]);
+            naoOtimizar(bufs.data());
+        }),
+        nsPorOp(VOLTAS, N, [&](size_t) {
+            for (size_t i = 0; i < N; i++) serialize(hs[i], &bufs[i * HDR_SIZE]);
+            naoOtimizar(bufs.data());
+        }));
+    imprimirCodec("deserialize",
+        nsPorOp(VOLTAS, N, [&](size_t) {
+            for (size_t i = 0; i < N; i++) deserializeBytes(saida[i], &bufs[i * HDR_SIZE]);
+            naoOtimizar(saida.data());
+        }),
+        nsPorOp(VOLTAS, N, [&](size_t) {
+            for (size_t i = 0; i < N; i++) deserialize(saida[i], &bufs[i * HDR_SIZE]);
+            naoOtimizar(saida.data());
+        }));
+
+    // janela de 64 fragmentos de uma rajada: só seq/flags/fo mudam
+    const size_t J = 64;
+    vector<VariacaoHeader> v(J);
+    for (size_t k = 0; k < J; k++)
+        v[k] = {1000 + (uint32_t)k, (uint8_t)(FLAG_ACK | (k + 1 < J ? FLAG_MB : 0)), (uint8_t)k};
+    imprimirCodec("lote de 64 (janela)",
+        nsPorOp(VOLTAS * N / J, J, [&](size_t) {
+            Header h = hs[0];
+            for (size_t k = 0; k < J; k++) {
+                h.seq = v[k].seq;
+                h.sf = (h.sf & ~FLAGS_MASK) | v[k].flags;
+                h.fo = v[k].fo;
+                serializeBytes(h, &bufs[k * HDR_SIZE]);
+            }
+            naoOtimizar(bufs.data());
+        }),
+        nsPorOp(VOLTAS * N / J, J, [&](size_t) {
+            serializeLote(hs[0], v.data(), J, bufs.data());
+            naoOtimizar(bufs.data());
+        }));
+
+    uint32_t soma = 0;
+    imprimirCodec("flags + STTL",
+        nsPorOp(VOLTAS, N, [&](size_t) {
+            for (size_t i = 0; i < N; i++) {
+                Header h;
+                deserializeBytes(h, &bufs[i * HDR_SIZE]);
+                soma += h.flags() + h.sttl();
+            }
+            naoOtimizar(&soma);
+        }),
+        nsPorOp(VOLTAS, N, [&](size_t) {
+            for (size_t i = 0; i < N; i++) {
+                const uint8_t* b = &bufs[i * HDR_SIZE];
+                soma += flagsDe(b) + sttlDe(b);
+            }
+            naoOtimizar(&soma);
+        }));
+
+    // metade dos SIDs iguais ao primeiro, metade diferindo no último byte
+    vector<SID> sids(N, hs[0].sid);
+    for (size_t i = 1; i < N; i += 2) sids[i].b[15] ^= 1;
+    imprimirCodec("comparação de SID",
+        nsPorOp(VOLTAS, N, [&](size_t) {
+            for (size_t i = 0; i < N; i++) soma += memcmp(sids[i].b, hs[0].sid.b, 16) == 0;
+            naoOtimizar(&soma);
+        }),
+        nsPorOp(VOLTAS, N, [&](size_t) {
+            for (size_t i = 0; i < N; i++) soma += sids[i].isEqual(hs[0].sid);
+            naoOtimizar(&soma);
+        }));
+    return ok;
+}
+
+// ---- Agrupamento de mensagens pequenas ----
+
+struct ResultadoAgrupamento {
+    bool ok = false;
+    double segundos = 0;
+    uint64_t registros = 0;  // separados pela central (só com agrupamento)
+    EstatisticasIO io;
+};
+
+// Envia "n" registros de "tamanho" bytes: com sendData um a um (modo < 0)
+// ou com submitView mantendo até 1024 na fila, agrupados ou não
+static ResultadoAgrupamento medirAgrupamento(const ParametrosTransferencia& p, size_t n,
+                                             size_t tamanho, int modo) {
+    ModoAgrupamento m = modo < 0 ? ModoAgrupamento::DESLIGADO : (ModoAgrupamento)modo;
+    ConfigCentral cc;
+    cc.porta = 0;
+    cc.janela = p.janela;
+    cc.atrasoMs = p.atrasoMs;
+    cc.desagrupar = m != ModoAgrupamento::DESLIGADO;
+    CentralEmThread central(cc);
+
+    ResultadoAgrupamento res;
+    UDPPeripheral cli;
+    cli.setVerboso(false);
+    if (!cli.init("127.0.0.1", central.porta()) || !cli.connect()) return res;
+    cli.setAgrupamento(m, chrono::microseconds(1000));
+
+    string reg(tamanho, 'r');
+    size_t enviados = 0, pendentes = 0;
+    bool falhou = false;
+    auto t0 = chrono::steady_clock::now();
+    if (modo < 0) {
+        for (; enviados < n && !falhou; enviados++) falhou = !cli.sendData(reg);
+    } else {
+        while ((enviados < n || pendentes > 0) && !falhou && cli.isActive()) {
+            while (enviados < n && pendentes < 1024) {
+                pendentes++;
+                enviados++;
+                cli.submitView(reg, [&](uint64_t, bool ok) { pendentes--; if (!ok) falhou = true; });
+            }
+            if (enviados == n) cli.aguardarEnvios();
+            else cli.processarEventos(TIMEOUT_ESPERA_MS);
+        }
+    }
+    res.segundos = chrono::duration<double>(chrono::steady_clock::now() - t0).count();
+    res.ok = !falhou && cli.isActive();
+    res.io = cli.estatisticasIO();
+    cli.disconnect(); // a central já separou tudo o que confirmou
+    res.registros = central.estatisticas().registros;
+    return res;
+}
+
+// Ida e volta de registros com tamanhos nas bordas do varint, e rejeição
+// de enquadramentos truncados
+static bool verificarEnquadramento() {
+    vector<size_t> tamanhos = {0, 1, 127, 128, 300, 16383, 16384, DATA_MAX};
+    string lote;
+    for (size_t t : tamanhos) enquadrar(lote, string(t, (char)('a' + t % 26)));
+    vector<string> lidos;
+    if (!desagrupar(lote, [&](string_view r) { lidos.emplace_back(r); })) return false;
+    if (lidos.size() != tamanhos.size()) return false;
+    for (size_t i = 0; i < tamanhos.size(); i++)
+        if (lidos[i] != string(tamanhos[i], (char)('a' + tamanhos[i] % 26))) return false;
+    for (size_t corte : {lote.size() - 1, (size_t)1 + 1 + 127 + 1}) // fim de registro / meio do prefixo
+        if (desagrupar(string_view(lote).substr(0, corte), [](string_view) {})) return false;
+    return true;
+}
+
+// Mensagens/s com registros pequenos: um por pacote (sendData e pipeline)
+// x agrupados em Nagle e cork. Com "verificar", falha se a central não
+// separar todos os registros ou se o agrupamento não reduzir os pacotes.
+static bool benchAgrupar(const ParametrosTransferencia& p, bool verificar) {
+    const size_t N = 50000, TAM = 64;
+    bool ok = verificarEnquadramento();
+    cout << "== Agrupamento (" << N << " registros de " << TAM << " B, atraso "
+         << p.atrasoMs << " ms por sentido, janela " << p.janela << ") ==" << endl;
+    cout << "enquadramento: " << (ok ? "OK" : "FALHOU") << endl;
+    const pair<const char*, int> modos[] = {
+        {"sendData", -1}, {"pipeline", (int)ModoAgrupamento::DESLIGADO},
+        {"nagle", (int)ModoAgrupamento::NAGLE}, {"cork", (int)ModoAgrupamento::CORK},
+    };
+    for (const auto& m : modos) {
+        // um por vez é lento: mede uma fração e mostra a taxa
+        size_t n = m.second < 0 ? N / 10 : N;
+        ResultadoAgrupamento r = medirAgrupamento(p, n, TAM, m.second);
+        bool agrupado = m.second > (int)ModoAgrupamento::DESLIGADO;
+        cout << left << setw(10) << m.first << right << fixed << setprecision(0)
+             << setw(10) << (r.ok ? n / r.segundos : 0.0) << " msgs/s" << setw(9)
+             << r.io.datagramasEnviados << " pkts" << setprecision(1) << setw(8)
+             << (r.io.datagramasEnviados ? (double)n / r.io.datagramasEnviados : 0.0) << " msgs/pkt";
+        if (agrupado) cout << setw(8) << r.registros << " separados";
+        cout << (r.ok ? "" : "  (FALHOU)") << endl;
+        ok = ok && r.ok;
+        if (agrupado) ok = ok && r.registros == n && r.io.datagramasEnviados * 10 < n;
+    }
+    if (verificar) cout << (ok ? "Verificação OK." : "Verificação FALHOU.") << endl;
+    return ok;
+}
+
+// ---- Fila de submissão de várias threads ----
+
+// Políticas com a fila cheia (capacidade 4, sem consumidor) e a soltura dos
+// produtores bloqueados quando a fila fecha
+static bool verificarPoliticas() {
+    bool ok = true;
+    for (PoliticaFila pol : {PoliticaFila::FALHAR, PoliticaFila::DESCARTAR}) {
+        FilaSubmissao<CallbackEnvio> f(4, pol);
+        CallbackEnvio nada;
+        for (int i = 0; i < 4; i++) {
+            string m = "m";
+            ok = ok && f.submeter(std::move(m), nada);
+        }
+        string extra = "extra";
+        bool chamado = false;
+        CallbackEnvio cb = [&](uint64_t, bool r) { chamado = !r; };
+        ok = ok && !f.submeter(std::move(extra), cb);
+        if (pol == PoliticaFila::FALHAR) ok = ok && extra == "extra" && !chamado && f.estatisticas().rejeitadas == 1;
+        else ok = ok && chamado && f.estatisticas().descartadas == 1;
+    }
+
+    FilaSubmissao<CallbackEnvio> f(2, PoliticaFila::BLOQUEAR);
+    atomic<int> aceitos{0};
+    thread produtor([&] {
+        CallbackEnvio nada;
+        for (int i = 0; i < 4; i++) {
+            string m = to_string(i);
+            if (f.submeter(std::move(m), nada)) aceitos++;
+        }
+    });
+    this_thread::sleep_for(chrono::milliseconds(20)); // produtor preso na 3ª
+    FilaSubmissao<CallbackEnvio>::Item item;
+    ok = ok && aceitos == 2 && f.retirar(item) && item.msg == "0";
+    while (aceitos < 3) this_thread::yield();         // a retirada o soltou
+    this_thread::sleep_for(chrono::milliseconds(20)); // preso de novo na 4ª
+    f.fechar();
+    produtor.join();
+    ok = ok && aceitos == 3 && f.estatisticas().bloqueios == 2;
+    while (f.retirar(item)) {}
+    return ok && f.encerrada();
+}
+
+struct ResultadoProdutores {
+    bool ok = false;
+    double segundos = 0;
+    EstatisticasFila fila;
+    uint64_t registros = 0;  // separados pela central (fim a fim)
+};
+
+// "produtores" threads submetem "n" mensagens de "tamanho" bytes no total.
+// Sem sessão, uma thread consumidora só esvazia a fila (dormindo no eventfd);
+// com sessão, a thread de protocolo roda executarFila com Nagle ligado.
+static ResultadoProdutores medirProdutores(const ParametrosTransferencia& p, size_t produtores,
+                                           size_t n, size_t tamanho, bool comSessao) {
+    ResultadoProdutores res;
+    const string modelo(tamanho, 'p');
+    atomic<uint64_t> confirmadas{0}, falhas{0};
+    CallbackEnvio cb = [&](uint64_t, bool ok) { (ok ? confirmadas : falhas)++; };
+    auto produzir = [&](auto submeter) {
+        vector<thread> ts;
+        for (size_t t = 0; t < produtores; t++)
+            ts.emplace_back([&, t] {
+                for (size_t i = t; i < n; i += produtores) {
+                    string m = modelo;
+                    if (!submeter(std::move(m))) falhas++;
+                }
+            });
+        for (thread& t : ts) t.join();
+    };
+
+    if (!comSessao) {
+        FilaSubmissao<CallbackEnvio> f(4096, PoliticaFila::BLOQUEAR);
+        uint64_t retiradas = 0;
+        auto t0 = chrono::steady_clock::now();
+        thread consumidor([&] {
+            FilaSubmissao<CallbackEnvio>::Item item;
+            while (true) {
+                while (f.retirar(item)) retiradas++;
+                if (f.encerrada()) break;
+                if (f.prepararEspera()) {
+                    pollfd pfd{f.descritor(), POLLIN, 0};
+                    poll(&pfd, 1, -1);
+                }
+                f.aposEspera(true);
+            }
+        });
+        produzir([&](string&& m) { CallbackEnvio c; return f.submeter(std::move(m), c); });
+        f.fechar();
+        consumidor.join();
+        res.segundos = chrono::duration<double>(chrono::steady_clock::now() - t0).count();
+        res.fila = f.estatisticas();
+        res.ok = retiradas == n && falhas == 0;
+        return res;
+    }
+
+    ConfigCentral cc;
+    cc.porta = 0;
+    cc.janela = p.janela;
+    cc.atrasoMs = p.atrasoMs;
+    cc.desagrupar = true;
+    CentralEmThread central(cc);
+    UDPPeripheral cli;
+    cli.setVerboso(false);
+    if (!cli.init("127.0.0.1", central.porta()) || !cli.connect()) return res;
+    cli.setAgrupamento(ModoAgrupamento::NAGLE, chrono::microseconds(1000));
+    if (!cli.setFilaSubmissao(4096)) return res;
+
+    auto t0 = chrono::steady_clock::now();
+    thread protocolo([&] { cli.executarFila(); });
+    produzir([&](string&& m) { return cli.submitConcorrente(std::move(m), cb); });
+    cli.fecharFilaSubmissao();
+    protocolo.join();
+    res.segundos = chrono::duration<double>(chrono::steady_clock::now() - t0).count();
+    res.fila = cli.estatisticasFila();
+    res.ok = confirmadas == n && falhas == 0 && cli.isActive();
+    cli.disconnect();
+    res.registros = central.estatisticas().registros;
+    return res;
+}
+
+// Mensagens/s com 1 a 8 threads submetendo ao mesmo tempo: só a fila e fim a
+// fim (fila -> thread de protocolo -> central). Com "verificar", falha se
+// alguma mensagem se perder ou se as políticas de fila cheia divergirem.
+static bool benchProdutores(const ParametrosTransferencia& p, bool verificar) {
+    const size_t N = 400000, TAM = 64;
+    bool ok = verificarPoliticas();
+    cout << "== Fila de submissão (" << N << " mensagens de " << TAM << " B, capacidade 4096, "
+         << "bloqueando) ==" << endl;
+    cout << "políticas: " << (ok ? "OK" : "FALHOU") << endl;
+    for (bool comSessao : {false, true}) {
+        for (size_t prod : {1, 2, 4, 8}) {
+            // fim a fim é limitado pela sessão: mede uma fração
+            size_t n = comSessao ? N / 4 : N;
+            ResultadoProdutores r = medirProdutores(p, prod, n, TAM, comSessao);
+            cout << left << setw(6) << (comSessao ? "sessao" : "fila") << right << setw(2) << prod
+                 << " produtores" << fixed << setprecision(0) << setw(11)
+                 << (r.ok ? n / r.segundos : 0.0) << " msgs/s" << setw(8) << r.fila.avisos << " avisos"
+                 << setw(8) << r.fila.bloqueios << " bloqueios";
+            if (comSessao) cout << setw(8) << r.registros << " separados";
+            cout << (r.ok ? "" : "  (FALHOU)") << endl;
+            ok = ok && r.ok && r.fila.aceitas == n;
+            if (comSessao) ok = ok && r.registros == n;
+        }
+    }
+    if (verificar) cout << (ok ? "Verificação OK." : "Verificação FALHOU.") << endl;
+    return ok;
+}
+
+static void uso(const char* prog) {
+    cerr << "Uso: " << prog << " <medição> [opções]\n"
+         << "Medições:\n"
+         << "  io       sendto/recvfrom por pacote x sendmmsg/recvmmsg\n"
+         << "  gso      por pacote x sendmmsg x sendmmsg com UDP_SEGMENT\n"
+         << "  trace    custo do trace por pacote no cliente\n"
+         << "  cc       goodput dos controles de congestionamento sob perda\n"
+         << "  cauda    p50/p99 de mensagens grandes sob perda, com e sem retransmissão rápida\n"
+         << "  cadencia perdas na fila curta de um gargalo e goodput, com e sem cadência\n"
+         << "  codec    serialize/deserialize, lote, flags/STTL e SID (sem rede)\n"
+         << "  agrupar  mensagens/s de registros pequenos, um por pacote x Nagle/cork\n"
+         << "  produtores  mensagens/s com 1-8 threads submetendo pela fila de submissão\n"
+         << "  all      todas as medições\n"
+         << "Opções:\n"
+         << "  --mb N       MiB enviados por medição (padrão 64)\n"
+         << "  --msg N      tamanho de cada mensagem em bytes (padrão 65536)\n"
+         << "  --wnd N      janela anunciada pela central, de 1 a 65535 (padrão 65535)\n"
+         << "  --delay MS   atraso por sentido na central (cc e cauda usam 2 se omitido)\n"
+         << "  --n N        mensagens medidas em cauda (padrão 200)\n"
+         << "  --verificar  cauda termina com erro se alguma mensagem falhar ou se a\n"
+         << "               retransmissão rápida não disparar; codec, se o codec otimizado\n"
+         << "               divergir da referência; agrupar, se a central não separar\n"
+         << "               todos os registros; produtores, se alguma mensagem se perder;\n"
+         << "               cadencia, se a cadência falhar, atrasar a transferência ou não\n"
+         << "               reduzir as perdas nas filas curtas\n";
+}
+
+int main(int argc, char** argv) {
+    if (argc < 2) { uso(argv[0]); return 1; }
+    string qual = argv[1];
+
+    ParametrosTransferencia p;
+    size_t mensagensCauda = 200;
+    bool verificar = false;
+    for (int i = 2; i < argc; i++) {
+        string a = argv[i];
+        if (a == "--verificar") { verificar = true; continue; }
+        if (i + 1 >= argc) { uso(argv[0]); return 1; }
+        if      (a == "--mb")  p.totalBytes = strtoull(argv[++i], nullptr, 10) << 20;
+        else if (a == "--msg") p.tamanhoMsg = strtoull(argv[++i], nullptr, 10);
+        else if (a == "--wnd") {
+            if (!lerJanela(argv[++i], p.janela)) {
+                cerr << "Janela invalida: " << argv[i] << " (use 1 a 65535)" << endl;
+                return 1;
+            }
+        }
+        else if (a == "--delay") p.atrasoMs = atof(argv[++i]);
+        else if (a == "--n")   mensagensCauda = strtoull(argv[++i], nullptr, 10);
+        else { uso(argv[0]); return 1; }
+    }
+
+    bool todas = qual == "all";
+    bool algum = false;
+    if (todas || qual == "codec") {
+        if (!benchCodec() && verificar) return 1;
+        algum = true;
+    }
+    if (todas || qual == "io") { benchIO(p); algum = true; }
+    if (todas || qual == "gso") { benchGSO(p); algum = true; }
+    if (todas || qual == "trace") { benchTrace(p); algum = true; }
+    if (todas || qual == "cc") { benchCC(p); algum = true; }
+    if (todas || qual == "cadencia") {
+        if (!benchCadencia(verificar) && verificar) return 1;
+        algum = true;
+    }
+    if (todas || qual == "cauda") {
+        if (!benchCauda(p, mensagensCauda, verificar) && verificar) return 1;
+        algum = true;
+    }
+    if (todas || qual == "agrupar") {
+        if (!benchAgrupar(p, verificar) && verificar) return 1;
+        algum = true;
+    }
+    if (todas || qual == "produtores") {
+        if (!benchProdutores(p, verificar) && verificar) return 1;
+        algum = true;
+    }
+    if (!algum) { uso(argv[0]); return 1; }
+    return 0;
+}
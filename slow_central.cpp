@@ -0,0 +1,107 @@
+/*
+ * slow_central.cpp
+ * Autores:
+ *  Enzo Tonon Morente - 14568476
+ *  João Pedro Alves Notari Godoy - 14582076
+ *  Letícia Barbosa Neves - 14582076
+ * Descrição: Central SLOW local para testes e medições do slow_peripheral
+ *            sem depender de slow.gmelodie.com
+ */
+
+#include <iostream>
+#include <string>
+#include <cstdlib>
+#include <csignal>
+#include <atomic>
+
+#include "slow_central.h"
+
+using namespace std;
+
+static atomic<bool> parar{false};
+
+static void tratarSinal(int) { parar = true; }
+
+static void uso(const char* prog) {
+    cerr << "Uso: " << prog << " [opções]\n"
+         << "  --bind ADDR      endereço local (padrão 127.0.0.1)\n"
+         << "  --port N         porta UDP (padrão 7033, 0 = qualquer)\n"
+         << "  --loss P         prob. de perder datagrama recebido (0..1)\n"
+         << "  --ack-loss P     prob. de perder datagrama enviado (0..1)\n"
+         << "  --delay MS       atraso fixo por sentido\n"
+         << "  --jitter MS      variação uniforme somada ao atraso\n"
+         << "  --reorder P      prob. de segurar um datagrama para reordenar\n"
+         << "  --rate MBPS      gargalo na entrada (padrão sem limite)\n"
+         << "  --queue BYTES    fila do gargalo (padrão 32768)\n"
+         << "  --wnd BYTES      janela anunciada, de 1 a 65535 (padrão " << 5 * DATA_MAX << ")\n"
+         << "  --sttl MS        tempo de vida da sessão (padrão 60000)\n"
+         << "  --isn N          seq fixo do SETUP (testes de wraparound)\n"
+         << "  --seed N         semente do gerador aleatório\n"
+         << "  --echo           devolve cada mensagem recebida ao periférico\n"
+         << "  --split          separa os registros de mensagens agrupadas (--coalesce do periférico)\n"
+         << "  -q               não imprime as mensagens recebidas\n"
+         << "  -v               imprime todos os cabeçalhos\n";
+}
+
+int main(int argc, char** argv) {
+    ConfigCentral cfg;
+    cfg.mostrarMensagens = true;
+
+    for (int i = 1; i < argc; i++) {
+        string a = argv[i];
+        auto valor = [&]() -> const char* {
+            if (i + 1 >= argc) { uso(argv[0]); exit(1); }
+            return argv[++i];
+        };
+        if      (a == "--bind")     cfg.endereco = valor();
+        else if (a == "--port")     cfg.porta = atoi(valor());
+        else if (a == "--loss")     cfg.perda = atof(valor());
+        else if (a == "--ack-loss") cfg.perdaAck = atof(valor());
+        else if (a == "--delay")    cfg.atrasoMs = atof(valor());
+        else if (a == "--jitter")   cfg.jitterMs = atof(valor());
+        else if (a == "--reorder")  cfg.reordem = atof(valor());
+        else if (a == "--rate")     cfg.taxaMbps = atof(valor());
+        else if (a == "--queue")    cfg.filaBytes = (uint32_t)strtoul(valor(), nullptr, 10);
+        else if (a == "--wnd") {
+            const char* v = valor();
+            if (!lerJanela(v, cfg.janela)) {
+                cerr << "Janela invalida: " << v << " (use 1 a 65535)" << endl;
+                return 1;
+            }
+        }
+        else if (a == "--sttl")     cfg.sttlMs = (uint32_t)strtoul(valor(), nullptr, 10);
+        else if (a == "--isn")    { cfg.isnFixo = true; cfg.isn = (uint32_t)strtoul(valor(), nullptr, 10); }
+        else if (a == "--seed")     cfg.semente = (uint32_t)strtoul(valor(), nullptr, 10);
+        else if (a == "--echo")     cfg.eco = true;
+        else if (a == "--split")    cfg.desagrupar = true;
+        else if (a == "-q")         cfg.mostrarMensagens = false;
+        else if (a == "-v")         cfg.verboso = true;
+        else { uso(argv[0]); return 1; }
+    }
+
+    CentralEmulador central(cfg);
+    if (!central.abrir()) {
+        cerr << "Erro ao abrir socket em " << cfg.endereco << ":" << cfg.porta << endl;
+        return 1;
+    }
+
+    signal(SIGINT, tratarSinal);
+    signal(SIGTERM, tratarSinal);
+
+    cout << "Central SLOW escutando em " << cfg.endereco << ":" << central.porta() << endl;
+    central.executar(parar);
+
+    const EstatisticasCentral& e = central.estatisticas();
+    cout << "\nrecebidos=" << e.recebidos << " perdidos_entrada=" << e.perdidosEntrada
+         << " perdidos_saida=" << e.perdidosSaida << " perdidos_fila=" << e.perdidosFila
+         << " enviados=" << e.enviados
+         << " duplicados=" << e.duplicados << " fora_de_ordem=" << e.foraDeOrdem
+         << "\nsessoes=" << e.sessoes << " revives=" << e.revives
+         << " revives_recusados=" << e.revivesRecusados
+         << " mensagens=" << e.mensagens << " bytes=" << e.bytes;
+    if (cfg.eco) cout << " ecos=" << e.ecos << " ecos_recusados=" << e.ecosRecusados;
+    if (cfg.desagrupar)
+        cout << " registros=" << e.registros << " agrupamentos_invalidos=" << e.agrupamentosInvalidos;
+    cout << endl;
+    return 0;
+}
@@ -0,0 +1,633 @@
+/*
+ * slow_central.h
+ * Autores:
+ *  Enzo Tonon Morente - 14568476
+ *  João Pedro Alves Notari Godoy - 14582076
+ *  Letícia Barbosa Neves - 14582076
+ * Descrição: Emulador local da central SLOW. Fala o mesmo cabeçalho de 32 bytes
+ *            que slow.gmelodie.com (connect/setup, ACK cumulativo, fragmentação,
+ *            disconnect e revive) e permite injetar perda, atraso, jitter e
+ *            reordenação, além de escolher a janela anunciada.
+ */
+
+#ifndef SLOW_CENTRAL_H
+#define SLOW_CENTRAL_H
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <queue>
+#include <random>
+#include <atomic>
+#include <thread>
+#include <chrono>
+#include <functional>
+#include <unordered_map>
+#include <optional>
+#include <algorithm>
+#include <cstdlib>
+#include <cerrno>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <arpa/inet.h>
+
+#include "slow_protocol.h"
+#include "slow_agrupamento.h"
+#include "slow_transporte.h"
+
+// Parâmetros do emulador (todos ajustáveis pela linha de comando do slow_central)
+struct ConfigCentral {
+    std::string endereco = "127.0.0.1"; // endereço de bind (loopback por padrão)
+    int      porta     = 7033;          // 0 = porta escolhida pelo kernel
+    double   perda     = 0.0;           // prob. de descartar datagrama recebido
+    double   perdaAck  = 0.0;           // prob. de descartar datagrama enviado
+    double   atrasoMs  = 0.0;           // atraso fixo em cada sentido
+    double   jitterMs  = 0.0;           // variação uniforme somada ao atraso
+    double   reordem   = 0.0;           // prob. de segurar um datagrama (reordenação)
+    double   taxaMbps  = 0.0;           // gargalo na entrada (0 = sem limite)
+    uint32_t filaBytes = 32 * 1024;     // fila do gargalo; o excesso é descartado
+    uint16_t janela    = 5 * DATA_MAX;  // janela anunciada (bytes)
+    uint32_t sttlMs    = 60000;         // tempo de vida da sessão após inatividade
+    uint32_t semente   = 1;             // semente do gerador (execuções reprodutíveis)
+    bool     isnFixo   = false;         // usa isn em vez de sortear o seq do SETUP
+    uint32_t isn       = 0;
+    bool     verboso   = false;         // imprime cada cabeçalho trocado
+    bool     mostrarMensagens = false;  // imprime uma linha por mensagem remontada
+    bool     eco       = false;         // devolve cada mensagem remontada ao periférico
+    bool     desagrupar = false;        // separa os registros de mensagens agrupadas
+};
+
+// Lê a janela anunciada de um argumento (--wnd): decimal de 1 a 65535. Fora
+// disso retorna false em vez de truncar para 16 bits.
+inline bool lerJanela(const char* texto, uint16_t& janela) {
+    char* fim = nullptr;
+    errno = 0;
+    unsigned long v = std::strtoul(texto, &fim, 10);
+    if (fim == texto || *fim != '\0' || errno == ERANGE || v < 1 || v > UINT16_MAX) return false;
+    janela = (uint16_t)v;
+    return true;
+}
+
+// Contadores do emulador
+struct EstatisticasCentral {
+    uint64_t recebidos = 0;         // datagramas recebidos (antes da perda)
+    uint64_t perdidosEntrada = 0;   // descartados na entrada
+    uint64_t perdidosSaida = 0;     // descartados na saída
+    uint64_t perdidosFila = 0;      // descartados pela fila cheia do gargalo
+    uint64_t enviados = 0;          // datagramas efetivamente enviados
+    uint64_t duplicados = 0;        // dados com seq já confirmado
+    uint64_t foraDeOrdem = 0;       // dados guardados à espera de lacuna
+    uint64_t mensagens = 0;         // mensagens completas remontadas
+    uint64_t bytes = 0;             // bytes de aplicação entregues
+    uint64_t sessoes = 0;           // handshakes aceitos
+    uint64_t revives = 0;           // revives aceitos
+    uint64_t revivesRecusados = 0;
+    uint64_t ecos = 0;              // mensagens devolvidas no modo eco
+    uint64_t ecosRecusados = 0;     // maiores que a janela anunciada pelo periférico
+    uint64_t registros = 0;         // registros separados no modo desagrupar
+    uint64_t agrupamentosInvalidos = 0; // mensagens com enquadramento corrompido
+};
+
+class CentralEmulador {
+public:
+    using Relogio = std::chrono::steady_clock;
+    // Chamado a cada mensagem remontada (sid, conteúdo), ou a cada registro
+    // no modo desagrupar
+    using CallbackMensagem = std::function<void(const SID&, const std::string&)>;
+
+    explicit CentralEmulador(const ConfigCentral& c): cfg(c), rng(c.semente) {}
+    ~CentralEmulador() { if (fd >= 0) close(fd); }
+
+    // Cria e associa o socket UDP; retorna false em caso de erro
+    bool abrir() {
+        fd = socket(AF_INET, SOCK_DGRAM, 0);
+        if (fd < 0) return false;
+        // muitos periféricos (ex.: o motor) mandam janelas inteiras ao mesmo
+        // tempo; o buffer padrão descartaria as rajadas antes da emulação
+        int buf = 4 << 20;
+        setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &buf, sizeof(buf));
+        setsockopt(fd, SOL_SOCKET, SO_SNDBUF, &buf, sizeof(buf));
+
+        sockaddr_in a{};
+        a.sin_family = AF_INET;
+        a.sin_port = htons(cfg.porta);
+        if (inet_pton(AF_INET, cfg.endereco.c_str(), &a.sin_addr) != 1) return false;
+        if (bind(fd, (sockaddr*)&a, sizeof(a)) < 0) return false;
+
+        socklen_t l = sizeof(a);
+        getsockname(fd, (sockaddr*)&a, &l);
+        portaLocal = ntohs(a.sin_port);
+        return true;
+    }
+
+    // Sem socket: a central vira um ponto da rede em memória e usa o relógio
+    // virtual dela. Os datagramas são tratados na chegada, então atraso,
+    // jitter, reordenação e gargalo ficam com o ModeloEnlace dos pontos
+    // (a perda da configuração continua valendo).
+    bool abrir(RedeVirtual& rede) {
+        ponto = &rede.novoPonto([this](const uint8_t* buf, size_t len, const sockaddr_in& de) {
+            entrada(buf, len, de);
+        });
+        relogio = &rede.relogio();
+        portaLocal = ntohs(ponto->endereco().sin_port);
+        return true;
+    }
+    // Ponto da central na rede em memória (destino dos periféricos)
+    TransporteMemoria* pontoRede() const { return ponto; }
+
+    int porta() const { return portaLocal; }
+    const EstatisticasCentral& estatisticas() const { return est; }
+    void aoReceberMensagem(CallbackMensagem cb) { callbackMensagem = std::move(cb); }
+
+    // Laço principal: roda até *parar ficar verdadeiro
+    void executar(const std::atomic<bool>& parar) {
+        std::vector<uint8_t> rbuf(65536);
+        auto ultimaLimpeza = Relogio::now();
+
+        while (!parar.load(std::memory_order_relaxed)) {
+            int espera = 100; // acorda periodicamente para checar "parar"
+            if (!fila.empty()) {
+                auto falta = std::chrono::duration_cast<std::chrono::milliseconds>(
+                    fila.top().quando - Relogio::now()).count();
+                espera = (int)std::max<long long>(0, std::min<long long>(falta, espera));
+            }
+
+            pollfd p{fd, POLLIN, 0};
+            int n = poll(&p, 1, espera);
+
+            // Esvazia o socket sem bloquear
+            if (n > 0 && (p.revents & POLLIN)) {
+                while (true) {
+                    sockaddr_in de; socklen_t dl = sizeof(de);
+                    ssize_t r = recvfrom(fd, rbuf.data(), rbuf.size(), MSG_DONTWAIT,
+                                         (sockaddr*)&de, &dl);
+                    if (r < 0) break;
+                    entrada(rbuf.data(), (size_t)r, de);
+                }
+            }
+
+            // Libera os datagramas cujo atraso já passou
+            auto agora = Relogio::now();
+            while (!fila.empty() && fila.top().quando <= agora) {
+                Evento e = fila.top();
+                fila.pop();
+                if (e.entrada) processar(e.dados.data(), e.dados.size(), e.peer);
+                else           transmitir(e.dados.data(), e.dados.size(), e.peer);
+            }
+
+            if (agora - ultimaLimpeza > std::chrono::seconds(1)) {
+                expirarSessoes(agora);
+                ultimaLimpeza = agora;
+            }
+        }
+    }
+
+private:
+    enum class Estado { SETUP_ENVIADO, ATIVA, DESCONECTADA };
+
+    // Pacote de dados guardado fora de ordem
+    struct Guardado {
+        Header h;
+        std::string payload;
+    };
+
+    // Estado de uma sessão na central
+    struct Sessao {
+        SID sid;
+        sockaddr_in peer;
+        Estado estado = Estado::SETUP_ENVIADO;
+        uint32_t isn = 0;          // seq do SETUP
+        uint32_t esperado = 0;     // próximo seq em ordem
+        std::unordered_map<uint32_t, Guardado> foraDeOrdem;
+        size_t bytesForaDeOrdem = 0;
+        std::string mensagem;      // remontagem em andamento
+        uint8_t fidAtual = 0;
+        int foEsperado = 0;
+        Relogio::time_point ultimaAtividade;
+        uint16_t janelaPeriferico = 0;   // wnd do último pacote do periférico
+        uint8_t fidEco = 0;              // fid da última mensagem de eco fragmentada
+        std::vector<std::string> ecos;   // mensagens a devolver depois do ACK
+        bool revivida = false;           // aberta por revive (seqRevive vale)
+        uint32_t seqRevive = 0;          // seq do R+ACK que reviveu a sessão
+    };
+
+    // Datagrama retido pela fila de atraso
+    struct Evento {
+        Relogio::time_point quando;
+        uint64_t ordem;            // desempate estável para atrasos iguais
+        bool entrada;              // true = chegando na central, false = saindo
+        std::vector<uint8_t> dados;
+        sockaddr_in peer;
+        bool operator>(const Evento& o) const {
+            return quando != o.quando ? quando > o.quando : ordem > o.ordem;
+        }
+    };
+
+    ConfigCentral cfg;
+    int fd = -1;
+    int portaLocal = 0;
+    std::mt19937_64 rng;
+    std::priority_queue<Evento, std::vector<Evento>, std::greater<Evento>> fila;
+    uint64_t ordemEventos = 0;
+    std::unordered_map<SID, Sessao, SIDHash> sessoes;
+    EstatisticasCentral est;
+    Relogio::time_point gargaloLivre;   // quando o gargalo termina a fila atual
+    CallbackMensagem callbackMensagem;
+    TransporteMemoria* ponto = nullptr;   // rede em memória no lugar do socket
+    const FonteTempo* relogio = nullptr;
+
+    Relogio::time_point agora() const { return relogio ? relogio->agora() : Relogio::now(); }
+
+    double sorteio() { return std::uniform_real_distribution<double>(0.0, 1.0)(rng); }
+
+    // Atraso sorteado para um datagrama (0 = sem fila)
+    Relogio::duration sortearAtraso() {
+        double ms = cfg.atrasoMs;
+        if (cfg.jitterMs > 0) ms += sorteio() * cfg.jitterMs;
+        if (cfg.reordem > 0 && sorteio() < cfg.reordem)
+            ms += std::max(2.0 * cfg.jitterMs, 5.0); // segura o bastante para ser ultrapassado
+        return std::chrono::duration_cast<Relogio::duration>(
+            std::chrono::duration<double, std::milli>(ms));
+    }
+
+    void enfileirar(bool ehEntrada, const uint8_t* buf, size_t len, const sockaddr_in& peer,
+                    Relogio::duration atraso) {
+        fila.push(Evento{agora() + atraso, ordemEventos++, ehEntrada,
+                         std::vector<uint8_t>(buf, buf + len), peer});
+    }
+
+    // Datagrama chegou do socket: aplica perda e atraso de entrada
+    void entrada(const uint8_t* buf, size_t len, const sockaddr_in& de) {
+        est.recebidos++;
+        if (cfg.perda > 0 && sorteio() < cfg.perda) {
+            est.perdidosEntrada++;
+            return;
+        }
+        auto atraso = sortearAtraso();
+        if (cfg.taxaMbps > 0) {
+            auto espera = passarPeloGargalo(len);
+            if (!espera) {
+                est.perdidosFila++;
+                return;
+            }
+            atraso += *espera;
+        }
+        if (atraso.count() == 0) processar(buf, len, de);
+        else enfileirar(true, buf, len, de, atraso);
+    }
+
+    // Enlace de taxaMbps com fila drop-tail de filaBytes: retorna quanto o
+    // datagrama espera até sair do gargalo, ou nada se a fila estiver cheia
+    std::optional<Relogio::duration> passarPeloGargalo(size_t len) {
+        auto agora = this->agora();
+        if (gargaloLivre < agora) gargaloLivre = agora;
+        double bytesPorSeg = cfg.taxaMbps * 1e6 / 8;
+        double naFila = std::chrono::duration<double>(gargaloLivre - agora).count() * bytesPorSeg;
+        if (naFila + len > cfg.filaBytes) return std::nullopt;
+        gargaloLivre += std::chrono::duration_cast<Relogio::duration>(
+            std::chrono::duration<double>(len / bytesPorSeg));
+        return gargaloLivre - agora;
+    }
+
+    // Datagrama da central (com payload opcional): aplica perda e atraso de saída
+    void enviar(const Header& h, const sockaddr_in& para, const char* payload = nullptr, size_t plen = 0) {
+        uint8_t buf[HDR_SIZE + DATA_MAX];
+        serialize(h, buf);
+        if (plen > 0) memcpy(buf + HDR_SIZE, payload, plen);
+        if (cfg.verboso) printHeader(h, "CENTRAL - Enviado");
+
+        if (cfg.perdaAck > 0 && sorteio() < cfg.perdaAck) {
+            est.perdidosSaida++;
+            return;
+        }
+        auto atraso = sortearAtraso();
+        if (atraso.count() == 0) transmitir(buf, HDR_SIZE + plen, para);
+        else enfileirar(false, buf, HDR_SIZE + plen, para, atraso);
+    }
+
+    void transmitir(const uint8_t* buf, size_t len, const sockaddr_in& para) {
+        if (ponto) {
+            iovec iov{const_cast<uint8_t*>(buf), len};
+            if (ponto->enviarPara(para, &iov, 1)) est.enviados++;
+            return;
+        }
+        if (sendto(fd, buf, len, 0, (const sockaddr*)&para, sizeof(para)) >= 0)
+            est.enviados++;
+    }
+
+    // sf com o STTL configurado nos 27 bits superiores
+    uint32_t sfCom(uint32_t flags) const {
+        return ((cfg.sttlMs & STTL_MASK) << 5) | flags;
+    }
+
+    uint16_t janelaAnunciada(const Sessao& s) const {
+        if (s.bytesForaDeOrdem >= cfg.janela) return 0;
+        return static_cast<uint16_t>(cfg.janela - s.bytesForaDeOrdem);
+    }
+
+    bool expirada(const Sessao& s, Relogio::time_point agora) const {
+        return agora - s.ultimaAtividade > std::chrono::milliseconds(cfg.sttlMs);
+    }
+
+    void expirarSessoes(Relogio::time_point agora) {
+        for (auto it = sessoes.begin(); it != sessoes.end(); ) {
+            if (expirada(it->second, agora)) it = sessoes.erase(it);
+            else ++it;
+        }
+    }
+
+    // Flags de um ACK: enquanto o ACK cumulativo for o do revive, vai com AR,
+    // para não ser confundido com a recusa (ACK sem AR e ack = seq do revive)
+    uint32_t flagsAck(const Sessao& s) const {
+        return FLAG_ACK | (s.revivida && s.esperado - 1 == s.seqRevive ? FLAG_AR : 0);
+    }
+
+    // ACK cumulativo: confirma tudo até esperado-1 (seq ecoa o ack, como a central pública)
+    void enviarAck(Sessao& s) {
+        Header r;
+        r.sid = s.sid;
+        r.sf  = sfCom(flagsAck(s));
+        r.seq = s.esperado - 1;
+        r.ack = s.esperado - 1;
+        r.wnd = janelaAnunciada(s);
+        enviar(r, s.peer);
+    }
+
+    // Modo eco: devolve as mensagens remontadas em fragmentos de DATA_MAX.
+    // Cada fragmento é um ACK igual ao de enviarAck com payload e fid/fo/MB,
+    // sem retransmissão (perda e reordenação de saída valem para eles).
+    // Mensagens maiores que a janela anunciada pelo periférico são recusadas.
+    void enviarEcos(Sessao& s) {
+        for (const std::string& m : s.ecos) {
+            if (m.size() > s.janelaPeriferico || m.size() > MAX_MENSAGEM) {
+                est.ecosRecusados++;
+                continue;
+            }
+            est.ecos++;
+            size_t nFrag = std::max<size_t>(1, (m.size() + DATA_MAX - 1) / DATA_MAX);
+            uint8_t fid = 0;
+            if (nFrag > 1) fid = s.fidEco = s.fidEco == 255 ? 1 : s.fidEco + 1;
+            for (size_t i = 0; i < nFrag; i++) {
+                size_t off = i * DATA_MAX;
+                size_t n = std::min<size_t>(DATA_MAX, m.size() - off);
+                Header r;
+                r.sid = s.sid;
+                r.sf  = sfCom(flagsAck(s) | (i + 1 < nFrag ? FLAG_MB : 0));
+                r.seq = s.esperado - 1;
+                r.ack = s.esperado - 1;
+                r.wnd = janelaAnunciada(s);
+                r.fid = fid;
+                r.fo  = (uint8_t)i;
+                enviar(r, s.peer, m.data() + off, n);
+            }
+        }
+        s.ecos.clear();
+    }
+
+    // Pacote já liberado pela fila de atraso: interpreta o cabeçalho
+    void processar(const uint8_t* buf, size_t len, const sockaddr_in& de) {
+        if (len < (size_t)HDR_SIZE) return;
+        Header h;
+        deserialize(h, buf);
+        if (cfg.verboso) printHeader(h, "CENTRAL - Recebido");
+
+        const char* payload = (const char*)buf + HDR_SIZE;
+        size_t plen = len - HDR_SIZE;
+        uint32_t f = h.flags();
+
+        if (f == FLAG_C) { conectar(h, de); return; }
+
+        auto it = sessoes.find(h.sid);
+        if (it == sessoes.end()) {
+            // Revive de sessão desconhecida é recusado explicitamente
+            if ((f & FLAG_R) && !(f & FLAG_C)) recusarRevive(h, de);
+            return;
+        }
+        Sessao& s = it->second;
+        auto agora = this->agora();
+
+        if ((f & (FLAG_C | FLAG_R | FLAG_ACK)) == (FLAG_C | FLAG_R | FLAG_ACK)) {
+            desconectar(s, h, de, agora);
+        } else if ((f & FLAG_R) && (f & FLAG_ACK)) {
+            reviver(s, h, payload, plen, de, agora);
+        } else if (f & FLAG_ACK) {
+            dados(s, h, payload, plen, de, agora);
+        }
+    }
+
+    // CONNECT -> SETUP com SID novo e seq inicial
+    void conectar(const Header& h, const sockaddr_in& de) {
+        Sessao s;
+        for (int i = 0; i < 16; i += 8) {
+            uint64_t v = rng();
+            memcpy(s.sid.b + i, &v, 8);
+        }
+        s.peer = de;
+        s.isn = cfg.isnFixo ? cfg.isn : (uint32_t)rng();
+        s.esperado = s.isn + 1;
+        s.ultimaAtividade = agora();
+
+        Header r;
+        r.sid = s.sid;
+        r.sf  = sfCom(FLAG_AR);
+        r.seq = s.isn;
+        r.ack = h.seq;
+        r.wnd = cfg.janela;
+
+        est.sessoes++;
+        sessoes[s.sid] = std::move(s);
+        enviar(r, de);
+    }
+
+    void desconectar(Sessao& s, const Header& h, const sockaddr_in& de, Relogio::time_point agora) {
+        s.peer = de;
+        s.estado = Estado::DESCONECTADA;
+        s.ultimaAtividade = agora;
+        s.esperado = h.seq + 1;
+        s.foraDeOrdem.clear();
+        s.bytesForaDeOrdem = 0;
+        s.mensagem.clear();
+        s.revivida = false;
+
+        Header r;
+        r.sid = s.sid;
+        r.sf  = sfCom(FLAG_ACK);
+        r.seq = h.seq;
+        r.ack = h.seq;
+        r.wnd = 0;
+        enviar(r, de);
+    }
+
+    void recusarRevive(const Header& h, const sockaddr_in& de) {
+        est.revivesRecusados++;
+        Header r;
+        r.sid = h.sid;
+        r.sf  = FLAG_ACK; // sem AR: revive negado
+        r.seq = h.seq;
+        r.ack = h.seq;
+        enviar(r, de);
+    }
+
+    // Revive (R+ACK): aceito se a sessão ainda está dentro do STTL. Os dados
+    // que o periférico manda logo atrás (seq > h.seq) e chegaram antes já
+    // estão guardados fora de ordem e são entregues em seguida. Um revive
+    // repetido (retransmitido) só tem o ACK reenviado.
+    void reviver(Sessao& s, const Header& h, const char* payload, size_t plen,
+                 const sockaddr_in& de, Relogio::time_point agora) {
+        if (expirada(s, agora)) {
+            SID sid = s.sid;
+            sessoes.erase(sid);
+            recusarRevive(h, de);
+            return;
+        }
+        s.peer = de;
+        s.ultimaAtividade = agora;
+        s.janelaPeriferico = h.wnd;
+        if (s.estado == Estado::ATIVA && s.revivida && h.seq == s.seqRevive) {
+            est.duplicados++;
+            enviarAck(s);
+            return;
+        }
+        est.revives++;
+        s.estado = Estado::ATIVA;
+        s.revivida = true;
+        s.seqRevive = h.seq;
+        s.esperado = h.seq + 1;
+        for (auto g = s.foraDeOrdem.begin(); g != s.foraDeOrdem.end(); ) {
+            if (seqMenor(h.seq, g->first)) { ++g; continue; }
+            s.bytesForaDeOrdem -= g->second.payload.size(); // de antes do revive
+            g = s.foraDeOrdem.erase(g);
+        }
+        s.mensagem.clear();
+        s.foEsperado = 0;
+        if (plen > 0 || (h.flags() & FLAG_MB))
+            entregar(s, h, payload, plen); // dados que vieram junto com o revive
+        consumirGuardados(s);
+
+        Header r;
+        r.sid = s.sid;
+        r.sf  = sfCom(FLAG_AR | FLAG_ACK);
+        r.seq = s.esperado - 1;
+        r.ack = s.esperado - 1;
+        r.wnd = janelaAnunciada(s);
+        enviar(r, de);
+        if (!s.ecos.empty()) enviarEcos(s);
+    }
+
+    // Pacote de dados (ou ACK final do handshake)
+    void dados(Sessao& s, const Header& h, const char* payload, size_t plen,
+               const sockaddr_in& de, Relogio::time_point agora) {
+        s.peer = de;
+        s.ultimaAtividade = agora;
+        s.janelaPeriferico = h.wnd;
+
+        if (s.estado == Estado::SETUP_ENVIADO) {
+            s.estado = Estado::ATIVA;
+            // ACK (3/3) do handshake: não carrega dados e não é confirmado
+            if (plen == 0 && h.ack == s.isn && h.seq != s.esperado) return;
+        }
+        if (s.estado == Estado::DESCONECTADA) {
+            // dados que ultrapassaram o revive: ficam para ele, sem ACK
+            if (!seqMenor(h.seq, s.esperado)) guardar(s, h, payload, plen);
+            return;
+        }
+
+        if (seqMenor(h.seq, s.esperado)) {
+            est.duplicados++;                 // já confirmado: reenvia o ACK
+        } else if (h.seq == s.esperado) {
+            entregar(s, h, payload, plen);
+            s.esperado++;
+            consumirGuardados(s);
+        } else {
+            guardar(s, h, payload, plen);
+        }
+        enviarAck(s);
+        if (!s.ecos.empty()) enviarEcos(s);
+    }
+
+    // Guarda um pacote fora de ordem (cabendo na janela)
+    void guardar(Sessao& s, const Header& h, const char* payload, size_t plen) {
+        if (s.foraDeOrdem.count(h.seq) || s.bytesForaDeOrdem + plen > cfg.janela) return;
+        est.foraDeOrdem++;
+        s.foraDeOrdem[h.seq] = Guardado{h, std::string(payload, plen)};
+        s.bytesForaDeOrdem += plen;
+    }
+
+    // Consome o que estava guardado logo após a lacuna
+    void consumirGuardados(Sessao& s) {
+        for (auto g = s.foraDeOrdem.find(s.esperado); g != s.foraDeOrdem.end();
+             g = s.foraDeOrdem.find(s.esperado)) {
+            s.bytesForaDeOrdem -= g->second.payload.size();
+            entregar(s, g->second.h, g->second.payload.data(), g->second.payload.size());
+            s.foraDeOrdem.erase(g);
+            s.esperado++;
+        }
+    }
+
+    // Remonta fragmentos em ordem (fid/fo/MB) e entrega mensagens completas
+    void entregar(Sessao& s, const Header& h, const char* payload, size_t plen) {
+        if (h.fo == 0) {
+            s.mensagem.clear();
+            s.fidAtual = h.fid;
+        } else if (h.fid != s.fidAtual || h.fo != (uint8_t)s.foEsperado) {
+            std::cerr << "[central] fragmento inesperado fid=" << (int)h.fid
+                      << " fo=" << (int)h.fo << ", descartando remontagem" << std::endl;
+            s.mensagem.clear();
+            s.foEsperado = 0;
+            return;
+        }
+        s.mensagem.append(payload, plen);
+        s.foEsperado = h.fo + 1;
+
+        if (!(h.flags() & FLAG_MB)) {
+            est.mensagens++;
+            est.bytes += s.mensagem.size();
+            if (cfg.mostrarMensagens) {
+                std::cout << "[central] mensagem completa (" << s.mensagem.size() << " bytes): \""
+                          << s.mensagem.substr(0, 50) << (s.mensagem.size() > 50 ? "..." : "")
+                          << "\"\n";
+            }
+            if (cfg.desagrupar) {
+                bool ok = desagrupar(s.mensagem, [&](std::string_view r) {
+                    est.registros++;
+                    if (callbackMensagem) callbackMensagem(s.sid, std::string(r));
+                });
+                if (!ok) est.agrupamentosInvalidos++;
+            } else if (callbackMensagem) {
+                callbackMensagem(s.sid, s.mensagem);
+            }
+            if (cfg.eco) s.ecos.push_back(std::move(s.mensagem));
+            s.mensagem.clear();
+            s.foEsperado = 0;
+        }
+    }
+};
+
+// Central emulada numa thread, escutando numa porta livre de loopback (para
+// os testes e o slow_bench). Sai do programa se não conseguir abrir.
+class CentralEmThread {
+public:
+    explicit CentralEmThread(const ConfigCentral& cfg): central(cfg) {
+        if (!central.abrir()) {
+            std::cerr << "Erro ao abrir a central emulada." << std::endl;
+            std::exit(1);
+        }
+        t = std::thread([this] { central.executar(parar); });
+    }
+    ~CentralEmThread() { encerrar(); }
+    // Para a central antes do fim do escopo (o cliente fica sem resposta)
+    void encerrar() {
+        parar = true;
+        if (t.joinable()) t.join();
+    }
+    int porta() const { return central.porta(); }
+    const EstatisticasCentral& estatisticas() const { return central.estatisticas(); }
+
+private:
+    CentralEmulador central;
+    std::atomic<bool> parar{false};
+    std::thread t;
+};
+
+#endif // SLOW_CENTRAL_H
@@ -0,0 +1,472 @@
+/*
+ * slow_loadgen.cpp
+ * Autores:
+ *  Enzo Tonon Morente - 14568476
+ *  João Pedro Alves Notari Godoy - 14582076
+ *  Letícia Barbosa Neves - 14582076
+ * Descrição: Gerador de carga: N sessões UDPPeripheral simultâneas contra uma
+ *            central (ou o emulador no próprio processo), com distribuição de
+ *            tamanhos, taxa alvo e troca de sessões (disconnect + revive).
+ *            Reporta p50/p99/p999 da latência envio -> ACK, mensagens/s e
+ *            goodput, em texto ou numa linha JSON para a CI
+ */
+
+#include <iostream>
+#include <iomanip>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <deque>
+#include <memory>
+#include <optional>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <random>
+#include <algorithm>
+#include <cstdlib>
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+
+#include "slow_peripheral.h"
+#include "slow_central.h"
+
+using namespace std;
+using Relogio = chrono::steady_clock;
+
+// Tamanho das mensagens: "N" (fixo), "A-B" (uniforme), "exp:MEDIA"
+// (exponencial, cortada em MAX_MENSAGEM) ou "T1:P1,T2:P2,..." (mistura com
+// pesos)
+class DistribuicaoTamanho {
+public:
+    bool interpretar(const string& s) {
+        texto = s;
+        try {
+            if (s.rfind("exp:", 0) == 0) {
+                tipo = EXPONENCIAL;
+                media = stod(s.substr(4));
+                return media >= 1;
+            }
+            if (s.find(':') != string::npos) {
+                tipo = MISTURA;
+                stringstream in(s);
+                string item;
+                vector<double> pesos;
+                while (getline(in, item, ',')) {
+                    size_t c = item.find(':');
+                    if (c == string::npos) return false;
+                    tamanhos.push_back(stoull(item.substr(0, c)));
+                    pesos.push_back(stod(item.substr(c + 1)));
+                }
+                mistura = discrete_distribution<size_t>(pesos.begin(), pesos.end());
+                return !tamanhos.empty() && *max_element(tamanhos.begin(), tamanhos.end()) <= MAX_MENSAGEM;
+            }
+            size_t h = s.find('-');
+            tipo = h == string::npos ? FIXO : UNIFORME;
+            minimo = stoull(s.substr(0, h));
+            maximo = h == string::npos ? minimo : stoull(s.substr(h + 1));
+            return minimo <= maximo && maximo <= MAX_MENSAGEM;
+        } catch (...) {
+            return false;
+        }
+    }
+
+    size_t sortear(mt19937& rng) {
+        switch (tipo) {
+        case FIXO:        return minimo;
+        case UNIFORME:    return uniform_int_distribution<size_t>(minimo, maximo)(rng);
+        case EXPONENCIAL: return min<size_t>((size_t)exponential_distribution<double>(1.0 / media)(rng) + 1, MAX_MENSAGEM);
+        default:          return tamanhos[mistura(rng)];
+        }
+    }
+
+    const string& descricao() const { return texto; }
+
+private:
+    enum { FIXO, UNIFORME, EXPONENCIAL, MISTURA } tipo = FIXO;
+    size_t minimo = 1000, maximo = 1000;
+    double media = 0;
+    vector<size_t> tamanhos;
+    discrete_distribution<size_t> mistura;
+    string texto = "1000";
+};
+
+struct Opcoes {
+    string host = "127.0.0.1";
+    int porta = 7033;
+    bool local = false;          // sobe o emulador da central numa thread
+    double perda = 0, atrasoMs = 0;
+    size_t sessoes = 16;
+    size_t threads = 1;
+    double duracao = 10;         // s de medição
+    double aquecimento = 1;      // s antes da medição (descartados)
+    double taxa = 0;             // mensagens/s no total (0 = laço fechado)
+    size_t pipeline = 8;         // mensagens em voo por sessão no laço fechado
+    DistribuicaoTamanho tamanho;
+    double troca = 0;            // prob. de disconnect + revive após cada mensagem
+    bool json = false;
+    double maxP99Ms = 0;         // falha se o p99 passar disso (0 = sem limite)
+    double minTaxa = 0;          // falha se mensagens/s ficar abaixo (0 = sem limite)
+    uint32_t semente = 1;
+};
+
+// O que cada thread mediu (somado no fim)
+struct Resultado {
+    vector<double> latenciasUs;
+    uint64_t mensagens = 0, bytes = 0;       // confirmadas dentro da medição
+    uint64_t falhas = 0;                     // mensagens concluídas com erro
+    uint64_t trocas = 0, revivesFalhos = 0;  // disconnect + revive
+    uint64_t sessoesPerdidas = 0;            // sem revive possível: saem da carga
+    uint64_t retransmissoes = 0;
+
+    void somar(const Resultado& o) {
+        latenciasUs.insert(latenciasUs.end(), o.latenciasUs.begin(), o.latenciasUs.end());
+        mensagens += o.mensagens;
+        bytes += o.bytes;
+        falhas += o.falhas;
+        trocas += o.trocas;
+        revivesFalhos += o.revivesFalhos;
+        sessoesPerdidas += o.sessoesPerdidas;
+        retransmissoes += o.retransmissoes;
+    }
+};
+
+// Sessões de uma thread, esperadas num epoll só (o epoll de cada sessão
+// fica dentro dele) mais um timerfd com o próximo envio agendado
+class Carga {
+public:
+    Carga(const Opcoes& o, uint32_t semente, const string& payload)
+        : op(o), dist(o.tamanho), rng(semente), payload(payload) {}
+
+    // Handshake de "n" sessões (antes de a medição começar)
+    bool conectar(size_t n, const char* host, int porta) {
+        sessoes.resize(n);
+        for (Sessao& s : sessoes) {
+            s.cli = make_unique<UDPPeripheral>();
+            s.cli->setVerboso(false);
+            if (!s.cli->init(host, porta) || !s.cli->connect()) return false;
+        }
+        return true;
+    }
+
+    void executar(Relogio::time_point inicio, Relogio::time_point inicioMedicao, Relogio::time_point fim) {
+        medicao = inicioMedicao;
+        fimMedicao = fim;
+        int ep = epoll_create1(EPOLL_CLOEXEC);
+        int tfd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+        adicionar(ep, tfd, TIMER);
+        for (uint32_t i = 0; i < sessoes.size(); i++) adicionar(ep, sessoes[i].cli->descritorEventos(), i);
+
+        // taxa por sessão com fase aleatória, para as sessões não enviarem juntas
+        chrono::nanoseconds intervalo{0};
+        if (op.taxa > 0) {
+            intervalo = chrono::nanoseconds((int64_t)(1e9 * op.sessoes / op.taxa));
+            uniform_int_distribution<int64_t> fase(0, intervalo.count());
+            for (Sessao& s : sessoes) s.proximoEnvio = inicio + chrono::nanoseconds(fase(rng));
+        }
+
+        auto limiteDreno = fim + chrono::seconds(10);
+        vector<uint32_t> tocadas;
+        while (true) {
+            auto agora = Relogio::now();
+            bool enviando = agora < fim;
+            if (!enviando && (ociosa() || agora > limiteDreno)) break;
+
+            optional<Relogio::time_point> proximo;
+            for (uint32_t i = 0; i < sessoes.size(); i++) {
+                Sessao& s = sessoes[i];
+                if (s.perdida) continue;
+                if (s.trocar && s.emVoo.empty()) {
+                    trocar(s, ep);
+                    tocadas.push_back(i);
+                }
+                if (!enviando || s.trocar || s.perdida) continue;
+                size_t antes = s.emVoo.size();
+                if (op.taxa > 0) {
+                    // agendado no passado continua valendo: a latência conta desde
+                    // o instante planejado (sem omissão coordenada)
+                    while (s.proximoEnvio <= agora && s.proximoEnvio < fim) {
+                        enviar(s, s.proximoEnvio);
+                        s.proximoEnvio += intervalo;
+                    }
+                    if (s.proximoEnvio < fim && (!proximo || s.proximoEnvio < *proximo)) proximo = s.proximoEnvio;
+                } else {
+                    while (s.emVoo.size() < op.pipeline && !s.perdida) enviar(s, agora);
+                }
+                if (s.emVoo.size() != antes) tocadas.push_back(i);
+            }
+            // o submit não arma o timerfd da sessão: uma volta sem espera arma
+            for (uint32_t i : tocadas) atender(sessoes[i], ep);
+            tocadas.clear();
+
+            armar(tfd, proximo);
+            int espera = enviando ? (int)max<int64_t>(1, chrono::duration_cast<chrono::milliseconds>(
+                                        fim - Relogio::now()).count() + 1)
+                                  : 100;
+            epoll_event evs[64];
+            int n = epoll_wait(ep, evs, 64, espera);
+            for (int k = 0; k < n; k++) {
+                uint32_t i = evs[k].data.u32;
+                if (i == TIMER) {
+                    uint64_t x;
+                    if (read(tfd, &x, sizeof(x)) < 0) { /* já consumido */ }
+                    continue;
+                }
+                atender(sessoes[i], ep);
+            }
+        }
+
+        for (Sessao& s : sessoes) {
+            res.falhas += s.emVoo.size(); // não concluídas no prazo do dreno
+            res.retransmissoes += s.cli->estatisticasIO().retransmissoes;
+            if (s.cli->isActive()) s.cli->disconnect();
+        }
+        close(tfd);
+        close(ep);
+    }
+
+    Resultado& resultado() { return res; }
+
+private:
+    static const uint32_t TIMER = UINT32_MAX;
+
+    struct EmVoo {
+        Relogio::time_point referencia; // envio planejado (ou real, no laço fechado)
+        uint32_t tamanho;
+    };
+
+    struct Sessao {
+        unique_ptr<UDPPeripheral> cli;
+        Relogio::time_point proximoEnvio;
+        deque<EmVoo> emVoo;     // na ordem do submit: os callbacks vêm na mesma ordem
+        bool trocar = false;    // sorteada para disconnect + revive quando esvaziar
+        bool perdida = false;
+    };
+
+    static void adicionar(int ep, int fd, uint32_t tag) {
+        epoll_event ev{};
+        ev.events = EPOLLIN;
+        ev.data.u32 = tag;
+        epoll_ctl(ep, EPOLL_CTL_ADD, fd, &ev);
+    }
+
+    static void armar(int tfd, optional<Relogio::time_point> quando) {
+        itimerspec its{};
+        if (quando) {
+            auto ns = chrono::duration_cast<chrono::nanoseconds>(quando->time_since_epoch()).count();
+            its.it_value.tv_sec = ns / 1000000000;
+            its.it_value.tv_nsec = max<int64_t>(ns % 1000000000, 1);
+        }
+        timerfd_settime(tfd, TFD_TIMER_ABSTIME, &its, nullptr);
+    }
+
+    bool ociosa() const {
+        for (const Sessao& s : sessoes)
+            if (!s.perdida && (!s.emVoo.empty() || s.trocar)) return false;
+        return true;
+    }
+
+    void enviar(Sessao& s, Relogio::time_point referencia) {
+        uint32_t n = (uint32_t)dist.sortear(rng);
+        s.emVoo.push_back({referencia, n});
+        // o callback só guarda dois ponteiros (cabe no std::function sem alocar)
+        s.cli->submitView(string_view(payload.data(), n), [this, sp = &s](uint64_t, bool ok) {
+            concluir(*sp, ok);
+        });
+    }
+
+    void concluir(Sessao& s, bool ok) {
+        EmVoo m = s.emVoo.front();
+        s.emVoo.pop_front();
+        if (!ok) {
+            res.falhas++;
+            return;
+        }
+        if (m.referencia >= medicao && m.referencia < fimMedicao) {
+            res.latenciasUs.push_back(chrono::duration<double, micro>(Relogio::now() - m.referencia).count());
+            res.mensagens++;
+            res.bytes += m.tamanho;
+        }
+        if (op.troca > 0 && uniform_real_distribution<double>(0, 1)(rng) < op.troca) s.trocar = true;
+    }
+
+    // ACKs e retransmissões da sessão; se ela caiu (pacote abandonado),
+    // tenta o revive uma vez antes de tirá-la da carga
+    void atender(Sessao& s, int ep) {
+        if (s.perdida) return;
+        s.cli->aguardarDatagramas(0);
+        if (s.cli->isActive() || s.trocar) return;
+        if (!s.cli->zeroWay("")) {
+            res.sessoesPerdidas++;
+            s.perdida = true;
+            res.falhas += s.emVoo.size();
+            s.emVoo.clear();
+            epoll_ctl(ep, EPOLL_CTL_DEL, s.cli->descritorEventos(), nullptr);
+        }
+    }
+
+    // Troca de sessão: DISCONNECT esperando o ACK e revive (zero-way)
+    void trocar(Sessao& s, int ep) {
+        s.trocar = false;
+        res.trocas++;
+        s.cli->storeSession();
+        if (!s.cli->disconnect() && s.cli->isActive()) return; // sem ACK: segue na mesma sessão
+        if (!s.cli->zeroWay("")) {
+            res.revivesFalhos++;
+            atender(s, ep); // a sessão não está ativa: segunda tentativa ou perda
+        }
+    }
+
+    const Opcoes& op;
+    DistribuicaoTamanho dist;
+    mt19937 rng;
+    const string& payload;
+    vector<Sessao> sessoes;
+    Relogio::time_point medicao, fimMedicao;
+    Resultado res;
+};
+
+static double percentil(vector<double>& v, double q) {
+    if (v.empty()) return 0;
+    size_t k = min(v.size() - 1, (size_t)(q * v.size()));
+    nth_element(v.begin(), v.begin() + k, v.end());
+    return v[k];
+}
+
+static void uso(const char* prog) {
+    cerr << "Uso: " << prog << " [host] [porta] [opções]\n"
+         << "  --local          sobe o emulador da central no próprio processo (ignora host/porta)\n"
+         << "  --loss P         perda na entrada do emulador local (0..1)\n"
+         << "  --delay MS       atraso por sentido no emulador local\n"
+         << "  --sessions N     sessões simultâneas (padrão 16)\n"
+         << "  --threads N      threads, cada uma com uma parte das sessões (padrão 1)\n"
+         << "  --duration S     segundos de medição (padrão 10)\n"
+         << "  --warmup S       segundos antes da medição, descartados (padrão 1)\n"
+         << "  --rate R         mensagens/s no total; 0 = laço fechado (padrão 0)\n"
+         << "  --pipeline N     mensagens em voo por sessão no laço fechado (padrão 8)\n"
+         << "  --size D         tamanhos: N, A-B, exp:MEDIA ou T1:P1,T2:P2 (padrão 1000)\n"
+         << "  --churn P        prob. de disconnect + revive após cada mensagem (padrão 0)\n"
+         << "  --seed N         semente dos sorteios\n"
+         << "  --json           uma linha JSON em vez do texto\n"
+         << "  --max-p99 MS     termina com erro se o p99 passar de MS\n"
+         << "  --min-rate R     termina com erro se mensagens/s ficar abaixo de R\n";
+}
+
+int main(int argc, char** argv) {
+    Opcoes op;
+    const char* posicionais[2] = {nullptr, nullptr};
+    for (int i = 1, n = 0; i < argc; i++) {
+        string a = argv[i];
+        auto valor = [&]() -> const char* {
+            if (i + 1 >= argc) { uso(argv[0]); exit(1); }
+            return argv[++i];
+        };
+        if      (a == "--local")    op.local = true;
+        else if (a == "--json")     op.json = true;
+        else if (a == "--loss")     op.perda = atof(valor());
+        else if (a == "--delay")    op.atrasoMs = atof(valor());
+        else if (a == "--sessions") op.sessoes = max<size_t>(strtoull(valor(), nullptr, 10), 1);
+        else if (a == "--threads")  op.threads = max<size_t>(strtoull(valor(), nullptr, 10), 1);
+        else if (a == "--duration") op.duracao = atof(valor());
+        else if (a == "--warmup")   op.aquecimento = atof(valor());
+        else if (a == "--rate")     op.taxa = atof(valor());
+        else if (a == "--pipeline") op.pipeline = max<size_t>(strtoull(valor(), nullptr, 10), 1);
+        else if (a == "--churn")    op.troca = atof(valor());
+        else if (a == "--seed")     op.semente = (uint32_t)strtoul(valor(), nullptr, 10);
+        else if (a == "--max-p99")  op.maxP99Ms = atof(valor());
+        else if (a == "--min-rate") op.minTaxa = atof(valor());
+        else if (a == "--size") {
+            const char* d = valor();
+            if (!op.tamanho.interpretar(d)) {
+                cerr << "Distribuicao de tamanhos invalida: " << d << endl;
+                return 1;
+            }
+        }
+        else if (a[0] != '-' && n < 2) posicionais[n++] = argv[i];
+        else { uso(argv[0]); return 1; }
+    }
+    if (posicionais[0]) op.host = posicionais[0];
+    if (posicionais[1]) op.porta = atoi(posicionais[1]);
+    op.threads = min(op.threads, op.sessoes);
+
+    unique_ptr<CentralEmulador> central;
+    atomic<bool> pararCentral{false};
+    thread tCentral;
+    if (op.local) {
+        ConfigCentral cfg;
+        cfg.porta = 0;
+        cfg.perda = op.perda;
+        cfg.atrasoMs = op.atrasoMs;
+        cfg.semente = op.semente;
+        central = make_unique<CentralEmulador>(cfg);
+        if (!central->abrir()) {
+            cerr << "Erro ao abrir a central emulada." << endl;
+            return 1;
+        }
+        tCentral = thread([&] { central->executar(pararCentral); });
+        op.host = "127.0.0.1";
+        op.porta = central->porta();
+    }
+    auto pararEmulador = [&] {
+        if (!tCentral.joinable()) return;
+        pararCentral = true;
+        tCentral.join();
+    };
+
+    // todas as mensagens saem (sem cópia) do mesmo buffer
+    const string payload(MAX_MENSAGEM, 'L');
+    vector<unique_ptr<Carga>> cargas;
+    for (size_t t = 0; t < op.threads; t++) {
+        size_t n = op.sessoes / op.threads + (t < op.sessoes % op.threads ? 1 : 0);
+        cargas.push_back(make_unique<Carga>(op, op.semente * 7919 + (uint32_t)t, payload));
+        if (!cargas.back()->conectar(n, op.host.c_str(), op.porta)) {
+            cerr << "Falha no handshake com " << op.host << ":" << op.porta << endl;
+            pararEmulador();
+            return 1;
+        }
+    }
+
+    auto inicio = Relogio::now();
+    auto inicioMedicao = inicio + chrono::duration_cast<Relogio::duration>(chrono::duration<double>(op.aquecimento));
+    auto fim = inicioMedicao + chrono::duration_cast<Relogio::duration>(chrono::duration<double>(op.duracao));
+    vector<thread> ts;
+    for (auto& c : cargas) ts.emplace_back([&, c = c.get()] { c->executar(inicio, inicioMedicao, fim); });
+    for (thread& t : ts) t.join();
+    pararEmulador();
+
+    Resultado r;
+    for (auto& c : cargas) r.somar(c->resultado());
+    double p50 = percentil(r.latenciasUs, 0.50), p99 = percentil(r.latenciasUs, 0.99);
+    double p999 = percentil(r.latenciasUs, 0.999);
+    double maximo = r.latenciasUs.empty() ? 0 : *max_element(r.latenciasUs.begin(), r.latenciasUs.end());
+    double mps = r.mensagens / op.duracao;
+    double goodput = r.bytes / op.duracao / 1e6;
+
+    bool ok = r.falhas == 0 && r.sessoesPerdidas == 0 && r.mensagens > 0;
+    bool limites = (op.maxP99Ms <= 0 || p99 <= op.maxP99Ms * 1000) && (op.minTaxa <= 0 || mps >= op.minTaxa);
+
+    if (op.json) {
+        cout << fixed << setprecision(1) << "{\"sessoes\":" << op.sessoes << ",\"threads\":" << op.threads
+             << ",\"duracao_s\":" << op.duracao << ",\"taxa_alvo\":" << op.taxa
+             << ",\"tamanho\":\"" << op.tamanho.descricao() << "\",\"troca\":" << setprecision(4) << op.troca
+             << setprecision(1) << ",\"mensagens\":" << r.mensagens << ",\"msgs_por_s\":" << mps
+             << ",\"goodput_mb_s\":" << setprecision(3) << goodput << setprecision(1)
+             << ",\"latencia_us\":{\"p50\":" << p50 << ",\"p99\":" << p99 << ",\"p999\":" << p999
+             << ",\"max\":" << maximo << "},\"falhas\":" << r.falhas << ",\"trocas\":" << r.trocas
+             << ",\"revives_falhos\":" << r.revivesFalhos << ",\"sessoes_perdidas\":" << r.sessoesPerdidas
+             << ",\"retransmissoes\":" << r.retransmissoes << ",\"ok\":" << (ok && limites ? "true" : "false")
+             << "}" << endl;
+    } else {
+        cout << op.sessoes << " sessões em " << op.threads << " thread(s), " << op.duracao << " s, tamanhos "
+             << op.tamanho.descricao() << ", "
+             << (op.taxa > 0 ? to_string((uint64_t)op.taxa) + " msgs/s alvo" : "laço fechado") << endl
+             << fixed << setprecision(0) << "mensagens: " << r.mensagens << " (" << mps << " msgs/s), goodput "
+             << setprecision(2) << goodput << " MB/s" << endl
+             << setprecision(0) << "latência envio->ACK (us): p50 " << p50 << "  p99 " << p99 << "  p999 " << p999
+             << "  max " << maximo << endl
+             << "falhas " << r.falhas << ", trocas " << r.trocas << ", revives falhos " << r.revivesFalhos
+             << ", sessões perdidas " << r.sessoesPerdidas << ", retransmissões " << r.retransmissoes << endl;
+        if (!limites) cout << "Limites de latência/taxa não atendidos." << endl;
+    }
+    return ok && limites ? 0 : 1;
+}
@@ -0,0 +1,437 @@
+/*
+ * slow_metricas.h
+ * Autores:
+ *  Enzo Tonon Morente - 14568476
+ *  João Pedro Alves Notari Godoy - 14582076
+ *  Letícia Barbosa Neves - 14582076
+ * Descrição: Métricas do periférico: contadores, medidores e histogramas por
+ *            sessão, atualizados sem trava pela thread da sessão, um registro
+ *            que soma as sessões (vivas e encerradas) e um exportador que
+ *            escreve o retrato no formato de texto do Prometheus num arquivo
+ *            periódico ou num socket Unix
+ */
+
+#ifndef SLOW_METRICAS_H
+#define SLOW_METRICAS_H
+
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+#include <cerrno>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/eventfd.h>
+
+// Contador de um só escritor (a thread da sessão): soma sem instrução
+// atômica de leitura-modificação-escrita, lido por outras threads sem trava
+class Contador {
+public:
+    void somar(uint64_t n = 1) { v.store(v.load(std::memory_order_relaxed) + n, std::memory_order_relaxed); }
+    uint64_t valor() const { return v.load(std::memory_order_relaxed); }
+
+private:
+    std::atomic<uint64_t> v{0};
+};
+
+// Valor instantâneo (bytes em trânsito, cwnd, SRTT)
+class Medidor {
+public:
+    void definir(uint64_t x) { v.store(x, std::memory_order_relaxed); }
+    uint64_t valor() const { return v.load(std::memory_order_relaxed); }
+
+private:
+    std::atomic<uint64_t> v{0};
+};
+
+// Cópia dos valores de um histograma, somável entre sessões
+struct ValoresHistograma {
+    static constexpr size_t BALDES = 26;   // até 2^0 .. 2^25 µs (~33,5 s), mais +Inf
+    uint64_t baldes[BALDES + 1] = {};       // não cumulativos
+    uint64_t soma = 0;                      // µs
+    uint64_t n = 0;
+
+    void acumular(const ValoresHistograma& o) {
+        for (size_t i = 0; i <= BALDES; i++) baldes[i] += o.baldes[i];
+        soma += o.soma;
+        n += o.n;
+    }
+
+    // Limite superior (µs) do balde onde cai o quantil q; aproximado à
+    // potência de 2 seguinte
+    uint64_t quantil(double q) const {
+        uint64_t alvo = (uint64_t)(q * n), acc = 0;
+        for (size_t i = 0; i < BALDES; i++) {
+            acc += baldes[i];
+            if (acc > alvo) return 1ULL << i;
+        }
+        return 1ULL << BALDES;
+    }
+};
+
+// Histograma de durações em µs com baldes em potências de 2; um só escritor
+class Histograma {
+public:
+    using us = std::chrono::microseconds;
+
+    void registrar(us d) {
+        uint64_t x = d.count() > 0 ? (uint64_t)d.count() : 0;
+        size_t b = x <= 1 ? 0 : (size_t)(64 - __builtin_clzll(x - 1)); // menor b com x <= 2^b
+        if (b > ValoresHistograma::BALDES) b = ValoresHistograma::BALDES;
+        baldes[b].somar();
+        soma.somar(x);
+        n.somar();
+    }
+
+    ValoresHistograma valores() const {
+        ValoresHistograma v;
+        for (size_t i = 0; i <= ValoresHistograma::BALDES; i++) v.baldes[i] = baldes[i].valor();
+        v.soma = soma.valor();
+        v.n = n.valor();
+        return v;
+    }
+
+private:
+    Contador baldes[ValoresHistograma::BALDES + 1];
+    Contador soma, n;
+};
+
+// Métricas de uma sessão (membro de cada UDPPeripheral)
+struct MetricasSessao {
+    Contador pacotesEnviados;      // fragmentos novos (sem reenvios)
+    Contador bytesEnviados;        // payload dos fragmentos novos
+    Contador retransmissoes;
+    Contador retransmissoesRapidas;
+    Contador timeouts;             // vencimentos do RTO (um por backoff)
+    Contador pacotesDescartados;   // abandonados depois de MAX_TENTATIVAS
+    Contador janelaCheia;          // vezes que o envio parou esperando janela
+    Contador mensagensConfirmadas;
+    Contador bytesConfirmados;     // goodput: bytes de mensagens confirmadas
+    Contador mensagensFalhas;
+    Contador handshakes;
+    Contador revives;
+    Contador revivesRecusados;
+    Medidor  bytesEmTransito;
+    Medidor  cwnd;
+    Medidor  srttUs;
+    Histograma rtt;                // amostras de RTT (Karn)
+    Histograma latenciaMensagem;   // submit até o ACK do último fragmento
+    Histograma latenciaHandshake;  // primeiro CONNECT até o SETUP
+    Histograma latenciaRevive;     // revive até a resposta da central
+};
+
+// Nomes e ajuda de cada métrica, na ordem de exportação
+struct DefinicaoContador { const char* nome; const char* ajuda; Contador MetricasSessao::*campo; };
+struct DefinicaoMedidor { const char* nome; const char* ajuda; Medidor MetricasSessao::*campo; };
+struct DefinicaoHistograma { const char* nome; const char* ajuda; Histograma MetricasSessao::*campo; };
+
+inline const DefinicaoContador CONTADORES[] = {
+    {"pacotes_enviados_total", "Fragmentos de dados enviados (sem reenvios)", &MetricasSessao::pacotesEnviados},
+    {"bytes_enviados_total", "Bytes de payload enviados (sem reenvios)", &MetricasSessao::bytesEnviados},
+    {"retransmissoes_total", "Pacotes reenviados", &MetricasSessao::retransmissoes},
+    {"retransmissoes_rapidas_total", "Reenvios por ACKs duplicados", &MetricasSessao::retransmissoesRapidas},
+    {"timeouts_total", "Vencimentos do RTO", &MetricasSessao::timeouts},
+    {"pacotes_descartados_total", "Pacotes abandonados apos o maximo de tentativas", &MetricasSessao::pacotesDescartados},
+    {"janela_cheia_total", "Paradas do envio esperando janela", &MetricasSessao::janelaCheia},
+    {"mensagens_confirmadas_total", "Mensagens confirmadas pela central", &MetricasSessao::mensagensConfirmadas},
+    {"bytes_confirmados_total", "Bytes de mensagens confirmadas (goodput)", &MetricasSessao::bytesConfirmados},
+    {"mensagens_falhas_total", "Mensagens concluidas com erro", &MetricasSessao::mensagensFalhas},
+    {"handshakes_total", "Handshakes concluidos", &MetricasSessao::handshakes},
+    {"revives_total", "Revives aceitos", &MetricasSessao::revives},
+    {"revives_recusados_total", "Revives recusados ou sem resposta", &MetricasSessao::revivesRecusados},
+};
+inline const DefinicaoMedidor MEDIDORES[] = {
+    {"bytes_em_transito", "Bytes enviados esperando ACK", &MetricasSessao::bytesEmTransito},
+    {"cwnd_bytes", "Janela de congestionamento", &MetricasSessao::cwnd},
+    {"srtt_microssegundos", "RTT suavizado", &MetricasSessao::srttUs},
+};
+inline const DefinicaoHistograma HISTOGRAMAS[] = {
+    {"rtt_segundos", "Amostras de RTT", &MetricasSessao::rtt},
+    {"latencia_mensagem_segundos", "Do submit ao ACK do ultimo fragmento", &MetricasSessao::latenciaMensagem},
+    {"latencia_handshake_segundos", "Do primeiro CONNECT ao SETUP", &MetricasSessao::latenciaHandshake},
+    {"latencia_revive_segundos", "Do revive a resposta da central", &MetricasSessao::latenciaRevive},
+};
+constexpr size_t N_CONTADORES = sizeof(CONTADORES) / sizeof(CONTADORES[0]);
+constexpr size_t N_HISTOGRAMAS = sizeof(HISTOGRAMAS) / sizeof(HISTOGRAMAS[0]);
+
+// Posição de um campo nas tabelas acima (e nos totais do registro)
+inline size_t indiceMetrica(Contador MetricasSessao::*campo) {
+    for (size_t c = 0; c < N_CONTADORES; c++)
+        if (CONTADORES[c].campo == campo) return c;
+    return 0;
+}
+inline size_t indiceMetrica(Histograma MetricasSessao::*campo) {
+    for (size_t h = 0; h < N_HISTOGRAMAS; h++)
+        if (HISTOGRAMAS[h].campo == campo) return h;
+    return 0;
+}
+
+// Sessões vivas (por ponteiro, com um rótulo) e o acumulado das que já
+// saíram. A trava só é tomada ao entrar, sair e exportar; o caminho de dados
+// escreve direto nas métricas da própria sessão.
+class RegistroMetricas {
+public:
+    void adicionar(const MetricasSessao* m, std::string rotulo) {
+        std::lock_guard<std::mutex> lk(mtx);
+        sessoes.push_back({m, std::move(rotulo)});
+    }
+
+    // A sessão vai ser destruída: os contadores dela entram no acumulado
+    void remover(const MetricasSessao* m) {
+        std::lock_guard<std::mutex> lk(mtx);
+        for (size_t i = 0; i < sessoes.size(); i++) {
+            if (sessoes[i].m != m) continue;
+            for (size_t c = 0; c < N_CONTADORES; c++) encerradas.contadores[c] += (m->*CONTADORES[c].campo).valor();
+            for (size_t h = 0; h < N_HISTOGRAMAS; h++)
+                encerradas.histogramas[h].acumular((m->*HISTOGRAMAS[h].campo).valores());
+            sessoes[i] = std::move(sessoes.back());
+            sessoes.pop_back();
+            return;
+        }
+    }
+
+    // Totais de todas as sessões (vivas e encerradas)
+    struct Totais {
+        uint64_t contadores[N_CONTADORES] = {};
+        ValoresHistograma histogramas[N_HISTOGRAMAS];
+        uint64_t bytesEmTransito = 0;
+        size_t sessoes = 0;
+    };
+
+    Totais totais() const {
+        std::lock_guard<std::mutex> lk(mtx);
+        Totais t = encerradas;
+        for (const Entrada& e : sessoes) {
+            for (size_t c = 0; c < N_CONTADORES; c++) t.contadores[c] += (e.m->*CONTADORES[c].campo).valor();
+            for (size_t h = 0; h < N_HISTOGRAMAS; h++)
+                t.histogramas[h].acumular((e.m->*HISTOGRAMAS[h].campo).valores());
+            t.bytesEmTransito += e.m->bytesEmTransito.valor();
+        }
+        t.sessoes = sessoes.size();
+        return t;
+    }
+
+    // Retrato no formato de texto do Prometheus: totais como slow_*, e com
+    // "porSessao" os contadores e medidores de cada sessão viva como
+    // slow_sessao_*{sessao="rótulo"} (histogramas só nos totais).
+    // "goodput" (bytes/s desde o retrato anterior) é calculado por quem chama.
+    std::string texto(bool porSessao, double goodput = -1) const {
+        Totais t = totais();
+        std::string s;
+        s.reserve(4096);
+        for (size_t c = 0; c < N_CONTADORES; c++) {
+            cabecalho(s, "slow_", CONTADORES[c].nome, CONTADORES[c].ajuda, "counter");
+            linha(s, "slow_", CONTADORES[c].nome, "", t.contadores[c]);
+        }
+        cabecalho(s, "slow_", "sessoes", "Sessoes registradas", "gauge");
+        linha(s, "slow_", "sessoes", "", t.sessoes);
+        cabecalho(s, "slow_", "bytes_em_transito", "Bytes enviados esperando ACK (todas as sessoes)", "gauge");
+        linha(s, "slow_", "bytes_em_transito", "", t.bytesEmTransito);
+        if (goodput >= 0) {
+            cabecalho(s, "slow_", "goodput_bytes_por_segundo", "Bytes confirmados por segundo desde o retrato anterior", "gauge");
+            char v[32];
+            snprintf(v, sizeof(v), "%.0f", goodput);
+            s += "slow_goodput_bytes_por_segundo ";
+            s += v;
+            s += '\n';
+        }
+        for (size_t h = 0; h < N_HISTOGRAMAS; h++) {
+            cabecalho(s, "slow_", HISTOGRAMAS[h].nome, HISTOGRAMAS[h].ajuda, "histogram");
+            histograma(s, HISTOGRAMAS[h].nome, t.histogramas[h]);
+        }
+        if (!porSessao) return s;
+
+        std::lock_guard<std::mutex> lk(mtx);
+        for (size_t c = 0; c < N_CONTADORES; c++) {
+            cabecalho(s, "slow_sessao_", CONTADORES[c].nome, CONTADORES[c].ajuda, "counter");
+            for (const Entrada& e : sessoes)
+                linha(s, "slow_sessao_", CONTADORES[c].nome, e.rotulo, (e.m->*CONTADORES[c].campo).valor());
+        }
+        for (const DefinicaoMedidor& d : MEDIDORES) {
+            cabecalho(s, "slow_sessao_", d.nome, d.ajuda, "gauge");
+            for (const Entrada& e : sessoes) linha(s, "slow_sessao_", d.nome, e.rotulo, (e.m->*d.campo).valor());
+        }
+        return s;
+    }
+
+private:
+    struct Entrada {
+        const MetricasSessao* m;
+        std::string rotulo;
+    };
+
+    static void cabecalho(std::string& s, const char* prefixo, const char* nome, const char* ajuda, const char* tipo) {
+        s += "# HELP "; s += prefixo; s += nome; s += ' '; s += ajuda; s += '\n';
+        s += "# TYPE "; s += prefixo; s += nome; s += ' '; s += tipo; s += '\n';
+    }
+
+    static void linha(std::string& s, const char* prefixo, const char* nome, const std::string& rotulo, uint64_t v) {
+        s += prefixo;
+        s += nome;
+        if (!rotulo.empty()) {
+            s += "{sessao=\"";
+            for (char c : rotulo) {
+                if (c == '"' || c == '\\') s += '\\';
+                if (c == '\n') { s += "\\n"; continue; }
+                s += c;
+            }
+            s += "\"}";
+        }
+        s += ' ';
+        s += std::to_string(v);
+        s += '\n';
+    }
+
+    // Baldes cumulativos com "le" em segundos; soma em segundos
+    static void histograma(std::string& s, const char* nome, const ValoresHistograma& v) {
+        uint64_t acc = 0;
+        char buf[96];
+        for (size_t i = 0; i <= ValoresHistograma::BALDES; i++) {
+            acc += v.baldes[i];
+            if (i < ValoresHistograma::BALDES)
+                snprintf(buf, sizeof(buf), "slow_%s_bucket{le=\"%.6f\"} ", nome, (double)(1ULL << i) / 1e6);
+            else
+                snprintf(buf, sizeof(buf), "slow_%s_bucket{le=\"+Inf\"} ", nome);
+            s += buf;
+            s += std::to_string(acc);
+            s += '\n';
+        }
+        snprintf(buf, sizeof(buf), "slow_%s_sum %.6f\n", nome, (double)v.soma / 1e6);
+        s += buf;
+        snprintf(buf, sizeof(buf), "slow_%s_count ", nome);
+        s += buf;
+        s += std::to_string(v.n);
+        s += '\n';
+    }
+
+    mutable std::mutex mtx;
+    std::vector<Entrada> sessoes;
+    Totais encerradas;
+};
+
+// Onde e como o exportador publica o retrato
+struct ConfigExportador {
+    std::string arquivo;            // reescrito a cada "periodo" (vazio = não)
+    std::chrono::milliseconds periodo{1000};
+    std::string socketUnix;         // cada conexão recebe um retrato (vazio = não)
+    bool porSessao = false;
+};
+
+// Thread que publica os retratos do registro. O arquivo é escrito num
+// temporário e renomeado, então quem lê nunca vê um retrato pela metade;
+// no socket Unix (stream), cada conexão aceita recebe o retrato e é fechada.
+class ExportadorMetricas {
+public:
+    explicit ExportadorMetricas(const RegistroMetricas& r): registro(r) {}
+    ~ExportadorMetricas() { parar(); }
+    ExportadorMetricas(const ExportadorMetricas&) = delete;
+    ExportadorMetricas& operator=(const ExportadorMetricas&) = delete;
+
+    bool iniciar(const ConfigExportador& c) {
+        cfg = c;
+        evfd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if (evfd < 0) return false;
+        if (!cfg.socketUnix.empty() && !escutar()) return false;
+        anterior = std::chrono::steady_clock::now();
+        t = std::thread([this] { laco(); });
+        return true;
+    }
+
+    // Escreve o último retrato no arquivo e encerra a thread
+    void parar() {
+        if (!t.joinable()) return;
+        uint64_t um = 1;
+        if (write(evfd, &um, sizeof(um)) < 0) { /* já sinalizado */ }
+        t.join();
+        if (!cfg.arquivo.empty()) escreverArquivo();
+        if (lfd >= 0) {
+            close(lfd);
+            unlink(cfg.socketUnix.c_str());
+        }
+        close(evfd);
+        lfd = evfd = -1;
+    }
+
+    // Retrato atual, com o goodput desde o retrato anterior
+    std::string retrato() {
+        uint64_t bytes = registro.totais().contadores[indiceMetrica(&MetricasSessao::bytesConfirmados)];
+        auto agora = std::chrono::steady_clock::now();
+        double seg = std::chrono::duration<double>(agora - anterior).count();
+        double goodput = seg > 0 ? (bytes - bytesAnteriores) / seg : 0;
+        anterior = agora;
+        bytesAnteriores = bytes;
+        return registro.texto(cfg.porSessao, goodput);
+    }
+
+private:
+    bool escutar() {
+        lfd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (lfd < 0) return false;
+        sockaddr_un sa{};
+        sa.sun_family = AF_UNIX;
+        if (cfg.socketUnix.size() >= sizeof(sa.sun_path)) return false;
+        memcpy(sa.sun_path, cfg.socketUnix.c_str(), cfg.socketUnix.size() + 1);
+        unlink(sa.sun_path); // socket de uma execução anterior
+        return bind(lfd, (sockaddr*)&sa, sizeof(sa)) == 0 && listen(lfd, 8) == 0;
+    }
+
+    void laco() {
+        auto proximo = std::chrono::steady_clock::now() + cfg.periodo;
+        while (true) {
+            int espera = -1;
+            if (!cfg.arquivo.empty()) {
+                auto resta = std::chrono::duration_cast<std::chrono::milliseconds>(
+                    proximo - std::chrono::steady_clock::now()).count();
+                espera = resta > 0 ? (int)resta : 0;
+            }
+            pollfd pfd[2] = {{evfd, POLLIN, 0}, {lfd, POLLIN, 0}};
+            int n = poll(pfd, lfd >= 0 ? 2 : 1, espera);
+            if (n < 0 && errno != EINTR) return;
+            if (pfd[0].revents) return;
+            if (lfd >= 0 && (pfd[1].revents & POLLIN)) atender();
+            if (!cfg.arquivo.empty() && std::chrono::steady_clock::now() >= proximo) {
+                escreverArquivo();
+                proximo += cfg.periodo;
+            }
+        }
+    }
+
+    void atender() {
+        int c = accept4(lfd, nullptr, nullptr, SOCK_CLOEXEC);
+        if (c < 0) return;
+        std::string s = retrato();
+        for (size_t off = 0; off < s.size();) {
+            ssize_t w = send(c, s.data() + off, s.size() - off, MSG_NOSIGNAL);
+            if (w <= 0) break;
+            off += (size_t)w;
+        }
+        close(c);
+    }
+
+    void escreverArquivo() {
+        std::string tmp = cfg.arquivo + ".tmp";
+        FILE* f = fopen(tmp.c_str(), "w");
+        if (!f) return;
+        std::string s = retrato();
+        bool ok = fwrite(s.data(), 1, s.size(), f) == s.size();
+        ok = fclose(f) == 0 && ok;
+        if (ok) rename(tmp.c_str(), cfg.arquivo.c_str());
+    }
+
+    const RegistroMetricas& registro;
+    ConfigExportador cfg;
+    std::thread t;
+    int evfd = -1, lfd = -1;
+    std::chrono::steady_clock::time_point anterior;
+    uint64_t bytesAnteriores = 0;
+};
+
+#endif // SLOW_METRICAS_H
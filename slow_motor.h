@@ -0,0 +1,515 @@
+/*
+ * slow_motor.h
+ * Autores:
+ *  Enzo Tonon Morente - 14568476
+ *  João Pedro Alves Notari Godoy - 14582076
+ *  Letícia Barbosa Neves - 14582076
+ * Descrição: Motor de várias sessões SLOW num único processo. As sessões são
+ *            repartidas entre threads de trabalho; cada uma tem um socket
+ *            UDP compartilhado pelas suas sessões, um laço de eventos
+ *            (epoll + timerfd) e uma roda de temporizadores, e entrega cada
+ *            datagrama à sessão pelo SID
+ */
+
+#ifndef SLOW_MOTOR_H
+#define SLOW_MOTOR_H
+
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <deque>
+#include <unordered_map>
+#include <random>
+#include <sys/eventfd.h>
+
+#include "slow_peripheral.h"
+
+// Conclusão da abertura de uma sessão do motor: (id, conectada)
+using CallbackSessao = function<void(uint32_t, bool)>;
+
+// Contadores do motor (somados entre os trabalhadores)
+struct EstatisticasMotor {
+    uint64_t sessoesAbertas = 0;      // handshakes concluídos
+    uint64_t sessoesFalhas = 0;       // handshakes que esgotaram as tentativas
+    uint64_t sessoesEncerradas = 0;   // fechadas ou abandonadas depois de abertas
+    uint64_t reenviosConnect = 0;     // CONNECTs reenviados por timeout
+    uint64_t datagramasRecebidos = 0;
+    uint64_t chamadasRecepcao = 0;
+    uint64_t semSessao = 0;           // SID desconhecido (ex.: ACK de sessão já fechada)
+};
+
+// Buffers por sessão pequenos: milhares de sessões num processo
+inline PerfilSessao perfilMotor() {
+    PerfilSessao p;
+    p.registrosTrace = 64;
+    p.slotsRecepcao = 4;
+    return p;
+}
+
+// Motor de sessões. abrirSessao/submit/fecharSessao podem ser chamados de
+// qualquer thread: viram comandos na fila do trabalhador da sessão, que é
+// acordado por um eventfd. Os callbacks rodam na thread do trabalhador.
+class MotorSessoes {
+public:
+    static constexpr size_t MAX_HANDSHAKES = 64; // CONNECTs em andamento por trabalhador
+
+    explicit MotorSessoes(size_t trabalhadores = 2, const PerfilSessao& perfil = perfilMotor())
+        : nTrabalhadores(max<size_t>(trabalhadores, 1)), perfil(perfil) {}
+    ~MotorSessoes() { parar(); }
+    MotorSessoes(const MotorSessoes&) = delete;
+    MotorSessoes& operator=(const MotorSessoes&) = delete;
+
+    // Ajuste aplicado a cada sessão nova antes do handshake (ex.: controle de
+    // congestionamento). Chamar antes de iniciar.
+    void setConfiguracao(function<void(UDPPeripheral&)> f) { configurar = std::move(f); }
+
+    // Registra as métricas de cada sessão, com o id como rótulo; o registro
+    // precisa viver mais que o motor. Chamar antes de iniciar.
+    void setRegistroMetricas(RegistroMetricas& r) { registro = &r; }
+
+    // Resolve o servidor, cria um socket por trabalhador e inicia as threads
+    bool iniciar(const char* host, int porta) {
+        if (!trabalhadores.empty()) return false;
+        hostent* he = gethostbyname(host);
+        if (!he) return false;
+        sockaddr_in destino{};
+        destino.sin_family = AF_INET;
+        memcpy(&destino.sin_addr, he->h_addr, he->h_length);
+        destino.sin_port = htons(porta);
+
+        for (size_t i = 0; i < nTrabalhadores; i++) {
+            trabalhadores.push_back(make_unique<Trabalhador>(destino, perfil, configurar, registro, (uint32_t)i));
+            if (!trabalhadores.back()->abrir()) {
+                trabalhadores.clear();
+                return false;
+            }
+        }
+        for (auto& t : trabalhadores) t->iniciar();
+        return true;
+    }
+
+    // Abre uma sessão (handshake no trabalhador dela). Retorna o id, já
+    // válido para submit: o que for enviado antes do handshake terminar
+    // espera por ele. cb(id, ok) informa o resultado do handshake.
+    uint32_t abrirSessao(CallbackSessao cb = nullptr) {
+        if (trabalhadores.empty() || parado) {
+            if (cb) cb(0, false);
+            return 0;
+        }
+        uint32_t id = proximoId.fetch_add(1, memory_order_relaxed);
+        Comando c;
+        c.tipo = Comando::ABRIR;
+        c.sessao = id;
+        c.cbSessao = std::move(cb);
+        trabalhadorDe(id).postar(std::move(c));
+        return id;
+    }
+
+    // Enfileira uma mensagem na sessão; cb(id, ok) como em UDPPeripheral::submit
+    // (id da mensagem dentro da sessão). Sessão inexistente ou fechada: ok = false.
+    bool submit(uint32_t sessao, string msg, CallbackEnvio cb) {
+        if (sessao == 0 || trabalhadores.empty() || parado) {
+            if (cb) cb(0, false);
+            return false;
+        }
+        Comando c;
+        c.tipo = Comando::ENVIAR;
+        c.sessao = sessao;
+        c.msg = std::move(msg);
+        c.cbEnvio = std::move(cb);
+        trabalhadorDe(sessao).postar(std::move(c));
+        return true;
+    }
+
+    // Encerra a sessão (DISCONNECT) depois que o que já foi enviado for
+    // confirmado
+    void fecharSessao(uint32_t sessao) {
+        if (sessao == 0 || trabalhadores.empty() || parado) return;
+        Comando c;
+        c.tipo = Comando::FECHAR;
+        c.sessao = sessao;
+        trabalhadorDe(sessao).postar(std::move(c));
+    }
+
+    // Para os trabalhadores: sessões ativas mandam DISCONNECT e o que estiver
+    // pendente é concluído com erro
+    void parar() {
+        if (parado.exchange(true)) return;
+        for (auto& t : trabalhadores) t->parar();
+    }
+
+    EstatisticasMotor estatisticas() const {
+        EstatisticasMotor e;
+        for (auto& t : trabalhadores) t->somar(e);
+        return e;
+    }
+
+    size_t numeroTrabalhadores() const { return nTrabalhadores; }
+
+private:
+    struct Comando {
+        enum Tipo { ABRIR, ENVIAR, FECHAR } tipo = ENVIAR;
+        uint32_t sessao = 0;
+        string msg;
+        CallbackEnvio cbEnvio;
+        CallbackSessao cbSessao;
+    };
+
+    // Sessão no trabalhador: o cliente vinculado ao socket compartilhado e o
+    // estado do handshake, feito sem bloquear
+    struct Sessao {
+        enum class Estado { ESPERANDO, CONECTANDO, ATIVA, REMOVIDA };
+        uint32_t id;
+        UDPPeripheral cli;
+        Estado estado = Estado::ESPERANDO;
+        SID sid;
+        uint32_t isn = 0;
+        uint32_t tentativas = 0;
+        EstimadorRTT::us rtoConexao = EstimadorRTT::RTO_INICIAL;
+        chrono::steady_clock::time_point prazoConexao;
+        CallbackSessao aoAbrir;
+        vector<pair<string, CallbackEnvio>> aguardando; // submits antes do handshake
+        uint32_t temporizador = RodaTemporizadores::NIL;
+        uint32_t geracao = 0;
+        bool tocada = false;       // na lista do fim da volta
+        bool fecharQuandoOciosa = false;
+
+        Sessao(uint32_t i, const PerfilSessao& p): id(i), cli(p) {}
+    };
+
+    class Trabalhador {
+    public:
+        static const uint32_t EV_COMANDO = 4;
+
+        Trabalhador(const sockaddr_in& d, const PerfilSessao& p, const function<void(UDPPeripheral&)>& cfg,
+                    RegistroMetricas* reg, uint32_t semente)
+            : destino(d), perfil(p), configurar(cfg), registro(reg), rng(random_device{}() ^ semente) {}
+        ~Trabalhador() {
+            if (fd >= 0) close(fd);
+            if (evfd >= 0) close(evfd);
+        }
+
+        bool abrir() {
+            fd = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+            evfd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+            if (fd < 0 || evfd < 0) return false;
+            int buf = 4 << 20; // rajadas de muitas janelas ao mesmo tempo
+            setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &buf, sizeof(buf));
+            setsockopt(fd, SOL_SOCKET, SO_SNDBUF, &buf, sizeof(buf));
+            return reator.abrir(fd) && reator.registrar(evfd, EV_COMANDO);
+        }
+
+        void iniciar() { t = thread([this] { executar(); }); }
+
+        void postar(Comando&& c) {
+            bool aceito = false;
+            {
+                lock_guard<mutex> g(m);
+                if (!fechado) {
+                    entrada.push_back(std::move(c));
+                    aceito = true;
+                }
+            }
+            if (aceito) acordar();
+            else falhar(c);
+        }
+
+        void parar() {
+            encerrar.store(true, memory_order_release);
+            acordar();
+            if (t.joinable()) t.join();
+        }
+
+        void somar(EstatisticasMotor& e) const {
+            e.sessoesAbertas += abertas.load(memory_order_relaxed);
+            e.sessoesFalhas += falhas.load(memory_order_relaxed);
+            e.sessoesEncerradas += encerradas.load(memory_order_relaxed);
+            e.reenviosConnect += reenvios.load(memory_order_relaxed);
+            e.datagramasRecebidos += recebidos.load(memory_order_relaxed);
+            e.chamadasRecepcao += chamadas.load(memory_order_relaxed);
+            e.semSessao += semSessao.load(memory_order_relaxed);
+        }
+
+    private:
+        void acordar() {
+            uint64_t um = 1;
+            if (write(evfd, &um, sizeof(um)) < 0) { /* contador já acordará o laço */ }
+        }
+
+        void executar() {
+            while (!encerrar.load(memory_order_acquire)) {
+                reator.armar(roda.proximoPrazo());
+                uint32_t ev = reator.esperar(-1);
+                if (ev & EV_COMANDO) {
+                    uint64_t v;
+                    if (read(evfd, &v, sizeof(v)) < 0) { /* já consumido */ }
+                    atenderComandos();
+                }
+                if (ev & Reator::EV_SOCKET) receber();
+                vencerPrazos();
+                fimDaVolta();
+            }
+            desligar();
+        }
+
+        void atenderComandos() {
+            {
+                lock_guard<mutex> g(m);
+                processando.swap(entrada);
+            }
+            for (Comando& c : processando) {
+                switch (c.tipo) {
+                case Comando::ABRIR: {
+                    auto s = make_unique<Sessao>(c.sessao, perfil);
+                    s->aoAbrir = std::move(c.cbSessao);
+                    s->cli.setVerboso(false);
+                    s->cli.vincular(fd, destino);
+                    if (registro) s->cli.setRegistroMetricas(*registro, to_string(c.sessao));
+                    if (configurar) configurar(s->cli);
+                    Sessao* p = s.get();
+                    sessoes[c.sessao] = std::move(s);
+                    esperandoHandshake.push_back(p->id);
+                    break;
+                }
+                case Comando::ENVIAR: {
+                    Sessao* s = buscar(c.sessao);
+                    if (!s) {
+                        if (c.cbEnvio) c.cbEnvio(0, false);
+                    } else if (s->estado != Sessao::Estado::ATIVA) {
+                        s->aguardando.emplace_back(std::move(c.msg), std::move(c.cbEnvio));
+                    } else {
+                        s->cli.submit(std::move(c.msg), std::move(c.cbEnvio));
+                        tocar(s);
+                    }
+                    break;
+                }
+                case Comando::FECHAR:
+                    if (Sessao* s = buscar(c.sessao)) {
+                        s->fecharQuandoOciosa = true;
+                        tocar(s);
+                    }
+                    break;
+                }
+            }
+            processando.clear();
+            iniciarHandshakes();
+        }
+
+        // Manda CONNECT das sessões na espera enquanto houver vaga
+        void iniciarHandshakes() {
+            while (!esperandoHandshake.empty() && porIsn.size() < MAX_HANDSHAKES) {
+                Sessao* s = buscar(esperandoHandshake.front());
+                esperandoHandshake.pop_front();
+                if (!s) continue;
+                do s->isn = (uint32_t)rng(); while (porIsn.count(s->isn)); // o SETUP volta com ack = isn
+                porIsn[s->isn] = s;
+                s->estado = Sessao::Estado::CONECTANDO;
+                s->tentativas = 1;
+                s->cli.enviarConnect(s->isn);
+                s->prazoConexao = chrono::steady_clock::now() + s->rtoConexao;
+                tocar(s);
+            }
+        }
+
+        // Esvazia o socket com recvmmsg e entrega cada datagrama pelo SID;
+        // o SETUP (SID ainda desconhecido) é achado pelo ack = isn
+        void receber() {
+            LoteRecepcao& l = *lote;
+            while (true) {
+                int n = recvmmsg(fd, l.msgs, LoteRecepcao::MAX, MSG_DONTWAIT, nullptr);
+                chamadas.fetch_add(1, memory_order_relaxed);
+                if (n <= 0) break;
+                recebidos.fetch_add(n, memory_order_relaxed);
+                for (int i = 0; i < n; i++) distribuir(l.buf[i], l.msgs[i].msg_len);
+                if (n < LoteRecepcao::MAX) break;
+            }
+        }
+
+        void distribuir(const uint8_t* buf, size_t n) {
+            if (n < (size_t)HDR_SIZE) return;
+            Header h;
+            deserialize(h, buf);
+            auto it = porSid.find(h.sid);
+            if (it != porSid.end()) {
+                it->second->cli.entregarDatagrama(buf, n);
+                tocar(it->second);
+                return;
+            }
+            auto p = porIsn.find(h.ack);
+            if (p != porIsn.end() && (h.flags() & FLAG_AR)) {
+                Sessao* s = p->second;
+                if (!s->cli.concluirConnect(h)) return;
+                porIsn.erase(p);
+                s->estado = Sessao::Estado::ATIVA;
+                s->sid = h.sid;
+                porSid[s->sid] = s;
+                abertas.fetch_add(1, memory_order_relaxed);
+                for (auto& [msg, cb] : s->aguardando) s->cli.submit(std::move(msg), std::move(cb));
+                s->aguardando.clear();
+                if (s->aoAbrir) s->aoAbrir(s->id, true);
+                tocar(s);
+                return;
+            }
+            semSessao.fetch_add(1, memory_order_relaxed);
+        }
+
+        void vencerPrazos() {
+            roda.avancar(chrono::steady_clock::now(), [&](uint32_t id, uint32_t geracao) {
+                Sessao* s = buscar(id);
+                if (!s || s->geracao != geracao) return;
+                s->temporizador = RodaTemporizadores::NIL;
+                tocar(s);
+            });
+        }
+
+        // Cada sessão tocada nesta volta (datagrama, comando ou prazo) anda
+        // uma vez, e seu prazo na roda do trabalhador é refeito
+        void fimDaVolta() {
+            auto agora = chrono::steady_clock::now();
+            for (size_t i = 0; i < tocadas.size(); i++) {
+                Sessao* s = tocadas[i];
+                s->tocada = false;
+                if (s->estado == Sessao::Estado::CONECTANDO) {
+                    if (agora >= s->prazoConexao && !reenviarConnect(s, agora)) {
+                        remover(s);
+                        continue;
+                    }
+                } else if (s->estado == Sessao::Estado::ATIVA) {
+                    s->cli.processarPendencias();
+                    if (!s->cli.isActive()) { // envio abandonado: a sessão caiu
+                        remover(s);
+                        continue;
+                    }
+                    if (s->fecharQuandoOciosa && s->cli.ocioso()) {
+                        s->cli.desconectarSemEsperar();
+                        remover(s);
+                        continue;
+                    }
+                }
+                reagendar(s);
+            }
+            tocadas.clear();
+            for (uint32_t id : removidas) sessoes.erase(id);
+            removidas.clear();
+            iniciarHandshakes(); // vagas liberadas por handshakes que falharam
+        }
+
+        bool reenviarConnect(Sessao* s, chrono::steady_clock::time_point agora) {
+            if (s->tentativas >= MAX_TENTATIVAS) return false;
+            s->tentativas++;
+            reenvios.fetch_add(1, memory_order_relaxed);
+            s->cli.enviarConnect(s->isn, true);
+            s->rtoConexao = min(s->rtoConexao * 2, EstimadorRTT::RTO_MAX);
+            s->prazoConexao = agora + s->rtoConexao;
+            return true;
+        }
+
+        void reagendar(Sessao* s) {
+            optional<chrono::steady_clock::time_point> prazo;
+            if (s->estado == Sessao::Estado::CONECTANDO) prazo = s->prazoConexao;
+            else if (s->estado == Sessao::Estado::ATIVA) prazo = s->cli.proximoPrazo();
+            roda.cancelar(s->temporizador);
+            if (prazo) s->temporizador = roda.agendar(s->id, ++s->geracao, *prazo);
+        }
+
+        // Tira a sessão das tabelas (apagada no fim da volta) e conclui com
+        // erro o que ela ainda devia
+        void remover(Sessao* s) {
+            roda.cancelar(s->temporizador);
+            if (s->estado == Sessao::Estado::CONECTANDO) porIsn.erase(s->isn);
+            if (s->estado == Sessao::Estado::ATIVA) porSid.erase(s->sid);
+            if (s->estado != Sessao::Estado::ATIVA) {
+                falhas.fetch_add(1, memory_order_relaxed);
+                if (s->aoAbrir) s->aoAbrir(s->id, false);
+            } else {
+                encerradas.fetch_add(1, memory_order_relaxed);
+            }
+            for (auto& a : s->aguardando)
+                if (a.second) a.second(0, false);
+            s->aguardando.clear();
+            s->cli.processarPendencias(); // inativa: falha o que restou na fila
+            s->estado = Sessao::Estado::REMOVIDA;
+            removidas.push_back(s->id);
+        }
+
+        // Fim do motor: DISCONNECT das ativas, erro para todo o resto
+        void desligar() {
+            atenderComandosFinal();
+            for (auto& [id, s] : sessoes) {
+                if (s->estado == Sessao::Estado::REMOVIDA) continue;
+                if (s->estado == Sessao::Estado::ATIVA) s->cli.desconectarSemEsperar();
+                remover(s.get());
+            }
+            sessoes.clear();
+            removidas.clear();
+        }
+
+        // Comandos que chegaram depois do último laço falham, e os próximos
+        // falham já em postar
+        void atenderComandosFinal() {
+            {
+                lock_guard<mutex> g(m);
+                fechado = true;
+                processando.swap(entrada);
+            }
+            for (Comando& c : processando) falhar(c);
+            processando.clear();
+        }
+
+        static void falhar(Comando& c) {
+            if (c.cbEnvio) c.cbEnvio(0, false);
+            if (c.cbSessao) c.cbSessao(c.sessao, false);
+        }
+
+        Sessao* buscar(uint32_t id) {
+            auto it = sessoes.find(id);
+            if (it == sessoes.end() || it->second->estado == Sessao::Estado::REMOVIDA) return nullptr;
+            return it->second.get();
+        }
+
+        void tocar(Sessao* s) {
+            if (s->tocada) return;
+            s->tocada = true;
+            tocadas.push_back(s);
+        }
+
+        sockaddr_in destino;
+        PerfilSessao perfil;
+        function<void(UDPPeripheral&)> configurar;
+        RegistroMetricas* registro;
+        mt19937 rng;
+        int fd = -1;
+        int evfd = -1;
+        Reator reator;
+        thread t;
+        atomic<bool> encerrar{false};
+
+        mutex m;
+        vector<Comando> entrada, processando;
+        bool fechado = false;                      // trabalhador parou (protegido por m)
+
+        unordered_map<uint32_t, unique_ptr<Sessao>> sessoes;
+        unordered_map<SID, Sessao*, SIDHash> porSid;
+        unordered_map<uint32_t, Sessao*> porIsn;   // handshakes em andamento
+        deque<uint32_t> esperandoHandshake;
+        RodaTemporizadores roda;
+        vector<Sessao*> tocadas;
+        vector<uint32_t> removidas;
+        unique_ptr<LoteRecepcao> lote = make_unique<LoteRecepcao>();
+
+        atomic<uint64_t> abertas{0}, falhas{0}, encerradas{0}, reenvios{0};
+        atomic<uint64_t> recebidos{0}, chamadas{0}, semSessao{0};
+    };
+
+    Trabalhador& trabalhadorDe(uint32_t sessao) { return *trabalhadores[sessao % nTrabalhadores]; }
+
+    size_t nTrabalhadores;
+    PerfilSessao perfil;
+    function<void(UDPPeripheral&)> configurar;
+    RegistroMetricas* registro = nullptr;
+    vector<unique_ptr<Trabalhador>> trabalhadores;
+    atomic<uint32_t> proximoId{1};
+    atomic<bool> parado{false};
+};
+
+#endif // SLOW_MOTOR_H
@@ -0,0 +1,2225 @@
+/*
+ * slow_peripheral.h
+ * Autores: 
+ *  Enzo Tonon Morente - 14568476 
+ *  João Pedro Alves Notari Godoy - 14582076
+ *  Letícia Barbosa Neves - 14582076
+ * Descrição: Cliente do protocolo SLOW (UDPPeripheral) e suas estruturas de
+ *            apoio: fila de retransmissão, temporizadores, RTO e reator
+ *            (a remontagem do que a central envia fica em slow_recepcao.h e
+ *            o transporte em memória com relógio virtual, em slow_transporte.h)
+ */
+
+#ifndef SLOW_PERIPHERAL_H
+#define SLOW_PERIPHERAL_H
+
+#include <iostream>
+#include <iomanip>
+#include <cstring>
+#include <cstdlib>
+#include <string>
+#include <cerrno>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#include <arpa/inet.h>
+#include <netdb.h>
+#include <cstdint>
+#include <vector> 
+#include <algorithm>   // std::min, std::max
+#include <optional>    // std::optional, std::nullopt
+#include <chrono>      // std::chrono para controle de tempo
+#include <functional>  // std::function
+#include <future>      // std::future/std::promise do submit()
+#include <memory>
+#include <cmath>       // pow/cbrt do CUBIC
+#include <string_view> // payload sem cópia (submitView/sendData)
+#include <sys/uio.h>   // iovec
+#include <netinet/udp.h> // UDP_SEGMENT (GSO)
+
+#include "slow_protocol.h"
+#include "slow_trace.h"
+#include "slow_recepcao.h"
+#include "slow_agrupamento.h"
+#include "slow_sessao.h"
+#include "slow_submissao.h"
+#include "slow_metricas.h"
+#include "slow_transporte.h"
+  
+using namespace std;
+
+// Constantes de retransmissão: o RTO é adaptativo (EstimadorRTT) e dobra a
+// cada timeout; depois de MAX_TENTATIVAS envios o pacote é abandonado
+static const uint32_t MAX_TENTATIVAS = 6;
+static const int TIMEOUT_ESPERA_MS = 5000; // espera máxima por ACK sem nada em trânsito
+
+//pacote que já foi enviado mas ainda não recebeu confirmação (ACK).
+//Só o cabeçalho é copiado; os dados continuam na memória da mensagem
+//(do chamador ou com contagem de referência), de onde também são reenviados.
+struct PacoteEmTransmissao {
+    uint8_t  cabecalho[HDR_SIZE];         /// cabeçalho serializado
+    const uint8_t* dados = nullptr;       /// payload na memória da mensagem
+    size_t   length = 0;                  /// tamanho do pacote
+    uint32_t seq = 0;                     /// número da squencia do pacote
+    size_t   dataSize = 0;                /// tamanho dos dados, mas sem o cabeçalho
+    std::chrono::steady_clock::time_point tempoEnvio; /// timestamp do envio
+    uint32_t tentativas = 0;              /// número de tentativas
+    bool ocupado = false;                 /// slot da fila circular em uso
+
+    // Ocupa o slot com um pacote recém-enviado
+    void preencher(const uint8_t* hdr, const uint8_t* payload, uint32_t sequence, size_t dSize,
+                   std::chrono::steady_clock::time_point agora) {
+        memcpy(cabecalho, hdr, HDR_SIZE);
+        dados = payload;
+        length = HDR_SIZE + dSize;
+        seq = sequence;
+        dataSize = dSize;
+        tempoEnvio = agora;
+        tentativas = 1;
+        ocupado = true;
+    }
+    
+    // Atualiza timestamp para nova tentativa
+    void atualizarTempo(std::chrono::steady_clock::time_point agora) {
+        tempoEnvio = agora;
+        tentativas++;
+    }
+};
+
+// Fila circular de retransmissão indexada pelo número de sequência.
+// O slot de um pacote é seq & mascara, então a busca por seq é O(1) e o ACK
+// cumulativo só avança "base"; nenhum buffer é deslocado. A capacidade
+// (potência de 2) acompanha a janela negociada.
+class FilaRetransmissao {
+    vector<PacoteEmTransmissao> slots;
+    uint32_t mascara = 0;
+    uint32_t base = 0;     // seq mais antigo ainda não confirmado
+    uint32_t proximo = 0;  // seq seguinte ao último inserido
+
+public:
+    // Número de slots para uma janela em bytes: pacotes cheios cabem duas vezes,
+    // o que deixa folga para fragmentos menores que DATA_MAX
+    static uint32_t capacidadePara(uint32_t janela) {
+        uint32_t n = max<uint32_t>(16, 2 * ((janela + DATA_MAX - 1) / DATA_MAX));
+        uint32_t c = 1;
+        while (c < n) c <<= 1;
+        return c;
+    }
+
+    bool vazia() const { return base == proximo; }
+    uint32_t tamanho() const { return proximo - base; }
+    uint32_t capacidade() const { return (uint32_t)slots.size(); }
+    bool cheia() const { return tamanho() >= capacidade(); }
+    uint32_t primeiroSeq() const { return base; }
+
+    // Pacote mais antigo ainda não confirmado (pula seqs que não foram usados)
+    PacoteEmTransmissao* primeiro() {
+        for (uint32_t s = base; s != proximo; ++s)
+            if (slots[s & mascara].ocupado) return &slots[s & mascara];
+        return nullptr;
+    }
+
+    // Cresce (nunca encolhe) mantendo os pacotes em trânsito nos novos slots
+    void garantirCapacidade(uint32_t cap) {
+        if (cap <= capacidade()) return;
+        vector<PacoteEmTransmissao> novos(cap);
+        for (uint32_t s = base; s != proximo; ++s) {
+            const PacoteEmTransmissao& p = slots[s & mascara];
+            if (p.ocupado) novos[s & (cap - 1)] = p;
+        }
+        slots.swap(novos);
+        mascara = cap - 1;
+    }
+
+    // Pacote com esse seq, se ainda estiver em trânsito
+    PacoteEmTransmissao* buscar(uint32_t seq) {
+        if (vazia() || seqMenor(seq, base) || !seqMenor(seq, proximo)) return nullptr;
+        PacoteEmTransmissao& p = slots[seq & mascara];
+        return (p.ocupado && p.seq == seq) ? &p : nullptr;
+    }
+
+    // Insere no fim; seqs pulados viram slots vazios. Exige !cheia().
+    PacoteEmTransmissao& inserir(const uint8_t* hdr, const uint8_t* dados, uint32_t seq, size_t dataSize,
+                                 chrono::steady_clock::time_point agora) {
+        if (vazia()) base = proximo = seq;
+        while (proximo != seq) slots[proximo++ & mascara].ocupado = false;
+        PacoteEmTransmissao& p = slots[seq & mascara];
+        p.preencher(hdr, dados, seq, dataSize, agora);
+        proximo = seq + 1;
+        return p;
+    }
+
+    // ACK cumulativo: libera todos os seq <= ack e devolve os bytes liberados.
+    // aoLiberar(p) é chamado para cada pacote antes de liberar seu slot.
+    template <typename F>
+    uint32_t confirmarAte(uint32_t ack, F aoLiberar) {
+        uint32_t liberados = 0;
+        while (!vazia() && seqMenorIgual(base, ack)) {
+            PacoteEmTransmissao& p = slots[base & mascara];
+            if (p.ocupado) {
+                aoLiberar(p);
+                liberados += p.dataSize;
+                p.ocupado = false;
+            }
+            ++base;
+        }
+        return liberados;
+    }
+    uint32_t confirmarAte(uint32_t ack) {
+        return confirmarAte(ack, [](PacoteEmTransmissao&) {});
+    }
+
+    // Remove um único pacote (ex.: descartado); devolve seu tamanho
+    uint32_t remover(uint32_t seq) {
+        PacoteEmTransmissao* p = buscar(seq);
+        if (!p) return 0;
+        p->ocupado = false;
+        while (!vazia() && !slots[base & mascara].ocupado) ++base; // pula buracos do início
+        return p->dataSize;
+    }
+
+    // Percorre os pacotes em trânsito, do mais antigo ao mais novo
+    template <typename F>
+    void paraCada(F f) {
+        for (uint32_t s = base; s != proximo; ++s) {
+            PacoteEmTransmissao& p = slots[s & mascara];
+            if (p.ocupado) f(p);
+        }
+    }
+};
+
+// Roda hierárquica de temporizadores de retransmissão (dois níveis).
+// Nível 0: N0 slots de GRANULARIDADE cada; nível 1: N1 slots de uma volta
+// inteira do nível 0. Um prazo cai direto no slot do seu tick e só é movido
+// (uma vez) do nível 1 para o 0 quando sua volta começa, então avançar o
+// relógio custa proporcional às expirações, não aos prazos pendentes.
+// As entradas são nós de um pool com lista livre, duplamente encadeados por
+// índice em cada slot. agendar devolve o índice do nó para o dono cancelar
+// o prazo quando ele é rearmado (a sessão tem um prazo de retransmissão; o
+// motor, um por sessão), e com o pool reservado agendar e disparar não
+// alocam. Quem dispara ainda confere a geração do prazo.
+class RodaTemporizadores {
+public:
+    using Relogio = chrono::steady_clock;
+    static constexpr auto GRANULARIDADE = chrono::milliseconds(5);
+    static constexpr uint32_t NIL = UINT32_MAX;
+
+    explicit RodaTemporizadores(Relogio::time_point inicio = Relogio::now())
+        : origem(inicio) {
+        fill(begin(listas), end(listas), Lista{});
+    }
+
+    // Reserva nós para "n" prazos pendentes (evita crescer no caminho de dados)
+    void reservar(size_t n) {
+        while (nos.size() < n) liberarNo(novoNo());
+    }
+
+    bool vazia() const { return pendentes == 0; }
+
+    // Instante do próximo tick com prazo (para armar o timerfd). Se o nível 0
+    // não tem nada nesta volta, acorda no início da volta que tem entradas no
+    // nível 1 (onde elas descem para o nível 0).
+    optional<Relogio::time_point> proximoPrazo() const {
+        if (pendentes == 0) return nullopt;
+        uint64_t fimVolta = (tickAtual / N0 + 1) * N0;
+        for (uint64_t t = tickAtual + 1; t < fimVolta; t++)
+            if (!listas[slot0(t)].vazia()) return instanteDe(t);
+        for (uint64_t v = fimVolta; v < fimVolta + N0 * N1; v += N0)
+            if (!listas[slot1(v)].vazia()) return instanteDe(v);
+        return instanteDe(fimVolta);
+    }
+
+    // Agenda (seq, geração) para disparar em "prazo" (nunca antes dele).
+    // Devolve o identificador do prazo, para cancelar.
+    uint32_t agendar(uint32_t seq, uint32_t geracao, Relogio::time_point prazo) {
+        uint32_t i = livre != NIL ? livre : novoNo();
+        livre = nos[i].prox;
+        nos[i].seq = seq;
+        nos[i].geracao = geracao;
+        nos[i].tick = tickDe(prazo, true);
+        inserir(i);
+        pendentes++;
+        return i;
+    }
+
+    // Cancela um prazo ainda pendente e zera o identificador
+    void cancelar(uint32_t& id) {
+        if (id != NIL && id < nos.size() && nos[id].lista != NIL) {
+            remover(id);
+            liberarNo(id);
+            pendentes--;
+        }
+        id = NIL;
+    }
+
+    // Avança até "agora" (lido uma vez pelo chamador) e chama
+    // disparar(seq, geracao) para cada prazo vencido
+    template <typename F>
+    void avancar(Relogio::time_point agora, F disparar) {
+        uint64_t alvo = tickDe(agora, false);
+        if (pendentes == 0) { // nada agendado: só acompanha o relógio
+            if (alvo > tickAtual) tickAtual = alvo;
+            return;
+        }
+        while (tickAtual < alvo) {
+            ++tickAtual;
+            // início de uma volta do nível 0: traz os prazos dela do nível 1
+            if ((tickAtual & (N0 - 1)) == 0) {
+                Lista& l1 = listas[slot1(tickAtual)];
+                while (!l1.vazia()) {
+                    uint32_t i = l1.inicio;
+                    remover(i);
+                    inserir(i);
+                }
+            }
+            // um nó por vez: disparar pode cancelar outros prazos deste slot,
+            // e reagendar sempre cai num tick futuro
+            Lista& l0 = listas[slot0(tickAtual)];
+            while (!l0.vazia()) {
+                uint32_t i = l0.inicio;
+                No n = nos[i];
+                remover(i);
+                liberarNo(i);
+                pendentes--;
+                disparar(n.seq, n.geracao);
+            }
+        }
+    }
+
+private:
+    static constexpr uint64_t N0 = 256;  // 256 × 5 ms = 1,28 s
+    static constexpr uint64_t N1 = 64;   // 64 × 1,28 s ≈ 82 s de horizonte
+
+    struct No {
+        uint32_t seq;
+        uint32_t geracao;
+        uint64_t tick;
+        uint32_t prox, ant;  // vizinhos no slot (prox também na lista livre)
+        uint32_t lista;      // slot onde está, NIL se livre
+    };
+    // Lista de um slot, em ordem de agendamento (dispara na mesma ordem)
+    struct Lista {
+        uint32_t inicio = NIL, fim = NIL;
+        bool vazia() const { return inicio == NIL; }
+    };
+
+    Relogio::time_point origem;
+    uint64_t tickAtual = 0;
+    size_t pendentes = 0;
+    Lista listas[N0 + N1]; // nível 0 seguido do nível 1
+    vector<No> nos;        // pool; só cresce quando a lista livre acaba
+    uint32_t livre = NIL;
+
+    static uint32_t slot0(uint64_t tick) { return (uint32_t)(tick & (N0 - 1)); }
+    static uint32_t slot1(uint64_t tick) { return (uint32_t)(N0 + ((tick / N0) & (N1 - 1))); }
+
+    uint32_t novoNo() {
+        nos.push_back(No{0, 0, 0, NIL, NIL, NIL});
+        return (uint32_t)nos.size() - 1;
+    }
+    void liberarNo(uint32_t i) {
+        nos[i].lista = NIL;
+        nos[i].prox = livre;
+        livre = i;
+    }
+
+    Relogio::time_point instanteDe(uint64_t tick) const {
+        return origem + chrono::duration_cast<Relogio::duration>(GRANULARIDADE) * tick;
+    }
+
+    // Converte instante em tick (arredonda para cima os prazos)
+    uint64_t tickDe(Relogio::time_point t, bool arredondarParaCima) const {
+        if (t <= origem) return 0;
+        uint64_t g = (uint64_t)chrono::duration_cast<Relogio::duration>(GRANULARIDADE).count();
+        uint64_t n = (uint64_t)(t - origem).count();
+        return arredondarParaCima ? (n + g - 1) / g : n / g;
+    }
+
+    // Põe o nó no fim do slot do seu tick
+    void inserir(uint32_t i) {
+        No& e = nos[i];
+        if (e.tick <= tickAtual) e.tick = tickAtual + 1;
+        uint64_t delta = e.tick - tickAtual;
+        if (delta >= N0 * N1) e.tick = tickAtual + N0 * N1 - 1; // limita ao horizonte
+        e.lista = e.tick / N0 == tickAtual / N0 ? slot0(e.tick) : slot1(e.tick);
+        Lista& l = listas[e.lista];
+        e.prox = NIL;
+        e.ant = l.fim;
+        if (l.vazia()) l.inicio = i;
+        else           nos[l.fim].prox = i;
+        l.fim = i;
+    }
+
+    // Tira o nó do seu slot
+    void remover(uint32_t i) {
+        No& e = nos[i];
+        Lista& l = listas[e.lista];
+        if (e.ant != NIL) nos[e.ant].prox = e.prox; else l.inicio = e.prox;
+        if (e.prox != NIL) nos[e.prox].ant = e.ant; else l.fim = e.ant;
+        e.lista = NIL;
+    }
+};
+
+// Estimador de RTT e RTO por sessão (RFC 6298). Só recebe amostras de
+// pacotes que não foram retransmitidos (regra de Karn); cada timeout dobra
+// o RTO até RTO_MAX, e uma amostra nova desfaz o backoff.
+class EstimadorRTT {
+public:
+    using us = chrono::microseconds;
+    static constexpr us RTO_INICIAL = chrono::seconds(1);
+    static constexpr us RTO_MIN     = chrono::milliseconds(200);
+    static constexpr us RTO_MAX     = chrono::seconds(60);
+
+    void amostra(us r) {
+        if (r.count() <= 0) r = us(1);
+        if (!temAmostra) {
+            srtt = r;
+            rttvar = r / 2;
+            temAmostra = true;
+        } else {
+            us erro = srtt > r ? srtt - r : r - srtt;
+            rttvar = (3 * rttvar + erro) / 4;   // beta = 1/4
+            srtt   = (7 * srtt + r) / 8;        // alpha = 1/8
+        }
+        // G (granularidade) = tick da roda de temporizadores
+        us variacao = max<us>(chrono::duration_cast<us>(RodaTemporizadores::GRANULARIDADE), 4 * rttvar);
+        rtoBase = min(RTO_MAX, max(RTO_MIN, srtt + variacao));
+        backoff = 0;
+    }
+
+    // Timeout de retransmissão: dobra o RTO (limitado a RTO_MAX)
+    void aplicarBackoff() {
+        if (rto() < RTO_MAX) backoff++;
+    }
+
+    us rto() const {
+        us r = rtoBase;
+        for (int i = 0; i < backoff && r < RTO_MAX; i++) r *= 2;
+        return min(r, RTO_MAX);
+    }
+    us srttAtual() const { return srtt; }
+    us rttvarAtual() const { return rttvar; }
+    bool possuiAmostra() const { return temAmostra; }
+
+private:
+    us srtt{0}, rttvar{0};
+    us rtoBase = RTO_INICIAL;
+    int backoff = 0;
+    bool temAmostra = false;
+};
+
+// Controle de congestionamento da sessão. A janela de congestionamento
+// (cwnd) limita os bytes em trânsito junto com a janela anunciada pela
+// central: o cliente usa min(cwnd, wnd). As implementações só reagem aos
+// eventos abaixo, então podem ser trocadas por sessão.
+class ControleCongestionamento {
+public:
+    using Relogio = chrono::steady_clock;
+    static const uint32_t MSS = DATA_MAX;
+    static const uint32_t JANELA_INICIAL = 10 * MSS; // RFC 6928
+
+    virtual ~ControleCongestionamento() = default;
+    virtual const char* nome() const = 0;
+    // ACK novo confirmou "bytes"; "limite" é a janela anunciada, acima da
+    // qual a cwnd não cresce (não adianta, e perderia o sentido de medida)
+    virtual void aoConfirmar(uint32_t bytes, uint32_t limite, Relogio::time_point agora,
+                             chrono::microseconds srtt) = 0;
+    // perda detectada sem timeout (ACKs duplicados); emTransito = bytes sem ACK
+    virtual void aoPerda(uint32_t emTransito, Relogio::time_point agora) = 0;
+    // timeout de retransmissão: volta ao slow start
+    virtual void aoTimeout(uint32_t emTransito, Relogio::time_point agora) = 0;
+
+    uint32_t janela() const { return cwnd; }
+    uint32_t limiar() const { return ssthresh; }
+    bool emSlowStart() const { return cwnd < ssthresh; }
+
+protected:
+    uint32_t cwnd = JANELA_INICIAL;
+    uint32_t ssthresh = UINT32_MAX;
+
+    // slow start: cresce o que foi confirmado (até ssthresh); retorna o que sobrou
+    uint32_t slowStart(uint32_t bytes) {
+        uint32_t cresce = min(bytes, ssthresh - cwnd);
+        cwnd += cresce;
+        return bytes - cresce;
+    }
+    void limitar(uint32_t limite) {
+        cwnd = min(cwnd, max(limite, 2 * MSS));
+    }
+};
+
+// Sem controle: só a janela anunciada vale (comportamento anterior)
+class SemControle : public ControleCongestionamento {
+public:
+    SemControle() { cwnd = UINT32_MAX; }
+    const char* nome() const override { return "nenhum"; }
+    void aoConfirmar(uint32_t, uint32_t, Relogio::time_point, chrono::microseconds) override {}
+    void aoPerda(uint32_t, Relogio::time_point) override {}
+    void aoTimeout(uint32_t, Relogio::time_point) override {}
+};
+
+// AIMD no estilo NewReno (RFC 5681): slow start até ssthresh, depois +1 MSS
+// por janela confirmada; perda corta a janela pela metade
+class ControleNewReno : public ControleCongestionamento {
+public:
+    const char* nome() const override { return "newreno"; }
+
+    void aoConfirmar(uint32_t bytes, uint32_t limite, Relogio::time_point,
+                     chrono::microseconds) override {
+        if (emSlowStart()) bytes = slowStart(bytes);
+        if (bytes > 0) {
+            acumulado += bytes;
+            if (acumulado >= cwnd) { // uma janela inteira confirmada
+                acumulado -= cwnd;
+                cwnd += MSS;
+            }
+        }
+        limitar(limite);
+    }
+    void aoPerda(uint32_t emTransito, Relogio::time_point) override {
+        ssthresh = max(emTransito / 2, 2 * MSS);
+        cwnd = ssthresh;
+        acumulado = 0;
+    }
+    void aoTimeout(uint32_t emTransito, Relogio::time_point) override {
+        ssthresh = max(emTransito / 2, 2 * MSS);
+        cwnd = MSS;
+        acumulado = 0;
+    }
+
+private:
+    uint32_t acumulado = 0; // bytes confirmados desde o último +1 MSS
+};
+
+// Variante no estilo CUBIC (RFC 9438): depois de uma perda a janela segue
+// W(t) = C(t - K)^3 + Wmax, com redução multiplicativa de 0,7 e piso na
+// estimativa AIMD equivalente (região amigável ao Reno)
+class ControleCubic : public ControleCongestionamento {
+public:
+    const char* nome() const override { return "cubic"; }
+
+    void aoConfirmar(uint32_t bytes, uint32_t limite, Relogio::time_point agora,
+                     chrono::microseconds srtt) override {
+        if (emSlowStart()) bytes = slowStart(bytes);
+        if (bytes > 0) {
+            if (!emEpoca) {
+                emEpoca = true;
+                inicioEpoca = agora;
+                double w0 = cwnd / (double)MSS;
+                if (w0 < wMax) k = cbrt((wMax - w0) / C);
+                else { k = 0; wMax = w0; }
+                wEst = w0;
+            }
+            double t = chrono::duration<double>(agora - inicioEpoca).count();
+            double rtt = max(srtt.count() / 1e6, 1e-3);
+            double w = cwnd / (double)MSS;
+            double alvo = C * pow(t + rtt - k, 3) + wMax;   // janela daqui a um RTT
+            double maxAlvo = 1.5 * w;                        // limita o salto por RTT
+            alvo = min(max(alvo, w), maxAlvo);
+            double confirmados = bytes / (double)MSS;
+            wEst += ALFA_RENO * confirmados / w;             // Reno equivalente
+            double novo = w + (alvo - w) * confirmados / w;
+            novo = max(novo, wEst);
+            cwnd = (uint32_t)min(novo * MSS, (double)UINT32_MAX / 2);
+        }
+        limitar(limite);
+    }
+    void aoPerda(uint32_t, Relogio::time_point) override { reduzir(); cwnd = ssthresh; }
+    void aoTimeout(uint32_t, Relogio::time_point) override { reduzir(); cwnd = MSS; }
+
+private:
+    static constexpr double C = 0.4;
+    static constexpr double BETA = 0.7;
+    static constexpr double ALFA_RENO = 3 * (1 - BETA) / (1 + BETA);
+
+    void reduzir() {
+        double w = cwnd / (double)MSS;
+        // convergência rápida: cede espaço se a janela já caiu antes de Wmax
+        wMax = w < wMax ? w * (1 + BETA) / 2 : w;
+        ssthresh = max((uint32_t)(cwnd * BETA), 2 * MSS);
+        emEpoca = false;
+    }
+
+    double wMax = 0, k = 0, wEst = 0;
+    bool emEpoca = false;
+    Relogio::time_point inicioEpoca;
+};
+
+enum class AlgoritmoCongestionamento { NENHUM, NEWRENO, CUBIC };
+
+inline unique_ptr<ControleCongestionamento> criarControle(AlgoritmoCongestionamento a) {
+    switch (a) {
+    case AlgoritmoCongestionamento::NENHUM: return make_unique<SemControle>();
+    case AlgoritmoCongestionamento::CUBIC:  return make_unique<ControleCubic>();
+    default:                                return make_unique<ControleNewReno>();
+    }
+}
+
+// Cadência de envio (desligada por padrão). Em vez de soltar de uma vez
+// tudo o que um ACK reabriu na janela, os fragmentos novos saem a
+// ganho × janela / SRTT bytes/s; o ganho maior no slow start acompanha a
+// janela dobrando a cada RTT. "rajada" é o crédito máximo do balde (o que
+// pode sair junto depois de uma pausa); "taxaMaxima" (bytes/s, 0 = sem)
+// limita a taxa, e sozinha vale até a primeira amostra de RTT.
+struct ConfigCadencia {
+    bool ligada = false;
+    double ganhoSlowStart = 2.0;
+    double ganho = 1.25;
+    uint32_t rajada = 2 * DATA_MAX;
+    uint64_t taxaMaxima = 0;
+};
+
+// Balde de fichas da cadência: o crédito (em bytes) recarrega à taxa atual
+// até "rajada"; um fragmento sai com crédito positivo e o deixa negativo
+// pelo seu tamanho, então a média é a taxa sem arredondar o fragmento.
+class Cadenciador {
+public:
+    using Relogio = chrono::steady_clock;
+
+    void configurar(const ConfigCadencia& c) {
+        cfg = c;
+        credito = cfg.rajada;
+        taxa = 0;
+    }
+    const ConfigCadencia& config() const { return cfg; }
+    bool ligado() const { return cfg.ligada; }
+    double taxaAtual() const { return taxa; } // bytes/s (0 = sem limite)
+
+    // Taxa para a janela e o SRTT atuais
+    void ajustar(uint32_t janela, chrono::microseconds srtt, bool slowStart) {
+        taxa = 0;
+        if (srtt.count() > 0)
+            taxa = (slowStart ? cfg.ganhoSlowStart : cfg.ganho) * janela * 1e6 / srtt.count();
+        if (cfg.taxaMaxima > 0 && (taxa == 0 || taxa > cfg.taxaMaxima)) taxa = (double)cfg.taxaMaxima;
+    }
+
+    // Um fragmento pode sair agora?
+    bool liberado(Relogio::time_point agora) {
+        if (taxa > 0 && agora > ultima)
+            credito = min<double>(cfg.rajada, credito + taxa * chrono::duration<double>(agora - ultima).count());
+        ultima = agora;
+        return taxa == 0 || credito > 0;
+    }
+    void consumir(size_t bytes) {
+        if (taxa > 0) credito -= (double)bytes;
+    }
+    // Quando o crédito volta a ser positivo
+    Relogio::time_point proximaLiberacao() const {
+        if (taxa == 0 || credito > 0) return ultima;
+        return ultima + chrono::duration_cast<Relogio::duration>(
+                            chrono::duration<double>((1 - credito) / taxa));
+    }
+
+private:
+    ConfigCadencia cfg;
+    double taxa = 0;
+    double credito = 0;
+    Relogio::time_point ultima;
+};
+
+// Pacote abandonado depois de MAX_TENTATIVAS (relatado ao chamador)
+struct FalhaEntrega {
+    bool ocorreu = false;
+    uint32_t seq = 0;        // primeiro pacote abandonado
+    uint32_t tentativas = 0;
+};
+
+// Laço de eventos do periférico: epoll sobre o socket UDP (não bloqueante) e
+// um timerfd armado no próximo prazo de retransmissão. Substitui o antigo
+// recvfrom com SO_RCVTIMEO de 100 ms reconfigurado a cada volta.
+class Reator {
+public:
+    using Relogio = chrono::steady_clock;
+    static const uint32_t EV_SOCKET = Transporte::PRONTO_DATAGRAMA; // socket tem datagramas
+    static const uint32_t EV_TIMER  = Transporte::PRONTO_PRAZO;     // prazo de retransmissão venceu
+    static const uint32_t EV_FILA   = 4;  // fila de submissão recebeu mensagens
+
+    Reator() = default;
+    Reator(const Reator&) = delete;
+    Reator& operator=(const Reator&) = delete;
+    ~Reator() {
+        if (tfd >= 0) close(tfd);
+        if (ep >= 0) close(ep);
+    }
+
+    bool abrir(int sockFd) {
+        ep = epoll_create1(EPOLL_CLOEXEC);
+        tfd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+        if (ep < 0 || tfd < 0) return false;
+        return registrar(sockFd, EV_SOCKET) && registrar(tfd, EV_TIMER);
+    }
+
+    // O próprio epoll, para ser esperado dentro de outro epoll
+    int descritor() const { return ep; }
+
+    // Registra outro descritor legível; "tag" volta no resultado de esperar()
+    bool registrar(int outroFd, uint32_t tag) {
+        epoll_event ev{};
+        ev.events = EPOLLIN;
+        ev.data.u32 = tag;
+        return epoll_ctl(ep, EPOLL_CTL_ADD, outroFd, &ev) == 0;
+    }
+
+    // Arma o timerfd para um instante absoluto (steady_clock = CLOCK_MONOTONIC);
+    // só faz a syscall se o prazo mudou
+    void armar(optional<Relogio::time_point> prazo) {
+        if (prazo == armado) return;
+        itimerspec its{};
+        if (prazo) {
+            auto ns = chrono::duration_cast<chrono::nanoseconds>(prazo->time_since_epoch()).count();
+            if (ns <= 0) ns = 1;
+            its.it_value.tv_sec  = ns / 1000000000;
+            its.it_value.tv_nsec = ns % 1000000000;
+        }
+        timerfd_settime(tfd, TFD_TIMER_ABSTIME, &its, nullptr);
+        armado = prazo;
+    }
+
+    // Espera até timeoutMs (-1 = sem limite) e devolve EV_SOCKET | EV_TIMER
+    uint32_t esperar(int timeoutMs) {
+        epoll_event evs[4];
+        int n = epoll_wait(ep, evs, 4, timeoutMs);
+        uint32_t prontos = 0;
+        for (int i = 0; i < n; i++) prontos |= evs[i].data.u32;
+        if (prontos & EV_TIMER) {
+            uint64_t expiracoes;
+            if (read(tfd, &expiracoes, sizeof(expiracoes)) < 0) { /* já consumido */ }
+            armado.reset();
+        }
+        return prontos;
+    }
+
+private:
+    int ep = -1;
+    int tfd = -1;
+    optional<Relogio::time_point> armado;
+};
+
+// Lote de datagramas enviados com um único sendmmsg. Cada datagrama são dois
+// iovecs: o cabeçalho no slot da fila de retransmissão (que não se move até o
+// lote ser despachado, antes de qualquer ACK ser lido) e o payload na memória
+// da mensagem.
+//
+// Com GSO (UDP_SEGMENT), datagramas consecutivos de tamanho cheio viram uma
+// única mensagem: os iovecs hdr0|dados0|hdr1|dados1|... formam um buffer
+// lógico que o kernel corta a cada HDR_SIZE + DATA_MAX bytes, de modo que
+// cada segmento é um pacote SLOW completo com o próprio cabeçalho. Só o
+// último do grupo pode ser menor.
+class LoteEnvio {
+public:
+    static const int MAX = 64;
+    static const size_t SEGMENTO = HDR_SIZE + DATA_MAX;
+    // limites do kernel: 64 segmentos e 65507 bytes de payload UDP (IPv4)
+    static const int MAX_SEGMENTOS = min<int>(64, 65507 / SEGMENTO);
+
+    bool vazio() const { return n == 0; }
+    bool cheio() const { return n == MAX; }
+    int tamanho() const { return n; }
+    void descartar() { n = 0; }
+    void setGSO(bool v) { gso = v; }
+    bool usandoGSO() const { return gso; }
+    // mensagens GSO (com mais de um segmento) enviadas no último despachar()
+    int mensagensGSO() const { return ultimasGSO; }
+
+    void adicionar(const uint8_t* hdr, const uint8_t* dados, size_t dataSize) {
+        iov[n][0].iov_base = const_cast<uint8_t*>(hdr);
+        iov[n][0].iov_len = HDR_SIZE;
+        iov[n][1].iov_base = const_cast<uint8_t*>(dados);
+        iov[n][1].iov_len = dataSize;
+        n++;
+    }
+
+    // Envia o lote; retorna o número de chamadas sendmmsg feitas. O que não
+    // sair (EAGAIN) já está na fila e será reenviado pelo temporizador. Se o
+    // kernel recusar UDP_SEGMENT, o GSO é desligado e o lote sai por pacote.
+    int despachar(int fd, const sockaddr_in& dst) {
+        int chamadas = 0, feitos = 0;
+        int m = montar(dst);
+        while (feitos < m) {
+            int r = sendmmsg(fd, msgs + feitos, m - feitos, 0);
+            chamadas++;
+            if (r <= 0) {
+                if (gso && feitos == 0 && errnoSemGSO(errno)) {
+                    gso = false;
+                    m = montar(dst);
+                    continue;
+                }
+                break;
+            }
+            feitos += r;
+        }
+        n = 0;
+        return chamadas;
+    }
+
+private:
+    static bool errnoSemGSO(int e) { return e == EIO || e == EINVAL || e == ENOPROTOOPT; }
+
+    // Preenche msgs[] a partir dos datagramas do lote; retorna quantas
+    // mensagens foram montadas
+    int montar(const sockaddr_in& dst) {
+        int m = 0;
+        ultimasGSO = 0;
+        for (int i = 0; i < n; ) {
+            int j = i + 1; // grupo [i, j)
+            if (gso)
+                while (j < n && j - i < MAX_SEGMENTOS && tamanhoDe(j - 1) == SEGMENTO) j++;
+
+            msghdr& mh = msgs[m].msg_hdr;
+            memset(&mh, 0, sizeof(mh));
+            mh.msg_name = const_cast<sockaddr_in*>(&dst);
+            mh.msg_namelen = sizeof(dst);
+            mh.msg_iov = iov[i];
+            mh.msg_iovlen = 2 * (j - i);
+            if (j - i > 1) {
+                mh.msg_control = controle[m];
+                mh.msg_controllen = sizeof(controle[m]);
+                cmsghdr* c = CMSG_FIRSTHDR(&mh);
+                c->cmsg_level = SOL_UDP;
+                c->cmsg_type = UDP_SEGMENT;
+                c->cmsg_len = CMSG_LEN(sizeof(uint16_t));
+                uint16_t seg = SEGMENTO;
+                memcpy(CMSG_DATA(c), &seg, sizeof(seg));
+                ultimasGSO++;
+            }
+            m++;
+            i = j;
+        }
+        return m;
+    }
+
+    size_t tamanhoDe(int i) const { return iov[i][0].iov_len + iov[i][1].iov_len; }
+
+    mmsghdr msgs[MAX];
+    iovec iov[MAX][2];
+    alignas(cmsghdr) char controle[MAX][CMSG_SPACE(sizeof(uint16_t))];
+    int n = 0;
+    bool gso = false;
+    int ultimasGSO = 0;
+};
+
+// Buffers para esvaziar o socket com recvmmsg
+struct LoteRecepcao {
+    static const int MAX = 32;
+    uint8_t buf[MAX][HDR_SIZE + DATA_MAX];
+    mmsghdr msgs[MAX];
+    iovec iov[MAX];
+
+    LoteRecepcao() {
+        memset(msgs, 0, sizeof(msgs));
+        for (int i = 0; i < MAX; i++) {
+            iov[i].iov_base = buf[i];
+            iov[i].iov_len = sizeof(buf[i]);
+            msgs[i].msg_hdr.msg_iov = &iov[i];
+            msgs[i].msg_hdr.msg_iovlen = 1;
+        }
+    }
+};
+
+// Contadores de chamadas de sistema do caminho de dados
+struct EstatisticasIO {
+    uint64_t datagramasEnviados = 0;
+    uint64_t chamadasEnvio = 0;
+    uint64_t datagramasRecebidos = 0;
+    uint64_t chamadasRecepcao = 0;
+    uint64_t mensagensGSO = 0;    // envios que o kernel segmentou (UDP_SEGMENT)
+    uint64_t retransmissoes = 0;  // pacotes reenviados
+    uint64_t retransmissoesRapidas = 0; // desses, quantos por ACKs duplicados
+    uint64_t pausasCadencia = 0;  // vezes que a cadência segurou fragmentos
+};
+
+// Conclusão de uma mensagem enviada com submit(): (id, entregue)
+using CallbackEnvio = function<void(uint64_t, bool)>;
+
+// Mensagem da aplicação na fila de envio. Fica na fila até o ACK cumulativo
+// cobrir seu último fragmento. "dados" aponta para a memória do chamador
+// (submitView) ou para a string entregue a submit(), mantida viva por "dono";
+// os fragmentos são enviados e reenviados direto dessa memória.
+struct MensagemPendente {
+    uint64_t id = 0;
+    string_view dados;
+    shared_ptr<const string> dono; // nulo quando a memória é do chamador
+    size_t   off = 0;             // bytes já colocados em fragmentos
+    uint8_t  fid = 0;             // fid dos fragmentos (0 se não fragmentada)
+    uint8_t  fo = 0;              // próximo fragment offset
+    bool     todaEnviada = false; // último fragmento já saiu
+    uint32_t ultimoSeq = 0;       // seq do último fragmento
+    chrono::steady_clock::time_point inicio; // entrada na fila (latência até o ACK)
+    CallbackEnvio cb;
+};
+
+// Fila circular das mensagens do submit(). Ao contrário de um deque, não
+// aloca nem libera blocos conforme as mensagens entram e saem: só cresce
+// (dobrando) quando há mais mensagens pendentes do que coube até agora.
+class FilaMensagens {
+public:
+    bool empty() const { return n == 0; }
+    size_t size() const { return n; }
+    MensagemPendente& operator[](size_t i) { return itens[(inicio + i) & mascara]; }
+    MensagemPendente& front() { return (*this)[0]; }
+    MensagemPendente& back() { return (*this)[n - 1]; }
+
+    void push_back(MensagemPendente&& m) {
+        if (n == itens.size()) crescer();
+        itens[(inicio + n) & mascara] = std::move(m);
+        n++;
+    }
+    // Remove a primeira; o slot é limpo para soltar o callback e o dono
+    void pop_front() {
+        itens[inicio] = MensagemPendente{};
+        inicio = (inicio + 1) & mascara;
+        n--;
+    }
+    void reservar(size_t cap) { while (itens.size() < cap) crescer(); }
+
+private:
+    void crescer() {
+        size_t cap = itens.empty() ? 16 : 2 * itens.size();
+        vector<MensagemPendente> novos(cap);
+        for (size_t i = 0; i < n; i++) novos[i] = std::move((*this)[i]);
+        itens.swap(novos);
+        inicio = 0;
+        mascara = cap - 1;
+    }
+
+    vector<MensagemPendente> itens;
+    size_t inicio = 0, n = 0, mascara = 0;
+};
+
+// Tamanho dos buffers de uma sessão. O padrão serve a um cliente por
+// processo; o motor de várias sessões (slow_motor.h) usa buffers pequenos
+// para caberem milhares delas.
+struct PerfilSessao {
+    size_t registrosTrace = 4096;  // capacidade do anel de trace
+    size_t slotsRecepcao = 64;     // pool de remontagem (janela anunciada)
+};
+
+// Encapsula o socket e a lógica do protocolo SLOW.
+class UDPPeripheral {
+    int fd;                       // descritor do socket UDP
+    bool socketProprio = true;    // false: socket do motor, que lê e distribui os datagramas
+    sockaddr_in srv;              // Endereço do servidor
+    Header lastHdr, prevHdr;      // último header recebido/enviado
+    bool active = false;          // sessão ativa
+    bool hasPrev = false;         // sessão armazenada para revive
+    uint32_t nextSeq = 0;         // Próximo número de sequência a usar
+    uint32_t lastCentralSeq = 0;  //  último seq recebido do servidor
+    uint32_t window_size = 5 * DATA_MAX; // tamanho máximo da janela (5 × 1440 bytes)
+    uint32_t bytesInFlight = 0;   // quantos bytes estão aguardando ACK
+    FilaRetransmissao pacotesEmTransito; //fila circular de pacotes em transmissão
+    RodaTemporizadores temporizadores;   //prazo de retransmissão da sessão
+    uint32_t temporizadorRTO = RodaTemporizadores::NIL; //prazo pendente na roda (um só, RFC 6298)
+    uint32_t geracaoRTO = 0;             //identifica o prazo armado por último
+    EstimadorRTT rtt;                    //SRTT/RTTVAR/RTO da sessão
+    unique_ptr<ControleCongestionamento> cc = criarControle(AlgoritmoCongestionamento::NEWRENO);
+    chrono::steady_clock::time_point ultimoReenvio{}; //pacotes enviados antes não geram amostra
+    bool reenviandoPerdidos = false;     //depois de um RTO, até o ACK cobrir perdidosAte
+    uint32_t proximoPerdido = 0;         //próximo pacote tido como perdido a reenviar
+    uint32_t perdidosAte = 0;            //último seq enviado antes do RTO
+    uint32_t bytesPerdidos = 0;          //bytes em trânsito tidos como perdidos, ainda não reenviados
+    FalhaEntrega falha;                  //último pacote abandonado
+    uint32_t ultimoAck = 0;              //último ACK cumulativo recebido
+    uint32_t acksDuplicados = 0;         //ACKs repetidos seguidos
+    uint32_t limiarAcksDuplicados = 3;   //dispara a retransmissão rápida (0 = desligada)
+    bool emRecuperacao = false;          //recuperação rápida em andamento
+    uint32_t recuperacaoAte = 0;         //último seq enviado quando a perda foi detectada
+    uint32_t inflacao = 0;               //bytes somados à cwnd pelos ACKs duplicados
+    Cadenciador cadencia;                //espaça os fragmentos novos (setCadencia)
+    bool cadenciaSegurando = false;      //há fragmento esperando o crédito da cadência
+    Reator reator;                       //epoll + timerfd do socket
+    FilaMensagens filaEnvio;             //mensagens enviadas ou a enviar, ainda sem ACK
+    size_t proximaAFragmentar = 0;       //índice em filaEnvio da 1ª mensagem com bytes a enviar
+    uint64_t proximoIdMensagem = 0;
+    uint8_t  ultimoFid = 0;              //fid da última mensagem fragmentada (0 = sem fragmentos)
+    size_t falhasMensagens = 0;          //mensagens concluídas com erro, inclusive recusadas no submit
+    size_t falhasRelatadas = 0;          //falhasMensagens na última volta de aguardarEnvios
+    bool janelaCheiaAvisada = false;
+    AnelTrace trace;                     //registros de cada pacote, formatados fora do caminho de dados
+    bool loteIO = true;                  //sendmmsg/recvmmsg em vez de sendto/recvfrom
+    LoteEnvio loteEnvio;
+    unique_ptr<LoteRecepcao> loteRecepcao; //criado em init (só quem lê o próprio socket)
+    EstatisticasIO io;
+    Remontador recepcao;                 //mensagens vindas da central (pool de slots)
+    ModoAgrupamento modoAgrupamento = ModoAgrupamento::DESLIGADO;
+    Agrupador agrupamento;               //lote aberto de mensagens pequenas
+    vector<pair<uint64_t, CallbackEnvio>> callbacksAgrupados; //(id, cb) de cada registro do lote
+    size_t limiarAgrupamento = DATA_MAX; //descarrega ao atingir esse tamanho
+    unique_ptr<CacheSessoes> cacheSessoes; //sessões em disco para o revive entre processos
+    string hostServidor;                 //chave no cache (como passado a init)
+    uint16_t portaServidor = 0;
+    bool sessaoDoCache = false;          //estado de revive veio do cache em init
+    bool revividaDoCache = false;        //conectarOuReviver() fez revive em vez de handshake
+    bool revivendo = false;              //R+ACK enviado, sem resposta da central ainda
+    bool reviveRecusado = false;         //a central respondeu ao R+ACK sem AR
+    bool sessaoRevivida = false;         //a sessão atual veio de revive (e não de handshake)
+    uint32_t seqRevive = 0;              //seq do R+ACK (a resposta o confirma)
+    chrono::steady_clock::time_point envioRevive;
+    uint32_t seqConnect = 0;             //seq do último CONNECT (o SETUP o confirma)
+    uint32_t tentativasConnect = 0;
+    chrono::steady_clock::time_point envioConnect;
+    chrono::microseconds atrasoAgrupamento{2000}; //e no máximo esse tempo depois do 1º registro
+    unique_ptr<FilaSubmissao<CallbackEnvio>> filaSubmissao; //submits de outras threads
+    chrono::steady_clock::time_point inicioConnect; //primeiro CONNECT (latência do handshake)
+    MetricasSessao metricas;             //contadores e histogramas, lidos pelo exportador
+    RegistroMetricas* registroMetricas = nullptr;
+    Transporte* transporte = nullptr;    //no lugar do socket (usarTransporte)
+    const FonteTempo* relogio = nullptr; //no lugar do steady_clock
+
+    chrono::steady_clock::time_point agora() const {
+        return relogio ? relogio->agora() : chrono::steady_clock::now();
+    }
+
+    void mostrarHeader(const Header& h, EventoTrace e) {
+        trace.cabecalho(TRACE_PACOTE, e, h);
+    }
+
+    void mostrarPayload(const uint8_t* dados, size_t n) {
+        trace.payload(dados, n);
+    }
+
+    // Envia cabeçalho + payload sem juntá-los num buffer: entra no lote ou
+    // sai direto com sendmsg (scatter-gather)
+    bool transmitir(const uint8_t* hdr, const uint8_t* dados, size_t dataSize) {
+        if (loteIO && !transporte) {
+            loteEnvio.adicionar(hdr, dados, dataSize);
+            if (loteEnvio.cheio()) despacharLote();
+            return true;
+        }
+        io.chamadasEnvio++;
+        if (!enviarDireto(hdr, dados, dataSize)) return false;
+        io.datagramasEnviados++;
+        return true;
+    }
+
+    // Um datagrama já, pelo socket ou pelo transporte
+    bool enviarDireto(const uint8_t* hdr, const void* dados, size_t dataSize) {
+        iovec iov[2] = {{const_cast<uint8_t*>(hdr), (size_t)HDR_SIZE},
+                        {const_cast<void*>(dados), dataSize}};
+        size_t n = dataSize ? 2 : 1;
+        if (transporte) return transporte->enviar(iov, n);
+        msghdr mh{};
+        mh.msg_name = &srv;
+        mh.msg_namelen = sizeof(srv);
+        mh.msg_iov = iov;
+        mh.msg_iovlen = n;
+        return sendmsg(fd, &mh, 0) >= 0;
+    }
+
+    void despacharLote() {
+        if (loteEnvio.vazio()) return;
+        io.datagramasEnviados += loteEnvio.tamanho();
+        io.chamadasEnvio += loteEnvio.despachar(fd, srv);
+        io.mensagensGSO += loteEnvio.mensagensGSO();
+    }
+
+    // Janela anunciada (até 16 bits): espaço livre no pool de remontagem
+    uint16_t advertisedWindow() const {
+        return static_cast<uint16_t>(min<uint32_t>(recepcao.janelaLivre(), UINT16_MAX));
+    }
+
+    // Temporizador de retransmissão da sessão (RFC 6298): um prazo só, de um
+    // RTO a partir de agora, valendo para o pacote mais antigo sem ACK.
+    // É rearmado quando um ACK avança e desarmado quando nada falta, então
+    // um RTO novo (amostra depois de um backoff) vale logo no próximo prazo.
+    void armarRetransmissao(chrono::steady_clock::time_point agora) {
+        temporizadores.cancelar(temporizadorRTO);
+        PacoteEmTransmissao* p = pacotesEmTransito.primeiro();
+        if (p) temporizadorRTO = temporizadores.agendar(p->seq, ++geracaoRTO, agora + rtt.rto());
+    }
+
+    // Verifica o prazo de retransmissão: só os prazos vencidos na roda são
+    // visitados, e o relógio é lido uma vez por chamada. Vencido, só o pacote
+    // mais antigo sem ACK é reenviado e decide o abandono: é ele que impede a
+    // central de confirmar os demais, e reenviar a janela toda de uma vez
+    // transbordaria de novo a fila que causou a perda. Os outros passam a
+    // contar como perdidos e voltam pela janela (reenviarPerdidos), que
+    // recomeça de 1 MSS.
+    void verificarTimeouts() {
+        auto agora = this->agora();
+        bool venceu = false;
+        temporizadores.avancar(agora, [&](uint32_t, uint32_t geracao) {
+            if (geracao != geracaoRTO) return; // prazo antigo
+            temporizadorRTO = RodaTemporizadores::NIL; // o nó já voltou ao pool
+            venceu = true;
+        });
+        PacoteEmTransmissao* p = venceu ? pacotesEmTransito.primeiro() : nullptr;
+        if (!p) return;
+        if (p->tentativas >= MAX_TENTATIVAS) {
+            abandonarEnvios(p->seq, p->tentativas);
+            return;
+        }
+        metricas.timeouts.somar();
+        rtt.aplicarBackoff(); // RTO dobra a cada timeout
+        cc->aoTimeout(bytesInFlight, agora);
+        sairDaRecuperacao(); // o timeout encerra a recuperação rápida
+        reenviar(*p, agora);
+        armarRetransmissao(agora);
+        reenviandoPerdidos = true;
+        proximoPerdido = p->seq + 1;
+        perdidosAte = nextSeq - 1;
+        bytesPerdidos = bytesInFlight - p->dataSize;
+        despacharLote();
+    }
+
+    // Bytes que de fato ocupam a rede: depois de um RTO, os pacotes tidos
+    // como perdidos só voltam a contar quando são reenviados
+    uint32_t bytesNaRede() const { return bytesInFlight - bytesPerdidos; }
+
+    // Reenvia, do mais antigo ao mais novo, os pacotes tidos como perdidos
+    // no último RTO, enquanto a janela efetiva deixar (os que um ACK já
+    // confirmou são pulados). Retorna false se algum ainda espera a janela.
+    bool reenviarPerdidos() {
+        optional<chrono::steady_clock::time_point> agora;
+        while (reenviandoPerdidos && seqMenorIgual(proximoPerdido, perdidosAte)) {
+            PacoteEmTransmissao* p = pacotesEmTransito.buscar(proximoPerdido);
+            if (p) {
+                uint32_t naRede = bytesNaRede();
+                if (naRede > 0 && naRede + p->dataSize > janelaEfetiva()) return false;
+                if (!agora) agora = this->agora();
+                reenviar(*p, *agora);
+                bytesPerdidos -= p->dataSize;
+            }
+            proximoPerdido++;
+        }
+        return true;
+    }
+
+    // Reenvia um pacote em trânsito (no modo lote, sai no próximo sendmmsg);
+    // quem chama rearma o temporizador
+    void reenviar(PacoteEmTransmissao& p, chrono::steady_clock::time_point agora) {
+        trace.evento(TRACE_EVENTO, EventoTrace::REENVIANDO, p.seq, p.tentativas + 1);
+        
+        if (transmitir(p.cabecalho, p.dados, p.dataSize)) {
+            p.atualizarTempo(agora);
+            ultimoReenvio = agora;
+            io.retransmissoes++;
+            metricas.retransmissoes.somar();
+            
+            // Registra o header do pacote reenviado (já serializado no slot)
+            trace.cabecalho(TRACE_PACOTE, EventoTrace::REENVIADO_DATA, p.cabecalho);
+            mostrarPayload(p.dados, p.dataSize);
+        } else {
+            cerr << "Erro ao reenviar pacote seq=" << p.seq << endl;
+            p.tentativas++; // conta a tentativa mesmo sem envio
+        }
+    }
+
+    // Retransmissão rápida (RFC 6582): o primeiro pacote sem ACK é reenviado
+    // sem esperar o RTO, que recomeça a contar a partir do reenvio.
+    void retransmitirPrimeiro(chrono::steady_clock::time_point agora) {
+        PacoteEmTransmissao* p = pacotesEmTransito.primeiro();
+        if (!p || p->tentativas >= MAX_TENTATIVAS) return; // o temporizador decide o abandono
+        io.retransmissoesRapidas++;
+        metricas.retransmissoesRapidas.somar();
+        reenviar(*p, agora);
+        armarRetransmissao(agora);
+    }
+
+    // ACK que não avançou com pacotes em trânsito: a central recebeu algo
+    // depois de uma lacuna. Antes do limiar, cada duplicado libera um
+    // fragmento novo além da cwnd (transmissão limitada, RFC 3042), para que
+    // poucos pacotes atrás da lacuna ainda gerem duplicados suficientes. No
+    // limiar, reenvia o primeiro pacote e entra em recuperação; cada ACK
+    // duplicado a mais infla a janela de um pacote (um pacote saiu da rede).
+    void tratarAckDuplicado(chrono::steady_clock::time_point agora) {
+        if (limiarAcksDuplicados == 0) return;
+        acksDuplicados++;
+        if (emRecuperacao) {
+            inflacao += DATA_MAX;
+            return;
+        }
+        if (acksDuplicados < limiarAcksDuplicados) {
+            inflacao = acksDuplicados * DATA_MAX;
+            return;
+        }
+        if (reenviandoPerdidos) return; // depois de um RTO os duplicados vêm dos próprios reenvios (RFC 6582)
+        emRecuperacao = true;
+        recuperacaoAte = nextSeq - 1;
+        cc->aoPerda(bytesInFlight, agora);
+        inflacao = limiarAcksDuplicados * DATA_MAX;
+        retransmitirPrimeiro(agora);
+    }
+
+    // ACK novo durante a recuperação: ACK parcial reenvia a próxima lacuna,
+    // ACK que cobre recuperacaoAte encerra a recuperação
+    void tratarAckNovo(uint32_t ack, chrono::steady_clock::time_point agora) {
+        acksDuplicados = 0;
+        if (!emRecuperacao) {
+            inflacao = 0; // fim da transmissão limitada
+            return;
+        }
+        if (seqMenor(ack, recuperacaoAte)) {
+            inflacao = 0;
+            retransmitirPrimeiro(agora);
+        } else {
+            sairDaRecuperacao();
+        }
+    }
+
+    // Encerra a recuperação rápida. A contagem de duplicados continua: só
+    // um ACK novo a zera, então um timeout no meio dela não impede que os
+    // duplicados seguintes cheguem ao limiar.
+    void sairDaRecuperacao() {
+        emRecuperacao = false;
+        inflacao = 0;
+    }
+
+    // Um pacote esgotou as tentativas: a central nunca vai confirmar além dele,
+    // então todos os pacotes em trânsito falham e a sessão fica inativa
+    // (guardada para revive, que reinicia a sequência na central)
+    void abandonarEnvios(uint32_t seq, uint32_t tentativas) {
+        trace.evento(TRACE_EVENTO, EventoTrace::PACOTE_DESCARTADO, seq, tentativas);
+        falha.ocorreu = true;
+        falha.seq = seq;
+        falha.tentativas = tentativas;
+        metricas.pacotesDescartados.somar(pacotesEmTransito.tamanho());
+        esquecerEmTransito();
+        storeSession();
+        active = false;
+        falharMensagens();
+    }
+
+    // Descarta os pacotes em trânsito e o prazo de retransmissão, sem
+    // concluir as mensagens (abandono, ou revive recusado que as manda de novo)
+    void esquecerEmTransito() {
+        if (!pacotesEmTransito.vazia())
+            pacotesEmTransito.confirmarAte(pacotesEmTransito.primeiroSeq() + pacotesEmTransito.tamanho() - 1);
+        temporizadores.cancelar(temporizadorRTO);
+        bytesInFlight = 0;
+        acksDuplicados = 0;
+        reenviandoPerdidos = false;
+        bytesPerdidos = 0;
+        sairDaRecuperacao();
+        loteEnvio.descartar(); // aponta para slots que acabaram de ser liberados
+    }
+
+    // Volta as mensagens da fila ao primeiro byte, para saírem inteiras
+    // numa sessão nova
+    void rebobinarMensagens() {
+        for (size_t i = 0; i < filaEnvio.size(); i++) {
+            MensagemPendente& m = filaEnvio[i];
+            m.off = 0;
+            m.fo = 0;
+            m.fid = 0;
+            m.todaEnviada = false;
+        }
+        proximaAFragmentar = 0;
+    }
+
+    //remove da fila de pacotes em transmissão o pacote com esse seq e retorna o seu tamanho
+    uint32_t removerPacote(uint32_t seq){
+        uint32_t n = pacotesEmTransito.remover(seq); // busca O(1) pelo slot seq & mascara
+        armarRetransmissao(agora());
+        return n;
+    }
+
+    // Remove todos os pacotes com seq <= ack (ACK cumulativo, com wraparound).
+    // O pacote confirmado gera uma amostra de RTT se nunca foi reenviado e
+    // nada foi reenviado depois dele (Karn): um pacote que esperou atrás de
+    // uma lacuna só é confirmado quando o reenvio dela chega, e mediria a
+    // espera pelo RTO em vez do RTT. Os bytes confirmados alimentam o
+    // controle de congestionamento (que não cresce durante a recuperação
+    // rápida). O ACK novo rearma o temporizador de retransmissão. Retorna os
+    // bytes confirmados.
+    uint32_t removerPacotesAteAck(uint32_t ack, chrono::steady_clock::time_point agora) {        
+        PacoteEmTransmissao* p = pacotesEmTransito.buscar(ack);
+        if (p && p->tentativas == 1 && p->tempoEnvio > ultimoReenvio) {
+            auto amostra = chrono::duration_cast<EstimadorRTT::us>(agora - p->tempoEnvio);
+            rtt.amostra(amostra);
+            metricas.rtt.registrar(amostra);
+        }
+        uint32_t confirmados = pacotesEmTransito.confirmarAte(ack, [&](PacoteEmTransmissao& c) {
+            if (reenviandoPerdidos && !seqMenor(c.seq, proximoPerdido) && seqMenorIgual(c.seq, perdidosAte))
+                bytesPerdidos -= c.dataSize; // perdido que chegou: não precisa mais ser reenviado
+        });
+        if (confirmados > 0) armarRetransmissao(agora);
+        bytesInFlight -= confirmados;
+        if (reenviandoPerdidos) {
+            if (seqMenor(proximoPerdido, ack + 1)) proximoPerdido = ack + 1;
+            if (!seqMenor(ack, perdidosAte)) {
+                reenviandoPerdidos = false;
+                bytesPerdidos = 0;
+            }
+        }
+        if (confirmados > 0 && !emRecuperacao)
+            cc->aoConfirmar(confirmados, window_size, agora, rtt.srttAtual());
+        return confirmados;
+    }
+
+    // Bytes que podem estar em trânsito: janela anunciada limitada pela cwnd
+    // (inflada pelos ACKs duplicados durante a recuperação rápida)
+    uint32_t janelaEfetiva() const {
+        return min<uint64_t>(window_size, (uint64_t)cc->janela() + inflacao);
+    }
+
+    // Ajusta a janela anunciada pela central e a capacidade da fila circular
+    void atualizarJanela(uint32_t wnd) {
+        window_size = wnd;
+        pacotesEmTransito.garantirCapacidade(FilaRetransmissao::capacidadePara(wnd));
+    }
+
+    // Arma o timerfd no próximo prazo da sessão
+    void armarTemporizador() {
+        reator.armar(proximoPrazo());
+    }
+
+    // Recebe um datagrama esperando no máximo timeoutMs; retransmissões que
+    // vencerem nesse meio tempo são tratadas. Retorna o tamanho ou -1.
+    ssize_t receberComPrazo(uint8_t* buf, size_t cap, int timeoutMs) {
+        auto limite = agora() + chrono::milliseconds(timeoutMs);
+        while (true) {
+            if (transporte) {
+                ssize_t n = transporte->receber(buf, cap);
+                if (n >= 0) return n;
+            } else {
+                sockaddr_in sa; socklen_t sl = sizeof(sa);
+                ssize_t n = recvfrom(fd, buf, cap, 0, (sockaddr*)&sa, &sl);
+                if (n >= 0) return n;
+                if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) return -1;
+            }
+
+            auto restante = chrono::duration_cast<chrono::milliseconds>(limite - agora()).count();
+            if (restante <= 0) return -1;
+            uint32_t ev;
+            if (transporte) {
+                ev = transporte->esperar(proximoPrazo(), (int)restante);
+            } else {
+                armarTemporizador();
+                ev = reator.esperar((int)restante);
+            }
+            if ((ev & Reator::EV_FILA) && filaSubmissao) filaSubmissao->aposEspera(true); // fica para depois
+            if (ev & Reator::EV_TIMER) verificarTimeouts();
+        }
+    }
+
+    // Dorme no epoll até o próximo prazo ou timeoutMs. Com a fila de
+    // submissão, só dorme se ela estiver vazia; aí o próximo produtor acorda
+    // a thread pelo eventfd.
+    uint32_t esperarEventos(int timeoutMs) {
+        if (transporte) return transporte->esperar(proximoPrazo(), timeoutMs);
+        armarTemporizador();
+        if (filaSubmissao && !filaSubmissao->prepararEspera()) timeoutMs = 0;
+        uint32_t ev = reator.esperar(timeoutMs);
+        if (filaSubmissao) filaSubmissao->aposEspera(ev & Reator::EV_FILA);
+        return ev;
+    }
+
+    // Passa ao envio as mensagens de outras threads (no máximo uma volta do
+    // anel por passo, para os ACKs não esperarem produtores rápidos)
+    void drenarSubmissoes() {
+        if (!filaSubmissao) return;
+        FilaSubmissao<CallbackEnvio>::Item item;
+        for (size_t i = filaSubmissao->capacidade(); i > 0 && filaSubmissao->retirar(item); i--)
+            submit(std::move(item.msg), std::move(item.cb));
+    }
+
+    // Aplica um ACK da central ao estado da sessão. Um ACK que traz dados
+    // não conta como duplicado (RFC 5681): o ack dele só se repete porque a
+    // central está enviando, não porque algo se perdeu.
+    void processarAck(const Header& r, bool comDados = false) {
+        auto agora = this->agora();
+        // Remove todos os pacotes confirmados até r.ack (ACK cumulativo)
+        bool emTransito = !pacotesEmTransito.vazia();
+        if (removerPacotesAteAck(r.ack, agora) > 0) tratarAckNovo(r.ack, agora);
+        else if (emTransito && !comDados && r.ack == ultimoAck) tratarAckDuplicado(agora);
+        ultimoAck = r.ack;
+        
+        lastCentralSeq = r.seq;
+        prevHdr = r;
+        // a central ecoa o seq confirmado; com vários pacotes em
+        // trânsito isso não pode fazer nextSeq voltar
+        if (seqMenor(nextSeq, lastCentralSeq + 1))
+            nextSeq = lastCentralSeq + 1;
+        atualizarJanela(r.wnd);
+        concluirMensagens();
+        atualizarMedidores();
+    }
+
+    void atualizarMedidores() {
+        metricas.bytesEmTransito.definir(bytesInFlight);
+        metricas.cwnd.definir(cc->janela());
+        metricas.srttUs.definir((uint64_t)rtt.srttAtual().count());
+    }
+
+    // Mensagens do início da fila cujo último fragmento já foi confirmado
+    void concluirMensagens() {
+        optional<chrono::steady_clock::time_point> agora;
+        while (!filaEnvio.empty() && proximaAFragmentar > 0) {
+            MensagemPendente& m = filaEnvio.front();
+            if (!m.todaEnviada) break;
+            if (!pacotesEmTransito.vazia() && !seqMenor(m.ultimoSeq, pacotesEmTransito.primeiroSeq()))
+                break; // ainda há fragmento dela sem ACK
+            if (!agora) agora = this->agora();
+            metricas.mensagensConfirmadas.somar();
+            metricas.bytesConfirmados.somar(m.dados.size());
+            metricas.latenciaMensagem.registrar(chrono::duration_cast<Histograma::us>(*agora - m.inicio));
+            CallbackEnvio cb = std::move(m.cb);
+            uint64_t id = m.id;
+            filaEnvio.pop_front();
+            proximaAFragmentar--;
+            if (cb) cb(id, true);
+        }
+    }
+
+    // Conclui com erro tudo o que está na fila de envio (e no lote aberto)
+    void falharMensagens() {
+        if (!agrupamento.vazio()) {
+            agrupamento.retirar();
+            auto cbs = std::move(callbacksAgrupados);
+            callbacksAgrupados.clear();
+            for (auto& [id, cb] : cbs) {
+                falhasMensagens++;
+                metricas.mensagensFalhas.somar();
+                if (cb) cb(id, false);
+            }
+        }
+        // só as que já estavam na fila: callbacks podem enfileirar outras
+        size_t n = filaEnvio.size();
+        proximaAFragmentar = 0;
+        for (size_t i = 0; i < n && !filaEnvio.empty(); i++) {
+            MensagemPendente m = std::move(filaEnvio.front());
+            filaEnvio.pop_front();
+            falhasMensagens++;
+            metricas.mensagensFalhas.somar();
+            if (m.cb) m.cb(m.id, false);
+        }
+    }
+
+    // Submit recusado na hora (sessão inativa ou mensagem grande demais):
+    // falha como as que não foram confirmadas, e aguardarEnvios a vê
+    uint64_t recusar(CallbackEnvio& cb) {
+        falhasMensagens++;
+        metricas.mensagensFalhas.somar();
+        if (cb) cb(0, false);
+        return 0;
+    }
+
+    // Libera fragmentos enquanto houver janela, atravessando mensagens:
+    // o fim de uma mensagem não espera o ACK para começar a próxima. No modo
+    // lote, tudo o que a janela liberou sai num único sendmmsg.
+    void bombear() {
+        liberarFragmentos();
+        despacharLote();
+        metricas.bytesEmTransito.definir(bytesInFlight);
+    }
+
+    void liberarFragmentos() {
+        optional<chrono::steady_clock::time_point> agora;
+        if (cadencia.ligado()) {
+            cadencia.ajustar(janelaEfetiva(), rtt.srttAtual(), cc->emSlowStart());
+            agora = this->agora();
+        }
+        cadenciaSegurando = false;
+        if (active && !reenviarPerdidos()) return; // os perdidos no RTO saem antes dos novos
+        while (active && proximaAFragmentar < filaEnvio.size()) {
+            MensagemPendente& m = filaEnvio[proximaAFragmentar];
+            size_t restante = m.dados.size() - m.off;
+            // fragmento cheio (ou o resto da mensagem), nunca maior que a janela
+            // toda; esperar por espaço evita fragmentos minúsculos
+            uint32_t janela = janelaEfetiva();
+            size_t tamanho = min<size_t>({restante, (size_t)DATA_MAX, max<size_t>(janela, 1)});
+            bool semEspaco = pacotesEmTransito.cheia() ||
+                             (bytesNaRede() > 0 && bytesNaRede() + tamanho > janela) ||
+                             janela == 0;
+            if (semEspaco) {
+                if (!janelaCheiaAvisada) {
+                    trace.evento(TRACE_EVENTO, EventoTrace::JANELA_CHEIA);
+                    metricas.janelaCheia.somar();
+                    janelaCheiaAvisada = true;
+                }
+                return;
+            }
+            janelaCheiaAvisada = false;
+            if (agora && !cadencia.liberado(*agora)) { // sai quando houver crédito
+                cadenciaSegurando = true;
+                io.pausasCadencia++;
+                return;
+            }
+
+            if (m.off == 0) // primeiro fragmento: decide se a mensagem será fragmentada
+                m.fid = tamanho < m.dados.size() ? proximoFid() : 0; //Identificador único para todos os fragmentos
+            bool more = m.off + tamanho < m.dados.size();
+            uint32_t seq = nextSeq;
+            if (!enviarFragmento((const uint8_t*)m.dados.data() + m.off, tamanho, m.fid, m.fo, more))
+                return; // erro de sendto: tenta de novo na próxima volta
+            if (agora) cadencia.consumir(tamanho + HDR_SIZE);
+            m.off += tamanho;
+            m.fo += 1;
+            if (!more) {
+                m.todaEnviada = true;
+                m.ultimoSeq = seq;
+                proximaAFragmentar++;
+            }
+        }
+    }
+
+    // fid da próxima mensagem fragmentada: sequencial, dando a volta em 255
+    // para 1 (0 fica para as mensagens de um fragmento só), então mensagens
+    // consecutivas nunca repetem o fid
+    uint8_t proximoFid() {
+        ultimoFid = ultimoFid == 255 ? 1 : ultimoFid + 1;
+        return ultimoFid;
+    }
+
+    // Monta e envia um fragmento baseado no último header recebido
+    bool enviarFragmento(const uint8_t* data, size_t len, uint8_t fid, uint8_t fo, bool more) {
+        Header h = prevHdr;
+        h.seq = nextSeq; //número da sequência
+        h.ack = lastCentralSeq;
+        h.wnd = advertisedWindow(); //espaço livre na janela
+
+        // Flags: sempre ACK; MB se ainda houver mais fragmentos; R no
+        // primeiro pacote de um revive
+        bool revive = revivendo && h.seq == seqRevive;
+        h.sf = (h.sf & ~0x1F) | FLAG_ACK | (more ? FLAG_MB : 0) | (revive ? FLAG_R : 0);
+
+        h.fid = fid; //qual mensagem o fragmento faz parte
+        h.fo = fo; //indice do fragmento
+
+        //realiza o envio do fragmento: só o cabeçalho é montado aqui
+        uint8_t hdr[HDR_SIZE];
+        serialize(h, hdr);
+        mostrarHeader(h, revive ? EventoTrace::ENVIADO_REVIVE : EventoTrace::ENVIADO_DATA);
+
+        if (!enviarPacoteComTimeout(hdr, data, h.seq, len)) return false;
+        nextSeq++;
+        return true;
+    }
+
+    // Trabalho sem bloqueio de uma volta do laço
+    void passo() {
+        drenarSubmissoes();
+        verificarTimeouts();
+        recepcao.expirar(agora());
+        if (active && socketProprio) receberAcks();
+        if (active && deveDescarregar()) flush();
+        if (active) bombear();
+        else if (!filaEnvio.empty()) falharMensagens();
+    }
+
+    // Esvazia o socket sem bloquear, aplicando todos os ACKs que chegaram
+    // (recvmmsg no modo lote). Retorna quantos ACKs foram processados.
+    int receberAcks() {
+        int acks = 0;
+        uint8_t rbuf[HDR_SIZE + DATA_MAX];
+        if (transporte) {
+            ssize_t n;
+            while ((n = transporte->receber(rbuf, sizeof(rbuf))) >= 0) {
+                io.chamadasRecepcao++;
+                io.datagramasRecebidos++;
+                acks += tratarDatagrama(rbuf, (size_t)n);
+            }
+            return acks;
+        }
+        if (loteIO) {
+            LoteRecepcao& l = *loteRecepcao;
+            while (true) {
+                int n = recvmmsg(fd, l.msgs, LoteRecepcao::MAX, MSG_DONTWAIT, nullptr);
+                io.chamadasRecepcao++;
+                if (n <= 0) break; // EAGAIN: nada mais pendente
+                io.datagramasRecebidos += n;
+                for (int i = 0; i < n; i++)
+                    acks += tratarDatagrama(l.buf[i], l.msgs[i].msg_len);
+                if (n < LoteRecepcao::MAX) break;
+            }
+            return acks;
+        }
+        while (true) {
+            sockaddr_in sa; socklen_t sl = sizeof(sa);
+            ssize_t n = recvfrom(fd, rbuf, sizeof(rbuf), 0, (sockaddr*)&sa, &sl);
+            io.chamadasRecepcao++;
+            if (n < 0) break; // EAGAIN: nada mais pendente
+            io.datagramasRecebidos++;
+            acks += tratarDatagrama(rbuf, (size_t)n);
+        }
+        return acks;
+    }
+
+    // Interpreta um datagrama recebido durante a transferência; 1 se era ACK
+    int tratarDatagrama(const uint8_t* rbuf, size_t n) {
+        if (n < (size_t)HDR_SIZE) return 0;
+
+        Header r; 
+        deserialize(r, rbuf);
+        
+        // Ignora pacotes com flags = 0 e os de outra sessão (respostas
+        // atrasadas de antes de um handshake)
+        if ((r.sf & 0x1F) == 0 || !r.sid.isEqual(prevHdr.sid)) return 0;
+        if (revivendo && !resolverRevive(r)) return 0;
+        
+        mostrarHeader(r, EventoTrace::RECEBIDO_ACK_DATA);
+        bool comDados = n > (size_t)HDR_SIZE;
+        if (comDados) {
+            mostrarPayload(rbuf + HDR_SIZE, n - HDR_SIZE);
+            recepcao.receber(r, rbuf + HDR_SIZE, n - HDR_SIZE, agora());
+        }
+        if (!(r.sf & FLAG_ACK)) return 0;
+        processarAck(r, comDados);
+        return 1;
+    }
+
+    // Resposta durante o revive. A central aceita com AR (ou com um ACK além
+    // do R+ACK, se a resposta ao revive se perdeu) e recusa com um ACK sem
+    // AR do próprio R+ACK. Retorna true se o pacote segue como ACK normal.
+    bool resolverRevive(const Header& r) {
+        bool aceito = (r.sf & FLAG_AR) ? !seqMenor(r.ack, seqRevive) : seqMenor(seqRevive, r.ack);
+        if (!aceito) {
+            if (r.ack == seqRevive) {
+                mostrarHeader(r, EventoTrace::RECEBIDO_ACK_REVIVE);
+                revivendo = false;
+                reviveRecusado = true;
+            } else {
+                trace.evento(TRACE_EVENTO, EventoTrace::PACOTE_IGNORADO, r.seq, r.ack); // de antes do revive
+            }
+            return false;
+        }
+        mostrarHeader(r, EventoTrace::RECEBIDO_ACK_REVIVE);
+        metricas.revives.somar();
+        metricas.latenciaRevive.registrar(chrono::duration_cast<Histograma::us>(agora() - envioRevive));
+        revivendo = false;
+        sessaoRevivida = true;
+        lastHdr = r;
+        return true;
+    }
+
+    // Função auxiliar para enviar pacote e adicionar à fila. O pacote entra
+    // na fila primeiro para que o lote aponte para o cabeçalho do slot.
+    bool enviarPacoteComTimeout(const uint8_t* hdr, const uint8_t* dados, uint32_t seq, size_t dataSize) {
+        if (pacotesEmTransito.cheia()) return false;
+        PacoteEmTransmissao& p = pacotesEmTransito.inserir(hdr, dados, seq, dataSize, agora());
+        if (!transmitir(p.cabecalho, p.dados, p.dataSize)) {
+            pacotesEmTransito.remover(seq);
+            return false;
+        }
+        if (temporizadorRTO == RodaTemporizadores::NIL) armarRetransmissao(p.tempoEnvio);
+        bytesInFlight += dataSize;
+        metricas.pacotesEnviados.somar();
+        metricas.bytesEnviados.somar(dataSize);
+        mostrarPayload(p.dados, dataSize);
+        return true;
+    }
+
+    // Registro pequeno no modo de agrupamento: entra no lote aberto, que é
+    // descarregado antes se o registro não couber. Registros maiores que o
+    // limiar saem sozinhos, mas enquadrados (a central desagrupa tudo).
+    uint64_t agrupar(string_view registro, CallbackEnvio cb) {
+        if (!active) return recusar(cb);
+        size_t n = Agrupador::enquadrado(registro);
+        if (!agrupamento.vazio() && agrupamento.tamanho() + n > limiarAgrupamento) flush();
+        if (n > limiarAgrupamento) {
+            auto dono = make_shared<string>();
+            dono->reserve(n);
+            enquadrar(*dono, registro);
+            string_view v(*dono);
+            return enfileirar(v, std::move(dono), std::move(cb));
+        }
+        agrupamento.adicionar(registro, agora());
+        uint64_t id = ++proximoIdMensagem;
+        callbacksAgrupados.emplace_back(id, std::move(cb));
+        if (deveDescarregar()) flush();
+        return id;
+    }
+
+    // O lote aberto deve virar mensagem agora?
+    bool deveDescarregar() const {
+        if (agrupamento.vazio()) return false;
+        if (agrupamento.tamanho() >= limiarAgrupamento) return true;
+        if (agora() - agrupamento.inicio() >= atrasoAgrupamento) return true;
+        // Nagle: sem nada esperando ACK não há por que segurar
+        return modoAgrupamento == ModoAgrupamento::NAGLE &&
+               filaEnvio.empty() && pacotesEmTransito.vazia();
+    }
+
+    // Envia o pedido de encerramento (não espera o ACK)
+    bool enviarDisconnect() {
+        Header h = prevHdr;
+        h.seq = nextSeq++;
+        h.ack = lastCentralSeq;
+        h.wnd = 0; // zera a janela
+        h.sf = (h.sf & ~0x1F) | FLAG_C | FLAG_R | FLAG_ACK; // Flags CONNECT, REVIVE e ACK juntas sinalizam encerramento
+
+        uint8_t buf[HDR_SIZE];
+        serialize(h, buf);
+        mostrarHeader(h, EventoTrace::ENVIADO_DISCONNECT);
+        return enviarDireto(buf, nullptr, 0); //envia o DISCONNECT
+    }
+
+    // Grava no cache o estado de revive da sessão atual
+    void gravarSessao() {
+        if (!cacheSessoes) return;
+        SessaoSalva s;
+        s.endereco = srv.sin_addr;
+        s.hdr = lastHdr;
+        s.proximoSeq = nextSeq;
+        s.ultimoSeqCentral = lastCentralSeq;
+        s.janela = window_size;
+        s.gravadaEm = chrono::system_clock::now();
+        cacheSessoes->gravar(hostServidor.c_str(), portaServidor, s);
+    }
+
+public:
+    explicit UDPPeripheral(const PerfilSessao& perfil = PerfilSessao{})
+        : fd(-1), trace(perfil.registrosTrace), recepcao(perfil.slotsRecepcao) {
+        pacotesEmTransito.garantirCapacidade(FilaRetransmissao::capacidadePara(window_size));
+        temporizadores.reservar(1);
+    }
+    ~UDPPeripheral() {
+        if (registroMetricas) registroMetricas->remover(&metricas);
+        if (fd >= 0 && socketProprio) close(fd);
+    }
+
+    // Inicializa o socket UDP e o reator de eventos. Com o cache de sessões
+    // ligado e uma sessão ainda viva para host:port, o endereço gravado
+    // dispensa o DNS e o estado dela fica pronto para conectarOuReviver().
+    bool init(const char* host, int port) {
+        fd = socket(AF_INET, SOCK_DGRAM, 0); // cria o socket UDP
+        if (fd < 0) return false; 
+
+        memset(&srv, 0, sizeof(srv));
+        srv.sin_family = AF_INET;
+        srv.sin_port = htons(port);
+        hostServidor = host;
+        portaServidor = (uint16_t)port;
+
+        SessaoSalva s;
+        if (cacheSessoes && cacheSessoes->buscar(host, portaServidor, s) &&
+            !s.expirada(chrono::system_clock::now())) {
+            srv.sin_addr = s.endereco;
+            lastHdr = prevHdr = s.hdr;
+            nextSeq = s.proximoSeq;
+            lastCentralSeq = s.ultimoSeqCentral;
+            atualizarJanela(s.janela);
+            hasPrev = sessaoDoCache = true;
+        } else {
+            hostent* he = gethostbyname(host); //resolve hostname
+            if (!he) return false;
+            memcpy(&srv.sin_addr, he->h_addr, he->h_length);
+        }
+        
+        // socket não bloqueante, configurado uma única vez; as esperas
+        // passam pelo reator (epoll + timerfd)
+        fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK);
+        loteRecepcao = make_unique<LoteRecepcao>();
+
+        return reator.abrir(fd);
+    }
+
+    // Usa "t" no lugar do socket e "r" no lugar do steady_clock (ex.: ponto
+    // de uma RedeVirtual e o relógio dela): as esperas passam a ser
+    // t.esperar(), que num relógio virtual só o avançam. Substitui init;
+    // sem fila de submissão nem GSO.
+    void usarTransporte(Transporte& t, const FonteTempo& r) {
+        transporte = &t;
+        relogio = &r;
+        temporizadores = RodaTemporizadores(r.agora());
+        temporizadores.reservar(1);
+    }
+
+    // realiza o handshake inicial com o servidor (3-way handshake)
+    bool connect() {
+        if (active) return true; //se já estiver conectado não fazer nada
+
+        // PASSO 1: Envia CONNECT
+        if (!enviarConnect(nextSeq)) return false;
+
+        // PASSO 2: Aguarda SETUP do servidor; respostas atrasadas de outra
+        // sessão (ex.: a recusa de um revive) são ignoradas
+        uint8_t rbuf[HDR_SIZE + DATA_MAX];
+        auto limite = agora() + chrono::milliseconds(TIMEOUT_ESPERA_MS);
+        Header r;
+        while (true) {
+            auto restante = chrono::duration_cast<chrono::milliseconds>(limite - agora()).count();
+            if (restante <= 0 || receberComPrazo(rbuf, sizeof(rbuf), (int)restante) < HDR_SIZE)
+                return false;
+            deserialize(r, rbuf);
+            if ((r.sf & FLAG_AR) && r.ack == seqConnect) break;
+            trace.evento(TRACE_EVENTO, EventoTrace::PACOTE_IGNORADO, r.seq, r.ack);
+        }
+        
+        // PASSO 3: Envia ACK final para completar 3-way handshake
+        return concluirConnect(r);
+    }
+
+    // Passos do handshake sem esperar a resposta, para quem lê o socket por
+    // conta própria (motor de sessões). enviarConnect manda o CONNECT com
+    // seq "isn" (um reenvio repete o isn); concluirConnect valida o SETUP
+    // que confirma esse CONNECT e manda o ACK final.
+    bool enviarConnect(uint32_t isn, bool reenvio = false) {
+        Header h;
+        h.seq = isn;
+        h.wnd = advertisedWindow(); //janela atual
+        h.sf |= FLAG_C; // flag connect
+
+        uint8_t buf[HDR_SIZE];
+        serialize(h, buf);
+        mostrarHeader(h, EventoTrace::ENVIADO_CONNECT);
+        tentativasConnect = reenvio ? tentativasConnect + 1 : 1;
+        seqConnect = isn;
+        nextSeq = isn + 1;
+        envioConnect = agora();
+        if (!reenvio) inicioConnect = envioConnect;
+        return enviarDireto(buf, nullptr, 0);
+    }
+
+    bool concluirConnect(const Header& r) {
+        mostrarHeader(r, EventoTrace::RECEBIDO_SETUP);
+
+        if (r.ack != seqConnect || !(r.sf & FLAG_AR)) return false; // verifica se ACK confirma nosso CONNECT
+
+        // o próprio handshake dá a primeira amostra de RTT (se não houve reenvio)
+        auto agora = this->agora();
+        if (tentativasConnect == 1) {
+            rtt.amostra(chrono::duration_cast<EstimadorRTT::us>(agora - envioConnect));
+            metricas.rtt.registrar(chrono::duration_cast<Histograma::us>(agora - envioConnect));
+        }
+        metricas.handshakes.somar();
+        metricas.latenciaHandshake.registrar(chrono::duration_cast<Histograma::us>(agora - inicioConnect));
+        
+        Header ack_final;
+        ack_final.seq = nextSeq++;
+        ack_final.ack = r.seq; // confirma o SETUP do servidor
+        ack_final.wnd = advertisedWindow();
+        ack_final.sf = FLAG_ACK; // apenas flag ACK
+
+        uint8_t ack_buf[HDR_SIZE];
+        serialize(ack_final, ack_buf);
+        mostrarHeader(ack_final, EventoTrace::ENVIADO_ACK_HANDSHAKE);
+        if (!enviarDireto(ack_buf, nullptr, 0))
+            return false;
+
+        //ajusta estado interno
+        prevHdr = r;
+        active = hasPrev = true; //sessão ativa e com histório para revive
+        sessaoRevivida = false;
+        falha = FalhaEntrega{};
+        lastCentralSeq = r.seq;
+        nextSeq = r.seq + 1;
+        atualizarJanela(r.wnd); //tamanho da janela do servidor
+        lastHdr = r;
+        gravarSessao();
+
+        return true; //3-way handshake bem sucedido
+    }
+    
+    
+    // Enfileira uma mensagem para envio assíncrono e já libera o que couber
+    // na janela. cb(id, ok) é chamado quando o último fragmento for confirmado
+    // pelo ACK cumulativo (ok = true) ou quando a entrega falhar (ok = false).
+    // A string passa a ser do cliente (movida, sem cópia do conteúdo).
+    // Retorna o id da mensagem, ou 0 se a sessão não estiver ativa ou se a
+    // mensagem passar de MAX_MENSAGEM (limite do fo).
+    uint64_t submit(string msg, CallbackEnvio cb) {
+        if (modoAgrupamento != ModoAgrupamento::DESLIGADO) return agrupar(msg, std::move(cb));
+        auto dono = make_shared<const string>(std::move(msg));
+        string_view v(*dono);
+        return enfileirar(v, std::move(dono), std::move(cb));
+    }
+
+    // Versão sem cópia nem posse: os fragmentos saem (e são reenviados) direto
+    // da memória do chamador, que precisa continuar válida até cb ser chamado
+    uint64_t submitView(string_view msg, CallbackEnvio cb) {
+        if (modoAgrupamento != ModoAgrupamento::DESLIGADO) return agrupar(msg, std::move(cb));
+        return enfileirar(msg, nullptr, std::move(cb));
+    }
+
+    // Mesma coisa, mas o resultado vem por um std::future
+    future<bool> submit(string msg) {
+        auto prom = make_shared<promise<bool>>();
+        future<bool> fut = prom->get_future();
+        submit(std::move(msg), [prom](uint64_t, bool ok) { prom->set_value(ok); });
+        return fut;
+    }
+
+private:
+    uint64_t enfileirar(string_view dados, shared_ptr<const string> dono, CallbackEnvio cb) {
+        if (!active || dados.size() > MAX_MENSAGEM) return recusar(cb);
+        MensagemPendente m;
+        m.id = ++proximoIdMensagem;
+        m.dados = dados;
+        m.dono = std::move(dono);
+        m.inicio = agora();
+        m.cb = std::move(cb);
+        filaEnvio.push_back(std::move(m));
+        uint64_t id = filaEnvio.back().id;
+        bombear();
+        return id;
+    }
+
+public:
+
+    // Uma volta do laço de eventos: retransmite o que venceu, aplica os ACKs
+    // que chegaram, libera novos fragmentos e dorme no epoll até timeoutMs
+    // (-1 = até o próximo evento). Quem usa submit() deve chamar isto.
+    void processarEventos(int timeoutMs) {
+        passo();
+        if (!active || (filaEnvio.empty() && pacotesEmTransito.vazia() && agrupamento.vazio())) return;
+        if (esperarEventos(timeoutMs)) passo();
+    }
+
+    // Descritor legível quando esta sessão tem trabalho (datagrama ou prazo
+    // vencido): várias sessões podem ser esperadas num epoll só, chamando
+    // aguardarDatagramas(0) na que ficar pronta
+    int descritorEventos() const { return reator.descritor(); }
+
+    // Como processarEventos, mas também espera (até timeoutMs) sem nada a
+    // enviar: para receber mensagens da central com setReceptor
+    void aguardarDatagramas(int timeoutMs) {
+        passo();
+        if (!active) return;
+        if (esperarEventos(timeoutMs)) passo();
+    }
+
+    // Roda o laço até todas as mensagens enfileiradas serem confirmadas.
+    // Retorna false se alguma falhou desde a chamada anterior (inclusive as
+    // recusadas na hora pelo submit) ou se a janela ficou parada (nada em
+    // trânsito) por mais de TIMEOUT_ESPERA_MS.
+    bool aguardarEnvios() {
+        flush(); // esperar pelo lote aberto não faz sentido
+        uint64_t ultimo = proximoIdMensagem;
+        auto inicioParado = agora();
+        while (active && !filaEnvio.empty() && filaEnvio.front().id <= ultimo) {
+            int espera = -1;
+            if (pacotesEmTransito.vazia()) { // janela fechada pela central
+                auto parado = chrono::duration_cast<chrono::milliseconds>(agora() - inicioParado).count();
+                if (parado >= TIMEOUT_ESPERA_MS) {
+                    trace.evento(TRACE_EVENTO, EventoTrace::TIMEOUT_ACK);
+                    falharMensagens();
+                    falhasRelatadas = falhasMensagens;
+                    return false;
+                }
+                espera = TIMEOUT_ESPERA_MS - (int)parado;
+            } else {
+                inicioParado = agora();
+            }
+            processarEventos(espera);
+        }
+        if (!active) falharMensagens();
+        bool ok = falhasMensagens == falhasRelatadas;
+        falhasRelatadas = falhasMensagens;
+        return ok;
+    }
+
+// Envia mensagem, fragmentando se necessário e aguardando ACK. É um
+// invólucro bloqueante de submitView(): como só retorna depois da conclusão,
+// a mensagem é enviada da memória do chamador, sem cópia.
+bool sendData(string_view msg) {
+    if (!active) return false; //verifica se a sessão está ativa
+
+    bool concluida = false, entregue = false;
+    submitView(msg, [&](uint64_t, bool ok) { concluida = true; entregue = ok; });
+    aguardarEnvios();
+    return concluida && entregue;
+}
+
+    // Encerra a sessão (DISCONNECT)
+    bool disconnect() {
+        if (!active) return false; //se não estiver ativo da erro
+        uint32_t seqDisconnect = nextSeq;
+        if (!enviarDisconnect()) return false;
+
+        // Aguarda o ACK de desconexão (até 3 esperas de TIMEOUT_ESPERA_MS);
+        // ACKs atrasados dos dados que chegarem antes não contam
+        auto limite = agora() + chrono::milliseconds(3 * TIMEOUT_ESPERA_MS);
+        while (true) {
+            uint8_t rbuf[HDR_SIZE + DATA_MAX];
+            auto restante = chrono::duration_cast<chrono::milliseconds>(limite - agora()).count();
+            if (restante <= 0) break;
+
+            if (receberComPrazo(rbuf, sizeof(rbuf), (int)restante) >= HDR_SIZE) { //se recebeu um pacote
+                Header r;
+                deserialize(r, rbuf);
+                
+                // Ignora pacotes com flags = 0
+                if ((r.sf & 0x1F) == 0) {
+                    continue;
+                }
+                
+                mostrarHeader(r, EventoTrace::RECEBIDO_ACK_DISCONNECT);
+
+                if ((r.sf & FLAG_ACK) && r.ack == seqDisconnect) { //ACK do DISCONNECT (não um atrasado dos dados)
+                    active = false; //desativa a sessão
+                    gravarSessao(); //o próximo processo pode fazer revive
+
+                    return true;
+                }
+            }
+        }
+        return false; //ACK não foi recebido no prazo
+    }
+
+    // ---- Sessão num socket do motor de sessões (slow_motor.h) ----
+
+    // Usa o socket de outro dono (não fecha nem lê dele): os pacotes saem
+    // por ele para "destino" e os datagramas desta sessão, já separados pelo
+    // SID, chegam por entregarDatagrama. Substitui init.
+    void vincular(int fdCompartilhado, const sockaddr_in& destino) {
+        fd = fdCompartilhado;
+        srv = destino;
+        socketProprio = false;
+    }
+
+    void entregarDatagrama(const uint8_t* buf, size_t n) { tratarDatagrama(buf, n); }
+
+    // Retransmissões vencidas, remontagens paradas, lote de agrupamento e
+    // fragmentos que a janela liberou (uma volta do laço, sem esperar)
+    void processarPendencias() { passo(); }
+
+    // Próximo instante com trabalho para processarPendencias: prazo de
+    // retransmissão, fim do lote de agrupamento ou crédito da cadência
+    optional<chrono::steady_clock::time_point> proximoPrazo() const {
+        optional<chrono::steady_clock::time_point> prazo = temporizadores.proximoPrazo();
+        if (!agrupamento.vazio()) {
+            auto fimLote = agrupamento.inicio() + atrasoAgrupamento;
+            if (!prazo || fimLote < *prazo) prazo = fimLote;
+        }
+        if (cadenciaSegurando) {
+            auto liberacao = cadencia.proximaLiberacao();
+            if (!prazo || liberacao < *prazo) prazo = liberacao;
+        }
+        return prazo;
+    }
+
+    // DISCONNECT sem esperar o ACK; a sessão fica inativa e guardada para revive
+    bool desconectarSemEsperar() {
+        if (!active) return false;
+        bool ok = enviarDisconnect();
+        active = false;
+        return ok;
+    }
+
+    // Revive (zero-way handshake) após desconexão. O R+ACK leva o primeiro
+    // fragmento de msg e o resto da janela sai logo atrás, sem esperar a
+    // resposta; todos ficam na fila de retransmissão como dados comuns. A
+    // resposta é esperada por até TIMEOUT_ESPERA_MS. Se a central recusar,
+    // a sessão é reaberta com connect() e msg vai de novo, inteira. Retorna
+    // true com a sessão aberta e msg confirmada (a memória de msg precisa
+    // valer até lá); foiRevivida() diz se o revive foi aceito.
+    bool zeroWay(string_view msg) {
+        //precisa de uma sessão guardada e de nada pendente nesta
+        if (!hasPrev || !filaEnvio.empty() || !pacotesEmTransito.vazia()) return false;
+
+        // estado da sessão guardada; nada da anterior continua em trânsito
+        prevHdr = lastHdr;
+        esquecerEmTransito();
+        if (window_size == 0) atualizarJanela(DATA_MAX); // o R+ACK sempre sai
+        active = revivendo = true;
+        reviveRecusado = sessaoRevivida = false;
+        falha = FalhaEntrega{};
+        seqRevive = nextSeq;
+        envioRevive = agora();
+
+        bool concluida = msg.empty(), entregue = msg.empty();
+        if (msg.empty()) enviarFragmento(nullptr, 0, 0, 0, false); // só o R+ACK
+        else enfileirar(msg, nullptr, [&](uint64_t, bool ok) { concluida = true; entregue = ok; });
+        despacharLote();
+
+        //espera a resposta; ACKs atrasados de antes do revive são ignorados
+        auto limite = envioRevive + chrono::milliseconds(TIMEOUT_ESPERA_MS);
+        while (true) {
+            passo();
+            if (!revivendo || !active) break;
+            auto restante = chrono::duration_cast<chrono::milliseconds>(limite - agora()).count();
+            if (restante <= 0) break;
+            esperarEventos((int)restante);
+        }
+
+        if (revivendo || reviveRecusado) metricas.revivesRecusados.somar();
+        if (revivendo) { //sem resposta no prazo
+            revivendo = false;
+            cerr << "Revive falhou: a central não respondeu." << endl;
+            if (active) {
+                esquecerEmTransito();
+                active = false;
+                falharMensagens();
+            }
+            return false;
+        }
+        if (reviveRecusado) { //sessão desconhecida ou vencida na central: handshake
+            cerr << "Revive recusado: reconectando com handshake." << endl;
+            esquecerEmTransito();
+            rebobinarMensagens();
+            active = false;
+            if (!connect()) {
+                falharMensagens();
+                return false;
+            }
+            bombear();
+        } else if (active) {
+            gravarSessao();
+        }
+
+        if (!msg.empty()) aguardarEnvios();
+        return active && concluida && entregue;
+    }
+
+    // Armazena último header para possível revive futuro (e no cache em
+    // disco, se ligado)
+    void storeSession() {
+        if (active) {
+            lastHdr = prevHdr;
+            hasPrev = true;
+            gravarSessao();
+        }
+    }
+
+    // Liga o cache de sessões em "caminho" (antes de init). Falha se o
+    // arquivo não puder ser aberto ou mapeado.
+    bool setCacheSessoes(const char* caminho) {
+        auto c = make_unique<CacheSessoes>();
+        if (!c->abrir(caminho)) return false;
+        cacheSessoes = std::move(c);
+        return true;
+    }
+
+    // Abre a sessão tentando primeiro o revive da sessão achada no cache por
+    // init; se não houver uma viva ou se a central recusar, faz o handshake
+    bool conectarOuReviver() {
+        if (active) return true;
+        if (sessaoDoCache) {
+            sessaoDoCache = false;
+            bool aberta = zeroWay(string_view()); // recusado, já faz o handshake
+            revividaDoCache = aberta && sessaoRevivida;
+            if (revividaDoCache) return true;
+            cacheSessoes->apagar(hostServidor.c_str(), portaServidor);
+            if (aberta) return true;
+        }
+        return connect();
+    }
+
+    // A sessão atual veio de um revive do cache (e não de um handshake)?
+    bool reviveuDoCache() const { return active && revividaDoCache; }
+
+    // A sessão atual foi aberta por um revive aceito (e não por handshake)?
+    bool foiRevivida() const { return active && sessaoRevivida; }
+
+    bool canRevive() const { return hasPrev; }
+    const FalhaEntrega& ultimaFalha() const { return falha; }
+    const EstimadorRTT& estimadorRTT() const { return rtt; }
+    const EstatisticasIO& estatisticasIO() const { return io; }
+    uint32_t bytesEmTransito() const { return bytesInFlight; }
+
+    // Mensagens que a central envia: remontadas num pool de "slots" fragmentos
+    // (a janela anunciada é o espaço livre nele) e entregues a cb sem cópia.
+    // Remontagens paradas por mais que "prazo" são descartadas.
+    void setReceptor(CallbackRecepcao cb) { recepcao.setCallback(std::move(cb)); }
+    void setBuffersRecepcao(size_t slots) { recepcao.reservar(slots); }
+    void setPrazoRemontagem(chrono::milliseconds prazo) { recepcao.setPrazo(prazo); }
+    const EstatisticasRecepcao& estatisticasRecepcao() const { return recepcao.estatisticas(); }
+
+    // Agrupamento de mensagens pequenas (desligado por padrão). submit e
+    // submitView passam a juntar registros enquadrados (slow_agrupamento.h)
+    // numa mensagem só, descarregada ao atingir "limiar" bytes, "atraso"
+    // depois do primeiro registro, num flush() ou, no NAGLE, quando nada
+    // estiver esperando ACK. Cada registro mantém seu id e callback. A
+    // central precisa desagrupar (--split).
+    void setAgrupamento(ModoAgrupamento modo,
+                        chrono::microseconds atraso = chrono::microseconds(2000),
+                        size_t limiar = DATA_MAX) {
+        flush();
+        modoAgrupamento = modo;
+        atrasoAgrupamento = atraso;
+        limiarAgrupamento = min(max<size_t>(limiar, 1), MAX_MENSAGEM);
+    }
+    ModoAgrupamento agrupamentoAtual() const { return modoAgrupamento; }
+
+    // Fila de submissão para outras threads (slow_submissao.h), depois de
+    // init. O estado da sessão continua sendo de uma thread só (a de
+    // protocolo), que roda executarFila() ou processarEventos(): qualquer
+    // outra usa submitConcorrente. Até "capacidade" mensagens esperam na
+    // fila; cheia, vale "politica".
+    bool setFilaSubmissao(size_t capacidade, PoliticaFila politica = PoliticaFila::BLOQUEAR) {
+        if (filaSubmissao || !socketProprio || transporte) return false;
+        auto f = make_unique<FilaSubmissao<CallbackEnvio>>(capacidade, politica);
+        if (!f->aberta() || !reator.registrar(f->descritor(), Reator::EV_FILA)) return false;
+        filaSubmissao = std::move(f);
+        return true;
+    }
+
+    // Qualquer thread: entrega a mensagem à thread de protocolo, onde cb é
+    // chamado. false com a fila fechada ou cheia; com FALHAR, "msg" continua
+    // com o chamador, com DESCARTAR, cb(0, false) já foi chamado.
+    bool submitConcorrente(string&& msg, CallbackEnvio cb = nullptr) {
+        return filaSubmissao && filaSubmissao->submeter(std::move(msg), cb);
+    }
+
+    // Thread de protocolo: atende a fila até fecharFilaSubmissao() e até
+    // todas as mensagens aceitas terminarem, com sucesso ou erro
+    void executarFila() {
+        if (!filaSubmissao) return;
+        while (true) {
+            passo();
+            if (filaSubmissao->encerrada() && ocioso()) return;
+            esperarEventos(-1);
+        }
+    }
+
+    // Qualquer thread: recusa novos submits e solta os produtores bloqueados
+    void fecharFilaSubmissao() {
+        if (filaSubmissao) filaSubmissao->fechar();
+    }
+    EstatisticasFila estatisticasFila() const {
+        return filaSubmissao ? filaSubmissao->estatisticas() : EstatisticasFila{};
+    }
+
+    // Métricas desta sessão, atualizadas sem trava pela thread dela. Com um
+    // registro, entram nos totais (e no retrato por sessão com "rotulo") até
+    // a sessão ser destruída; a exportação fica com ExportadorMetricas.
+    const MetricasSessao& metricasSessao() const { return metricas; }
+    void setRegistroMetricas(RegistroMetricas& r, string rotulo) {
+        if (registroMetricas) registroMetricas->remover(&metricas);
+        registroMetricas = &r;
+        r.adicionar(&metricas, std::move(rotulo));
+    }
+
+    // Envia já o lote aberto, se houver
+    void flush() {
+        if (agrupamento.vazio()) return;
+        auto dono = make_shared<const string>(agrupamento.retirar());
+        string_view v(*dono);
+        auto cbs = std::move(callbacksAgrupados);
+        callbacksAgrupados.clear();
+        enfileirar(v, std::move(dono), [cbs = std::move(cbs)](uint64_t, bool ok) {
+            for (auto& [id, cb] : cbs)
+                if (cb) cb(id, ok);
+        });
+    }
+
+    // Liga/desliga o trace de cada pacote (desligado em medições). A saída
+    // só aparece com um DrenoTrace consumindo anelTrace().
+    void setVerboso(bool v) { trace.setNivel(v ? TRACE_PAYLOAD : TRACE_DESLIGADO); }
+    void setNivelTrace(NivelTrace n) { trace.setNivel(n); }
+    AnelTrace& anelTrace() { return trace; }
+    // Escolhe entre sendmmsg/recvmmsg em lote e sendto/recvfrom por pacote
+    void setLoteIO(bool v) { despacharLote(); loteIO = v; }
+    // Liga o envio com GSO (UDP_SEGMENT) no caminho em lote. Retorna false, e
+    // fica no envio por pacote, se o kernel não suportar a opção.
+    bool setGSO(bool v) {
+        despacharLote();
+        int seg = 0;
+        socklen_t len = sizeof(seg);
+        if (v && (transporte || getsockopt(fd, SOL_UDP, UDP_SEGMENT, &seg, &len) < 0)) v = false;
+        loteEnvio.setGSO(v);
+        return v;
+    }
+    bool usandoGSO() const { return loteIO && loteEnvio.usandoGSO(); }
+    // Troca o controle de congestionamento desta sessão (NewReno por padrão)
+    void setControleCongestionamento(AlgoritmoCongestionamento a) { cc = criarControle(a); }
+    void setControleCongestionamento(unique_ptr<ControleCongestionamento> c) { cc = std::move(c); }
+    const ControleCongestionamento& controleCongestionamento() const { return *cc; }
+    // Cadência dos fragmentos novos desta sessão (ConfigCadencia; as
+    // retransmissões não esperam por ela)
+    void setCadencia(const ConfigCadencia& c) { cadencia.configurar(c); }
+    const Cadenciador& cadenciador() const { return cadencia; }
+    // ACKs duplicados que disparam a retransmissão rápida (0 desliga)
+    void setLimiarAcksDuplicados(uint32_t n) {
+        limiarAcksDuplicados = n;
+        if (n == 0) { sairDaRecuperacao(); acksDuplicados = 0; }
+    }
+    bool isActive() const { return active; }
+    // Nada a enviar nem esperando ACK (nem lote de agrupamento aberto)
+    bool ocioso() const { return filaEnvio.empty() && pacotesEmTransito.vazia() && agrupamento.vazio(); }
+};
+
+#endif // SLOW_PERIPHERAL_H
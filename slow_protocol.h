@@ -0,0 +1,235 @@
+/*
+ * slow_protocol.h
+ * Autores:
+ *  Enzo Tonon Morente - 14568476
+ *  João Pedro Alves Notari Godoy - 14582076
+ *  Letícia Barbosa Neves - 14582076
+ * Descrição: Definições do cabeçalho do protocolo SLOW compartilhadas entre o
+ *            periférico (slow_peripheral) e o emulador da central (slow_central)
+ */
+
+#ifndef SLOW_PROTOCOL_H
+#define SLOW_PROTOCOL_H
+
+#include <iostream>
+#include <iomanip>
+#include <cstring>
+#include <cstdint>
+#include <cstddef>
+#include <string>
+
+// Tamanho do cabeçalho em bytes e tamanho máximo de dados por pacote
+static const int HDR_SIZE = 32;
+static const int DATA_MAX = 1440;
+
+// fo tem 8 bits: uma mensagem tem no máximo 256 fragmentos (fo 0..255)
+static const size_t MAX_FRAGMENTOS = 256;
+static const size_t MAX_MENSAGEM = MAX_FRAGMENTOS * DATA_MAX;
+
+// Flags do protocolo SLOW (bit flags em h.sf)
+static const uint32_t FLAG_C   = 1 << 4;  // Connect / Disconnect
+static const uint32_t FLAG_R   = 1 << 3;  // Revive
+static const uint32_t FLAG_ACK = 1 << 2;  // Acknowledgment
+static const uint32_t FLAG_AR  = 1 << 1;  // Ack de Revive / Setup
+static const uint32_t FLAG_MB  = 1 << 0;  // More Bit (fragmentação)
+
+// Máscara das flags e campo STTL (27 bits superiores de h.sf)
+static const uint32_t FLAGS_MASK = 0x1F;
+static const uint32_t STTL_MASK  = 0x07FFFFFF;
+
+// SID (Session ID): identificador único de sessão, 16 bytes
+struct SID {
+    uint8_t b[16];
+    // Retorna SID "nulo" (todos zeros)
+    static SID nil() {
+        SID s{};
+        memset(s.b, 0, 16);
+        return s;
+    }
+    // Compara igualdade de 16 bytes (duas palavras de 64 bits)
+    bool isEqual(const SID& o) const {
+        uint64_t a0, a1, b0, b1;
+        memcpy(&a0, b, 8);   memcpy(&a1, b + 8, 8);
+        memcpy(&b0, o.b, 8); memcpy(&b1, o.b + 8, 8);
+        return ((a0 ^ b0) | (a1 ^ b1)) == 0;
+    }
+    bool operator==(const SID& o) const { return isEqual(o); }
+};
+
+// Hash de SID para tabelas (os bytes já são aleatórios, basta combiná-los)
+struct SIDHash {
+    size_t operator()(const SID& s) const {
+        uint64_t a, b;
+        memcpy(&a, s.b, 8);
+        memcpy(&b, s.b + 8, 8);
+        return static_cast<size_t>(a ^ (b * 0x9E3779B97F4A7C15ULL));
+    }
+};
+
+// Estrutura de cabeçalho de controle do protocolo SLOW (flags em h.sf)
+struct Header {
+    SID     sid;    // Session ID
+    uint32_t sf;    // Flags e campo de controle
+    uint32_t seq;   // Número de sequência (enviado)
+    uint32_t ack;   // Número do ack
+    uint16_t wnd;   // Tamanho da janela
+    uint8_t  fid;   // Fragment ID
+    uint8_t  fo;    // Fragment Offset
+
+    // Construtor inicializa campos padrão
+    Header(): sid(SID::nil()), sf(0), seq(0), ack(0), wnd(0), fid(0), fo(0) {}
+
+    uint32_t flags() const { return sf & FLAGS_MASK; }
+    uint32_t sttl()  const { return (sf >> 5) & STTL_MASK; }
+};
+
+// Comparação de números de sequência de 32 bits com wraparound (aritmética
+// serial, RFC 1982): a vem antes de b se a distância a-b for negativa
+inline bool seqMenor(uint32_t a, uint32_t b)      { return (int32_t)(a - b) < 0; }
+inline bool seqMenorIgual(uint32_t a, uint32_t b) { return (int32_t)(a - b) <= 0; }
+
+// Converte inteiro de 32 bits para 4 bytes
+inline void pack32(uint32_t v, uint8_t* p) {
+    for (int i = 0; i < 4; ++i)
+        p[i] = (v >> (i * 8)) & 0xFF;
+}
+
+// Converte inteiro de 16 bits para 2 bytes
+inline void pack16(uint16_t v, uint8_t* p) {
+    for (int i = 0; i < 2; ++i)
+        p[i] = (v >> (i * 8)) & 0xFF;
+}
+
+// Reconstrói inteiro de 32 bits a partir de 4 bytes
+inline uint32_t unpack32(const uint8_t* p) {
+    uint32_t v = 0;
+    for (int i = 0; i < 4; ++i)
+        v |= (uint32_t)p[i] << (i * 8);
+    return v;
+}
+
+// Reconstrói inteiro de 16 bits a partir de 2 bytes
+inline uint16_t unpack16(const uint8_t* p) {
+    uint16_t v = 0;
+    for (int i = 0; i < 2; ++i)
+        v |= (uint16_t)p[i] << (i * 8);
+    return v;
+}
+
+// Posição de cada campo no cabeçalho serializado (little-endian)
+static constexpr size_t OFF_SID = 0;
+static constexpr size_t OFF_SF  = 16;
+static constexpr size_t OFF_SEQ = 20;
+static constexpr size_t OFF_ACK = 24;
+static constexpr size_t OFF_WND = 28;
+static constexpr size_t OFF_FID = 30;
+static constexpr size_t OFF_FO  = 31;
+static_assert(OFF_SF == OFF_SID + sizeof(SID::b) && OFF_SEQ == OFF_SF + 4 &&
+              OFF_ACK == OFF_SEQ + 4 && OFF_WND == OFF_ACK + 4 &&
+              OFF_FID == OFF_WND + 2 && OFF_FO == OFF_FID + 1 && OFF_FO + 1 == HDR_SIZE,
+              "campos do cabeçalho SLOW devem ser contíguos e somar 32 bytes");
+
+// Versões de referência, byte a byte (o formato do fio é definido por elas)
+inline void serializeBytes(const Header& h, uint8_t* buf) {
+    memcpy(buf,          h.sid.b,   16);     // SID
+    pack32(h.sf,         buf + 16);           // Flags
+    pack32(h.seq,        buf + 20);           // Sequence number
+    pack32(h.ack,        buf + 24);           // Acknowledgment number
+    pack16(h.wnd,        buf + 28);           // Window size
+    buf[30] = h.fid;                         // Fragment ID
+    buf[31] = h.fo;                          // Fragment offset
+}
+
+inline void deserializeBytes(Header& h, const uint8_t* buf) {
+    memcpy(h.sid.b,      buf,           16);
+    h.sf  = unpack32(buf + 16);
+    h.seq = unpack32(buf + 20);
+    h.ack = unpack32(buf + 24);
+    h.wnd = unpack16(buf + 28);
+    h.fid = buf[30];
+    h.fo  = buf[31];
+}
+
+// Leitura/escrita little-endian de largura fixa: um load/store por campo
+// (memcpy de tamanho constante), com troca de bytes só em máquinas big-endian
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+inline uint32_t paraLE32(uint32_t v) { return __builtin_bswap32(v); }
+inline uint16_t paraLE16(uint16_t v) { return __builtin_bswap16(v); }
+#else
+inline uint32_t paraLE32(uint32_t v) { return v; }
+inline uint16_t paraLE16(uint16_t v) { return v; }
+#endif
+
+inline void armazenar32(uint32_t v, uint8_t* p) { v = paraLE32(v); memcpy(p, &v, 4); }
+inline void armazenar16(uint16_t v, uint8_t* p) { v = paraLE16(v); memcpy(p, &v, 2); }
+inline uint32_t carregar32(const uint8_t* p) { uint32_t v; memcpy(&v, p, 4); return paraLE32(v); }
+inline uint16_t carregar16(const uint8_t* p) { uint16_t v; memcpy(&v, p, 2); return paraLE16(v); }
+
+// escreve todos os campos no buffer de 32 bytes
+inline void serialize(const Header& h, uint8_t* buf) {
+    memcpy(buf + OFF_SID, h.sid.b, 16);
+    armazenar32(h.sf,  buf + OFF_SF);
+    armazenar32(h.seq, buf + OFF_SEQ);
+    armazenar32(h.ack, buf + OFF_ACK);
+    armazenar16(h.wnd, buf + OFF_WND);
+    buf[OFF_FID] = h.fid;
+    buf[OFF_FO]  = h.fo;
+}
+
+// reconstrói um Header a partir do buffer recebido.
+inline void deserialize(Header& h, const uint8_t* buf) {
+    memcpy(h.sid.b, buf + OFF_SID, 16);
+    h.sf  = carregar32(buf + OFF_SF);
+    h.seq = carregar32(buf + OFF_SEQ);
+    h.ack = carregar32(buf + OFF_ACK);
+    h.wnd = carregar16(buf + OFF_WND);
+    h.fid = buf[OFF_FID];
+    h.fo  = buf[OFF_FO];
+}
+
+// Flags e STTL direto do buffer, sem desserializar o resto
+inline uint32_t flagsDe(const uint8_t* buf) { return carregar32(buf + OFF_SF) & FLAGS_MASK; }
+inline uint32_t sttlDe(const uint8_t* buf)  { return (carregar32(buf + OFF_SF) >> 5) & STTL_MASK; }
+
+// O que muda entre os fragmentos de uma mesma rajada
+struct VariacaoHeader {
+    uint32_t seq;
+    uint8_t  flags;
+    uint8_t  fo;
+};
+
+// Serializa n cabeçalhos iguais a "modelo" exceto por seq, flags e fo, em
+// saida[0..n*HDR_SIZE). O modelo é serializado uma vez; cada cabeçalho é uma
+// cópia de 32 bytes com três campos sobrescritos.
+inline void serializeLote(const Header& modelo, const VariacaoHeader* v, size_t n, uint8_t* saida) {
+    uint8_t base[HDR_SIZE];
+    serialize(modelo, base);
+    uint32_t sfBase = modelo.sf & ~FLAGS_MASK;
+    for (size_t i = 0; i < n; i++, saida += HDR_SIZE) {
+        memcpy(saida, base, HDR_SIZE);
+        armazenar32(sfBase | (v[i].flags & FLAGS_MASK), saida + OFF_SF);
+        armazenar32(v[i].seq, saida + OFF_SEQ);
+        saida[OFF_FO] = v[i].fo;
+    }
+}
+
+// Imprime Header (em cout, ou no stream dado)
+inline void printHeader(const Header& h, const std::string& label, std::ostream& cout = std::cout) {
+    using std::hex; using std::dec; using std::setw; using std::setfill;
+    cout << "---- " << label << " ----\n";
+    cout << "SID: ";
+    for (int i = 0; i < 16; i++)
+        cout << hex << setw(2) << setfill('0') << (int)h.sid.b[i];
+    cout << dec << "\n";
+    uint32_t flags = h.flags();
+    uint32_t sttl  = h.sttl();
+    cout << "Flags: 0x" << hex << flags << dec << " ("<<flags<<")\n";
+    cout << "STTL: "    << sttl  << "\n";
+    cout << "SEQNUM: "  << h.seq  << "\n";
+    cout << "ACKNUM: "  << h.ack  << "\n";
+    cout << "WINDOW: "  << h.wnd  << "\n";
+    cout << "FID: "     << (int)h.fid << "\n";
+    cout << "FO: "      << (int)h.fo  << "\n\n";
+}
+
+#endif // SLOW_PROTOCOL_H
@@ -0,0 +1,212 @@
+/*
+ * slow_recepcao.h
+ * Autores:
+ *  Enzo Tonon Morente - 14568476
+ *  João Pedro Alves Notari Godoy - 14582076
+ *  Letícia Barbosa Neves - 14582076
+ * Descrição: Remontagem das mensagens que a central envia ao periférico.
+ *            Os fragmentos (fid/fo/MB) vão para slots de um pool reservado
+ *            no início, podem chegar fora de ordem ou repetidos, e a mensagem
+ *            completa é entregue sem cópia, como trechos dos slots
+ */
+
+#ifndef SLOW_RECEPCAO_H
+#define SLOW_RECEPCAO_H
+
+#include <vector>
+#include <chrono>
+#include <functional>
+#include <string>
+#include <string_view>
+#include <cstring>
+#include <cstdint>
+
+#include "slow_protocol.h"
+
+// Mensagem remontada, em ordem de fo. Os trechos apontam para os slots do
+// pool (ou para o datagrama, se veio num fragmento só) e só valem durante o
+// callback; quem precisar guardar copia.
+struct MensagemRecebida {
+    uint8_t fid = 0;
+    size_t tamanho = 0;                       // soma dos trechos
+    const std::string_view* partes = nullptr; // um trecho por fragmento
+    size_t nPartes = 0;
+
+    void copiarPara(char* destino) const {
+        for (size_t i = 0; i < nPartes; i++) {
+            memcpy(destino, partes[i].data(), partes[i].size());
+            destino += partes[i].size();
+        }
+    }
+    std::string str() const {
+        std::string s(tamanho, '\0');
+        copiarPara(&s[0]);
+        return s;
+    }
+};
+
+using CallbackRecepcao = std::function<void(const MensagemRecebida&)>;
+
+// Contadores da recepção
+struct EstatisticasRecepcao {
+    uint64_t fragmentos = 0;   // fragmentos com dados recebidos
+    uint64_t mensagens = 0;    // mensagens entregues
+    uint64_t bytes = 0;        // bytes de aplicação entregues
+    uint64_t duplicados = 0;   // fragmento já guardado
+    uint64_t semBuffer = 0;    // descartados com o pool cheio
+    uint64_t invalidos = 0;    // fo além do fim da mensagem: remontagem descartada
+    uint64_t expiradas = 0;    // mensagens incompletas descartadas pelo prazo
+};
+
+// Remontador com um pool fixo de slots de DATA_MAX bytes. Cada fid em
+// remontagem tem um bitmap dos fo já recebidos e o slot de cada um; o total
+// de fragmentos é conhecido quando chega o que tem MB = 0. A janela de
+// recepção é o espaço livre no pool.
+class Remontador {
+public:
+    using Relogio = std::chrono::steady_clock;
+
+    explicit Remontador(size_t slots = 64,
+                        std::chrono::milliseconds prazo = std::chrono::milliseconds(5000))
+        : prazoRemontagem(prazo) {
+        reservar(slots);
+    }
+
+    // Troca o tamanho do pool; descarta o que estiver em remontagem
+    void reservar(size_t slots) {
+        for (Parcial& p : parciais) p = Parcial{};
+        pool.assign(slots * DATA_MAX, 0);
+        tamanhos.assign(slots, 0);
+        livres.clear();
+        for (size_t i = slots; i > 0; i--) livres.push_back((uint32_t)(i - 1));
+        emRemontagem = 0;
+    }
+
+    void setCallback(CallbackRecepcao c) { cb = std::move(c); }
+    void setPrazo(std::chrono::milliseconds p) { prazoRemontagem = p; }
+    const EstatisticasRecepcao& estatisticas() const { return est; }
+    size_t slotsLivres() const { return livres.size(); }
+
+    // Bytes que ainda cabem no pool (janela de recepção anunciada)
+    uint32_t janelaLivre() const { return (uint32_t)(livres.size() * DATA_MAX); }
+
+    // Fragmento com dados recebido da central. Uma mensagem de um fragmento
+    // só é entregue direto do datagrama, sem passar pelo pool.
+    void receber(const Header& h, const uint8_t* dados, size_t len, Relogio::time_point agora = Relogio::now()) {
+        if (len > (size_t)DATA_MAX) len = DATA_MAX;
+        est.fragmentos++;
+        bool mais = h.flags() & FLAG_MB;
+        if (!mais && h.fo == 0) {
+            std::string_view v((const char*)dados, len);
+            entregar(h.fid, &v, 1, len);
+            return;
+        }
+
+        if (parciais.empty()) parciais.resize(256); // só na primeira mensagem fragmentada
+        Parcial& p = parciais[h.fid];
+        if (p.ativa && agora - p.ultimo > prazoRemontagem) {
+            descartar(p);  // fid reaproveitado depois de uma remontagem abandonada
+            est.expiradas++;
+        }
+        if (!p.ativa) {
+            p.ativa = true;
+            emRemontagem++;
+        }
+        p.ultimo = agora;
+
+        if (p.tem(h.fo)) { est.duplicados++; return; }
+        // o último fragmento fixa o total; nada pode vir depois dele
+        if ((p.total >= 0 && h.fo >= p.total) || (!mais && h.fo < p.maiorFo) ||
+            (mais && h.fo == MAX_FRAGMENTOS - 1)) {
+            est.invalidos++;
+            descartar(p);
+            return;
+        }
+        if (livres.empty()) { est.semBuffer++; return; }
+
+        uint32_t s = livres.back();
+        livres.pop_back();
+        memcpy(&pool[(size_t)s * DATA_MAX], dados, len);
+        tamanhos[s] = (uint16_t)len;
+        p.marcar(h.fo, s);
+        p.bytes += len;
+        if (!mais) p.total = h.fo + 1;
+        if (h.fo > p.maiorFo) p.maiorFo = h.fo;
+
+        if (p.total >= 0 && p.recebidos == p.total) {
+            for (int fo = 0; fo < p.total; fo++) {
+                uint32_t k = p.slot[fo];
+                partes[fo] = std::string_view((const char*)&pool[(size_t)k * DATA_MAX], tamanhos[k]);
+            }
+            entregar(h.fid, partes, (size_t)p.total, p.bytes);
+            descartar(p);
+        }
+    }
+
+    // Descarta as remontagens sem fragmento novo há mais que o prazo
+    // (varre no máximo a cada 100 ms)
+    void expirar(Relogio::time_point agora) {
+        if (emRemontagem == 0 || agora - ultimaVarredura < std::chrono::milliseconds(100)) return;
+        ultimaVarredura = agora;
+        for (Parcial& p : parciais) {
+            if (p.ativa && agora - p.ultimo > prazoRemontagem) {
+                descartar(p);
+                est.expiradas++;
+            }
+        }
+    }
+
+private:
+    // Estado de uma mensagem em remontagem (índice = fid)
+    struct Parcial {
+        bool ativa = false;
+        uint64_t bits[MAX_FRAGMENTOS / 64] = {};
+        uint32_t slot[MAX_FRAGMENTOS];
+        int total = -1;       // número de fragmentos, -1 até chegar o último
+        int maiorFo = -1;
+        int recebidos = 0;
+        size_t bytes = 0;
+        Relogio::time_point ultimo;
+
+        bool tem(uint8_t fo) const { return bits[fo / 64] >> (fo % 64) & 1; }
+        void marcar(uint8_t fo, uint32_t s) {
+            bits[fo / 64] |= 1ULL << (fo % 64);
+            slot[fo] = s;
+            recebidos++;
+        }
+    };
+
+    // Devolve os slots ao pool e libera o fid
+    void descartar(Parcial& p) {
+        for (int w = 0; w < (int)(MAX_FRAGMENTOS / 64); w++)
+            for (uint64_t b = p.bits[w]; b; b &= b - 1)
+                livres.push_back(p.slot[w * 64 + __builtin_ctzll(b)]);
+        p = Parcial{};
+        emRemontagem--;
+    }
+
+    void entregar(uint8_t fid, const std::string_view* v, size_t n, size_t tamanho) {
+        est.mensagens++;
+        est.bytes += tamanho;
+        if (!cb) return;
+        MensagemRecebida m;
+        m.fid = fid;
+        m.tamanho = tamanho;
+        m.partes = v;
+        m.nPartes = n;
+        cb(m);
+    }
+
+    std::chrono::milliseconds prazoRemontagem;
+    std::vector<Parcial> parciais;        // uma por fid (criadas quando preciso)
+    std::vector<uint8_t> pool;            // slots de DATA_MAX bytes
+    std::vector<uint16_t> tamanhos;       // bytes válidos em cada slot
+    std::vector<uint32_t> livres;         // pilha de slots livres
+    std::string_view partes[MAX_FRAGMENTOS];
+    size_t emRemontagem = 0;
+    Relogio::time_point ultimaVarredura;
+    CallbackRecepcao cb;
+    EstatisticasRecepcao est;
+};
+
+#endif // SLOW_RECEPCAO_H
@@ -0,0 +1,178 @@
+/*
+ * slow_sessao.h
+ * Autores:
+ *  Enzo Tonon Morente - 14568476
+ *  João Pedro Alves Notari Godoy - 14582076
+ *  Letícia Barbosa Neves - 14582076
+ * Descrição: Cache em disco das sessões do periférico, para que um processo
+ *            novo faça revive (zero-way) em vez do handshake de 3 vias.
+ *            Arquivo pequeno mapeado com mmap, uma entrada por servidor
+ *            (host e porta), cada uma com checksum próprio
+ */
+
+#ifndef SLOW_SESSAO_H
+#define SLOW_SESSAO_H
+
+#include <chrono>
+#include <cstring>
+#include <cstdint>
+#include <cstddef>
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+#include <netinet/in.h>
+
+#include "slow_protocol.h"
+
+// Estado necessário para o revive, como foi gravado
+struct SessaoSalva {
+    in_addr  endereco{};          // endereço já resolvido (dispensa o DNS)
+    Header   hdr;                 // último cabeçalho da central (SID, STTL)
+    uint32_t proximoSeq = 0;
+    uint32_t ultimoSeqCentral = 0;
+    uint32_t janela = 0;
+    std::chrono::system_clock::time_point gravadaEm;
+
+    // A central já esqueceu a sessão? (STTL em ms contado da gravação)
+    bool expirada(std::chrono::system_clock::time_point agora) const {
+        return agora - gravadaEm >= std::chrono::milliseconds(hdr.sttl());
+    }
+};
+
+// Arquivo: cabeçalho + ENTRADAS entradas de tamanho fixo. Escritas sob
+// flock exclusivo (vários processos podem usar o mesmo arquivo); uma entrada
+// com checksum errado (escrita interrompida, arquivo corrompido) é ignorada.
+class CacheSessoes {
+public:
+    static constexpr size_t ENTRADAS = 16;
+    static constexpr size_t MAX_HOST = 63;
+
+    CacheSessoes() = default;
+    ~CacheSessoes() {
+        if (mapa) munmap(mapa, sizeof(Arquivo));
+        if (fd >= 0) close(fd);
+    }
+    CacheSessoes(const CacheSessoes&) = delete;
+    CacheSessoes& operator=(const CacheSessoes&) = delete;
+
+    // Abre ou cria o arquivo; um arquivo de outro formato é reinicializado
+    bool abrir(const char* caminho) {
+        fd = open(caminho, O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+        if (fd < 0) return false;
+        Trava t(fd, LOCK_EX);
+        struct stat st;
+        if (fstat(fd, &st) < 0) return false;
+        bool novo = (size_t)st.st_size != sizeof(Arquivo);
+        if (novo && ftruncate(fd, sizeof(Arquivo)) < 0) return false;
+        void* p = mmap(nullptr, sizeof(Arquivo), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if (p == MAP_FAILED) return false;
+        mapa = static_cast<Arquivo*>(p);
+        if (novo || memcmp(mapa->assinatura, ASSINATURA, sizeof(ASSINATURA)) != 0) {
+            memset(mapa, 0, sizeof(Arquivo));
+            memcpy(mapa->assinatura, ASSINATURA, sizeof(ASSINATURA));
+        }
+        return true;
+    }
+
+    bool aberto() const { return mapa != nullptr; }
+
+    // Sessão gravada para host:porta, se houver uma íntegra
+    bool buscar(const char* host, uint16_t porta, SessaoSalva& s) const {
+        if (!mapa) return false;
+        Trava t(fd, LOCK_SH);
+        const Entrada* e = procurar(host, porta);
+        if (!e) return false;
+        s.endereco.s_addr = e->ip;
+        deserialize(s.hdr, e->hdr);
+        s.proximoSeq = e->proximoSeq;
+        s.ultimoSeqCentral = e->ultimoSeqCentral;
+        s.janela = e->janela;
+        s.gravadaEm = std::chrono::system_clock::time_point(std::chrono::milliseconds(e->gravadaEmMs));
+        return true;
+    }
+
+    // Grava (ou substitui) a sessão de host:porta. Sem espaço, reaproveita a
+    // entrada mais antiga. Hosts maiores que MAX_HOST não são guardados.
+    void gravar(const char* host, uint16_t porta, const SessaoSalva& s) {
+        if (!mapa || strlen(host) > MAX_HOST) return;
+        Trava t(fd, LOCK_EX);
+        Entrada* e = const_cast<Entrada*>(procurar(host, porta));
+        for (size_t i = 0; !e && i < ENTRADAS; i++)
+            if (!valida(mapa->entradas[i])) e = &mapa->entradas[i];
+        if (!e) {
+            e = &mapa->entradas[0];
+            for (Entrada& x : mapa->entradas)
+                if (x.gravadaEmMs < e->gravadaEmMs) e = &x;
+        }
+        Entrada n{};
+        strncpy(n.host, host, MAX_HOST);
+        n.porta = porta;
+        n.ip = s.endereco.s_addr;
+        serialize(s.hdr, n.hdr);
+        n.proximoSeq = s.proximoSeq;
+        n.ultimoSeqCentral = s.ultimoSeqCentral;
+        n.janela = s.janela;
+        n.gravadaEmMs = (uint64_t)std::chrono::duration_cast<std::chrono::milliseconds>(
+            s.gravadaEm.time_since_epoch()).count();
+        n.checksum = checksum(n);
+        *e = n;
+    }
+
+    // Esquece a sessão de host:porta (revive recusado)
+    void apagar(const char* host, uint16_t porta) {
+        if (!mapa) return;
+        Trava t(fd, LOCK_EX);
+        if (const Entrada* e = procurar(host, porta)) memset(const_cast<Entrada*>(e), 0, sizeof(Entrada));
+    }
+
+private:
+    static constexpr char ASSINATURA[8] = {'S', 'L', 'O', 'W', 'S', 'E', 'S', '1'};
+
+    struct Entrada {
+        char     host[MAX_HOST + 1];
+        uint16_t porta;
+        uint16_t reserva;
+        uint32_t ip;                // ordem de rede
+        uint8_t  hdr[HDR_SIZE];     // serializado
+        uint32_t proximoSeq, ultimoSeqCentral, janela, reserva2;
+        uint64_t gravadaEmMs;       // system_clock, ms desde a época
+        uint32_t checksum;          // FNV-1a dos bytes anteriores
+        uint32_t reserva3;
+    };
+    static_assert(sizeof(Entrada) == 136, "entrada do cache de sessões deve ter 136 bytes");
+
+    struct Arquivo {
+        char    assinatura[8];
+        Entrada entradas[ENTRADAS];
+    };
+
+    // flock pelo tempo de vida do objeto
+    struct Trava {
+        int fd;
+        Trava(int f, int modo): fd(f) { while (flock(fd, modo) < 0 && errno == EINTR) {} }
+        ~Trava() { flock(fd, LOCK_UN); }
+    };
+
+    static uint32_t checksum(const Entrada& e) {
+        const uint8_t* p = reinterpret_cast<const uint8_t*>(&e);
+        uint32_t h = 2166136261u;
+        for (size_t i = 0; i < offsetof(Entrada, checksum); i++) h = (h ^ p[i]) * 16777619u;
+        return h;
+    }
+    static bool valida(const Entrada& e) { return e.host[0] != '\0' && e.checksum == checksum(e); }
+
+    const Entrada* procurar(const char* host, uint16_t porta) const {
+        for (const Entrada& e : mapa->entradas)
+            if (valida(e) && e.porta == porta && strncmp(e.host, host, sizeof(e.host)) == 0)
+                return &e;
+        return nullptr;
+    }
+
+    int fd = -1;
+    Arquivo* mapa = nullptr;
+};
+
+#endif // SLOW_SESSAO_H
@@ -0,0 +1,173 @@
+/*
+ * slow_stream.h
+ * Autores:
+ *  Enzo Tonon Morente - 14568476
+ *  João Pedro Alves Notari Godoy - 14582076
+ *  Letícia Barbosa Neves - 14582076
+ * Descrição: Envio em fluxo de um arquivo ou pipe pelo periférico, sem montar
+ *            a entrada inteira na memória: o conteúdo é cortado em mensagens
+ *            consecutivas de até MAX_MENSAGEM bytes enviadas em pipeline
+ */
+
+#ifndef SLOW_STREAM_H
+#define SLOW_STREAM_H
+
+#include <memory>
+#include <vector>
+#include <chrono>
+#include <cstring>
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "slow_peripheral.h"
+
+// Resultado de um envio em fluxo
+struct ResultadoStream {
+    bool     ok = false;
+    uint64_t bytes = 0;       // bytes confirmados pela central
+    uint64_t mensagens = 0;   // mensagens confirmadas
+    double   segundos = 0;
+    double   mbps() const { return segundos > 0 ? bytes / segundos / 1e6 : 0; }
+};
+
+// Envia tudo o que vier de um arquivo ou do stdin ("-").
+// Arquivo regular (inclusive stdin redirecionado de um arquivo): mapeado com
+// mmap, e cada mensagem é um trecho do mapa entregue a submitView, então os
+// bytes vão do page cache para o socket sem cópia; as páginas já confirmadas
+// são devolvidas ao kernel. Pipe/terminal: lido com read() para "emVoo"
+// buffers de uma mensagem, reaproveitados em rodízio (as mensagens são
+// confirmadas na ordem do envio).
+class EnvioStream {
+public:
+    explicit EnvioStream(UDPPeripheral& c, size_t tamanhoMsg = MAX_MENSAGEM, size_t emVoo = 4)
+        : cliente(c), tamMsg(min(max<size_t>(tamanhoMsg, 1), MAX_MENSAGEM)),
+          emVoo(max<size_t>(emVoo, 1)) {}
+    ~EnvioStream() {
+        if (mapa) munmap(mapa, tamanhoMapa);
+        if (fd >= 0 && fd != STDIN_FILENO) close(fd);
+    }
+    EnvioStream(const EnvioStream&) = delete;
+    EnvioStream& operator=(const EnvioStream&) = delete;
+
+    // Abre a entrada; false (com errno) se não der para abrir ou mapear
+    bool abrir(const char* caminho) {
+        fd = strcmp(caminho, "-") == 0 ? STDIN_FILENO : open(caminho, O_RDONLY | O_CLOEXEC);
+        if (fd < 0) return false;
+        struct stat st;
+        if (fstat(fd, &st) < 0) return false;
+        if (S_ISREG(st.st_mode)) {
+            tamanhoMapa = (size_t)st.st_size;
+            if (tamanhoMapa > 0) {
+                void* p = mmap(nullptr, tamanhoMapa, PROT_READ, MAP_PRIVATE, fd, 0);
+                if (p == MAP_FAILED) return false;
+                mapa = static_cast<char*>(p);
+                madvise(mapa, tamanhoMapa, MADV_SEQUENTIAL);
+            }
+            mapeado = true;
+        } else {
+            for (size_t i = 0; i < emVoo; i++) buffers.emplace_back(new char[tamMsg]);
+        }
+        return true;
+    }
+
+    bool usandoMmap() const { return mapeado; }
+
+    // Envia até o fim da entrada, mantendo até "emVoo" mensagens na fila do
+    // cliente. Falha se uma mensagem falhar, se a leitura falhar ou se a
+    // janela ficar parada por TIMEOUT_ESPERA_MS.
+    ResultadoStream executar() {
+        ResultadoStream r;
+        auto inicio = chrono::steady_clock::now();
+        auto ultimoProgresso = inicio;
+        bool fim = false, falhou = false;
+        size_t pendentes = 0;
+        uint64_t enviadas = 0;
+
+        while (!falhou && cliente.isActive()) {
+            while (!fim && pendentes < emVoo) {
+                string_view trecho;
+                if (!proximoTrecho(enviadas, trecho)) { falhou = true; break; }
+                if (trecho.empty()) { fim = true; break; }
+                pendentes++;
+                enviadas++;
+                uint64_t id = cliente.submitView(trecho, [&, n = trecho.size()](uint64_t, bool ok) {
+                    pendentes--;
+                    if (!ok) { falhou = true; return; }
+                    r.mensagens++;
+                    r.bytes += n;
+                    ultimoProgresso = chrono::steady_clock::now();
+                    devolverPaginas(r.bytes);
+                });
+                if (id == 0) falhou = true; // sessão caiu: o callback já contou
+            }
+            if (falhou || (fim && pendentes == 0)) break;
+
+            int espera = -1;
+            if (cliente.bytesEmTransito() == 0) { // janela fechada pela central
+                auto parado = chrono::duration_cast<chrono::milliseconds>(
+                    chrono::steady_clock::now() - ultimoProgresso).count();
+                if (parado >= TIMEOUT_ESPERA_MS) { falhou = true; break; }
+                espera = TIMEOUT_ESPERA_MS - (int)parado;
+            }
+            cliente.processarEventos(espera);
+        }
+
+        // os callbacks apontam para esta pilha: espera (ou falha) o que restou
+        if (pendentes > 0) cliente.aguardarEnvios();
+        r.segundos = chrono::duration<double>(chrono::steady_clock::now() - inicio).count();
+        r.ok = !falhou && fim && pendentes == 0;
+        return r;
+    }
+
+private:
+    // Próximo trecho da entrada (vazio no fim). No pipe, o trecho "k" vai
+    // para o buffer k % emVoo, livre porque a mensagem k - emVoo já concluiu.
+    bool proximoTrecho(uint64_t k, string_view& trecho) {
+        if (mapeado) {
+            size_t n = min(tamMsg, tamanhoMapa - lido);
+            trecho = string_view(mapa + lido, n);
+            lido += n;
+            return true;
+        }
+        char* buf = buffers[k % emVoo].get();
+        size_t n = 0;
+        while (n < tamMsg) { // pipes entregam leituras parciais
+            ssize_t q = read(fd, buf + n, tamMsg - n);
+            if (q == 0) break;
+            if (q < 0) {
+                if (errno == EINTR) continue;
+                return false;
+            }
+            n += (size_t)q;
+        }
+        trecho = string_view(buf, n);
+        return true;
+    }
+
+    // Devolve ao kernel as páginas do mapa já confirmadas, em blocos grandes,
+    // para o RSS não crescer com o arquivo
+    void devolverPaginas(uint64_t confirmados) {
+        static const size_t BLOCO = 8u << 20;
+        if (!mapa || confirmados - devolvido < BLOCO) return;
+        size_t pagina = (size_t)sysconf(_SC_PAGESIZE);
+        size_t ate = (size_t)confirmados / pagina * pagina;
+        madvise(mapa + devolvido, ate - devolvido, MADV_DONTNEED);
+        devolvido = ate;
+    }
+
+    UDPPeripheral& cliente;
+    size_t tamMsg;
+    size_t emVoo;
+    int fd = -1;
+    bool mapeado = false;
+    char* mapa = nullptr;
+    size_t tamanhoMapa = 0;
+    size_t lido = 0;
+    size_t devolvido = 0;
+    vector<unique_ptr<char[]>> buffers;
+};
+
+#endif // SLOW_STREAM_H
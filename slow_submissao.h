@@ -0,0 +1,280 @@
+/*
+ * slow_submissao.h
+ * Autores:
+ *  Enzo Tonon Morente - 14568476
+ *  João Pedro Alves Notari Godoy - 14582076
+ *  Letícia Barbosa Neves - 14582076
+ * Descrição: Fila de submissão de várias threads para a thread de protocolo
+ *            do periférico: anel limitado sem travas (vários produtores, um
+ *            consumidor), com política para a fila cheia e um eventfd que
+ *            acorda o consumidor só quando ele está dormindo
+ */
+
+#ifndef SLOW_SUBMISSAO_H
+#define SLOW_SUBMISSAO_H
+
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <memory>
+#include <string>
+#include <functional>
+#include <cstdint>
+#include <cstddef>
+#include <unistd.h>
+#include <sys/eventfd.h>
+
+// Anel limitado com um número de sequência por célula (D. Vyukov): o
+// produtor reserva a posição com um CAS em "cauda" e publica a célula
+// gravando seq = pos + 1; o consumidor, único, lê a célula quando seq
+// indica que ela foi publicada e a devolve com seq = pos + capacidade.
+// Capacidade arredondada para potência de 2.
+template <typename T>
+class FilaMPSC {
+public:
+    explicit FilaMPSC(size_t capacidade) {
+        size_t cap = 2;
+        while (cap < capacidade) cap *= 2;
+        celulas.reset(new Celula[cap]);
+        mascara = cap - 1;
+        for (size_t i = 0; i < cap; i++) celulas[i].seq.store(i, std::memory_order_relaxed);
+    }
+    FilaMPSC(const FilaMPSC&) = delete;
+    FilaMPSC& operator=(const FilaMPSC&) = delete;
+
+    size_t capacidade() const { return mascara + 1; }
+
+    // Qualquer thread. false com a fila cheia ("v" fica intacto).
+    bool empurrar(T& v) {
+        size_t pos = cauda.load(std::memory_order_relaxed);
+        while (true) {
+            Celula& c = celulas[pos & mascara];
+            size_t seq = c.seq.load(std::memory_order_acquire);
+            intptr_t dif = (intptr_t)seq - (intptr_t)pos;
+            if (dif == 0) {
+                if (cauda.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    c.valor = std::move(v);
+                    c.seq.store(pos + 1, std::memory_order_release);
+                    return true;
+                }
+            } else if (dif < 0) {
+                return false; // a célula ainda não foi consumida na volta anterior
+            } else {
+                pos = cauda.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    // Só o consumidor. false com a fila vazia.
+    bool retirar(T& v) {
+        Celula& c = celulas[cabeca & mascara];
+        if (c.seq.load(std::memory_order_acquire) != cabeca + 1) return false;
+        v = std::move(c.valor);
+        c.valor = T{};
+        c.seq.store(cabeca + mascara + 1, std::memory_order_release);
+        cabeca++;
+        return true;
+    }
+
+    // Só o consumidor: há célula publicada na cabeça?
+    bool vazia() const {
+        return celulas[cabeca & mascara].seq.load(std::memory_order_acquire) != cabeca + 1;
+    }
+
+private:
+    struct Celula {
+        std::atomic<size_t> seq;
+        T valor;
+    };
+
+    std::unique_ptr<Celula[]> celulas;
+    size_t mascara = 0;
+    alignas(64) std::atomic<size_t> cauda{0};  // disputada pelos produtores
+    alignas(64) size_t cabeca = 0;             // só do consumidor
+};
+
+// O que fazer quando a fila está cheia
+enum class PoliticaFila {
+    BLOQUEAR,   // o produtor espera o consumidor abrir espaço
+    FALHAR,     // submit retorna false e a mensagem volta ao chamador
+    DESCARTAR   // a mensagem é descartada e o callback recebe false na hora
+};
+
+// Contadores da fila; os do produtor só mudam fora do caminho rápido
+struct EstatisticasFila {
+    uint64_t aceitas = 0;     // mensagens retiradas pelo consumidor
+    uint64_t rejeitadas = 0;  // FALHAR com a fila cheia
+    uint64_t descartadas = 0; // DESCARTAR com a fila cheia
+    uint64_t bloqueios = 0;   // vezes que um produtor esperou (BLOQUEAR)
+    uint64_t avisos = 0;      // escritas no eventfd para acordar o consumidor
+};
+
+// Mensagem entregue pela fila: a string é do periférico depois de retirada
+template <typename Callback>
+struct Submissao {
+    std::string msg;
+    Callback cb;
+};
+
+// Fila de submissão com eventfd. O consumidor chama prepararEspera() antes
+// de dormir no epoll e aposEspera() ao acordar: com a fila vazia, marca
+// "dormindo" e o próximo produtor escreve no eventfd; com o consumidor
+// acordado nenhum produtor faz syscall. Fechada, recusa novas mensagens,
+// solta os produtores bloqueados e acorda o consumidor.
+template <typename Callback>
+class FilaSubmissao {
+public:
+    using Item = Submissao<Callback>;
+
+    FilaSubmissao(size_t capacidade, PoliticaFila p): anel(capacidade), politica(p) {
+        evfd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    }
+    ~FilaSubmissao() {
+        if (evfd >= 0) close(evfd);
+    }
+    FilaSubmissao(const FilaSubmissao&) = delete;
+    FilaSubmissao& operator=(const FilaSubmissao&) = delete;
+
+    bool aberta() const { return evfd >= 0; }
+    int descritor() const { return evfd; }
+    size_t capacidade() const { return anel.capacidade(); }
+
+    // Qualquer thread. Retorna true se a mensagem entrou na fila; com
+    // FALHAR, "msg" continua com o chamador quando retorna false.
+    bool submeter(std::string&& msg, Callback& cb) {
+        Produtor guarda(*this);
+        if (fechada.load()) return false;
+        Item item{std::move(msg), std::move(cb)};
+        if (!anel.empurrar(item)) {
+            if (politica == PoliticaFila::BLOQUEAR) {
+                if (!esperarEspaco(item)) {
+                    devolver(item, msg, cb);
+                    return false;
+                }
+            } else if (politica == PoliticaFila::FALHAR) {
+                rejeitadas.fetch_add(1, std::memory_order_relaxed);
+                devolver(item, msg, cb);
+                return false;
+            } else {
+                descartadas.fetch_add(1, std::memory_order_relaxed);
+                if (item.cb) item.cb(0, false);
+                return false;
+            }
+        }
+        // Dekker com prepararEspera: publicação antes de ler "dormindo"
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (dormindo.load(std::memory_order_relaxed) && dormindo.exchange(false)) avisar();
+        return true;
+    }
+
+    // Consumidor: retira uma mensagem
+    bool retirar(Item& item) {
+        if (!anel.retirar(item)) return false;
+        aceitas.store(aceitas.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        if (++desdeSoltura >= anel.capacidade() / 8) soltarBloqueados();
+        return true;
+    }
+
+    // Consumidor, antes de dormir: false se já há mensagem (não dormir)
+    bool prepararEspera() {
+        soltarBloqueados();
+        dormindo.store(true);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (anel.vazia()) return true;
+        dormindo.store(false);
+        return false;
+    }
+
+    // Consumidor, ao acordar; "aviso" se o eventfd estava legível
+    void aposEspera(bool aviso) {
+        if (aviso) {
+            uint64_t n;
+            if (read(evfd, &n, sizeof(n)) < 0) { /* já consumido */ }
+        }
+        dormindo.store(false, std::memory_order_relaxed);
+    }
+
+    // Qualquer thread: recusa novas mensagens e acorda todos
+    void fechar() {
+        fechada.store(true);
+        {
+            std::lock_guard<std::mutex> lk(mtx);
+            espaco.notify_all();
+        }
+        avisar();
+    }
+
+    // Consumidor: fechada, sem produtor no meio de um submit e sem mensagens
+    bool encerrada() const {
+        return fechada.load() && produtores.load() == 0 && anel.vazia();
+    }
+
+    EstatisticasFila estatisticas() const {
+        EstatisticasFila e;
+        e.aceitas = aceitas.load(std::memory_order_relaxed);
+        e.rejeitadas = rejeitadas.load(std::memory_order_relaxed);
+        e.descartadas = descartadas.load(std::memory_order_relaxed);
+        e.bloqueios = bloqueios.load(std::memory_order_relaxed);
+        e.avisos = avisos.load(std::memory_order_relaxed);
+        return e;
+    }
+
+private:
+    // Conta os produtores dentro de submeter, para encerrada() não perder
+    // uma mensagem reservada e ainda não publicada
+    struct Produtor {
+        FilaSubmissao& f;
+        explicit Produtor(FilaSubmissao& fila): f(fila) { f.produtores.fetch_add(1); }
+        ~Produtor() {
+            if (f.produtores.fetch_sub(1) == 1 && f.fechada.load()) f.avisar();
+        }
+    };
+
+    // BLOQUEAR: o consumidor solta os bloqueados a cada um oitavo do anel
+    // retirado e antes de dormir; a tentativa dentro do predicado (sob o
+    // mutex) não perde a notificação.
+    bool esperarEspaco(Item& item) {
+        bloqueios.fetch_add(1, std::memory_order_relaxed);
+        bloqueados.fetch_add(1);
+        bool empurrou = false;
+        {
+            std::unique_lock<std::mutex> lk(mtx);
+            espaco.wait(lk, [&] { return fechada.load() || (empurrou = anel.empurrar(item)); });
+        }
+        bloqueados.fetch_sub(1);
+        return empurrou;
+    }
+
+    void soltarBloqueados() {
+        desdeSoltura = 0;
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (bloqueados.load(std::memory_order_relaxed) == 0) return;
+        std::lock_guard<std::mutex> lk(mtx);
+        espaco.notify_all();
+    }
+
+    static void devolver(Item& item, std::string& msg, Callback& cb) {
+        msg = std::move(item.msg);
+        cb = std::move(item.cb);
+    }
+
+    void avisar() {
+        uint64_t um = 1;
+        avisos.fetch_add(1, std::memory_order_relaxed);
+        if (write(evfd, &um, sizeof(um)) < 0) { /* contador cheio: já há aviso */ }
+    }
+
+    FilaMPSC<Item> anel;
+    PoliticaFila politica;
+    int evfd = -1;
+    std::atomic<bool> fechada{false};
+    alignas(64) std::atomic<bool> dormindo{false};
+    std::atomic<uint32_t> produtores{0};
+    std::atomic<uint32_t> bloqueados{0};
+    size_t desdeSoltura = 0;                   // retiradas desde a última notificação
+    std::mutex mtx;
+    std::condition_variable espaco;
+    std::atomic<uint64_t> aceitas{0}, rejeitadas{0}, descartadas{0}, bloqueios{0}, avisos{0};
+};
+
+#endif // SLOW_SUBMISSAO_H
@@ -0,0 +1,66 @@
+/*
+ * slow_trace.cpp
+ * Autores:
+ *  Enzo Tonon Morente - 14568476
+ *  João Pedro Alves Notari Godoy - 14582076
+ *  Letícia Barbosa Neves - 14582076
+ * Descrição: Decodificador offline do trace binário gravado com
+ *            ./slow_peripheral --trace ARQ; imprime a mesma saída do modo
+ *            interativo
+ */
+
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <cstdio>
+#include <cstring>
+
+#include "slow_trace.h"
+
+using namespace std;
+
+static void uso(const char* prog) {
+    cerr << "Uso: " << prog << " [-t] [-n NIVEL] ARQUIVO\n"
+         << "  -t        prefixa cada registro com o instante relativo (ms)\n"
+         << "  -n NIVEL  mostra só registros até NIVEL (1 eventos, 2 pacotes, 3 payload)\n";
+}
+
+int main(int argc, char** argv) {
+    bool instantes = false;
+    int nivelMax = TRACE_PAYLOAD;
+    const char* caminho = nullptr;
+    for (int i = 1; i < argc; i++) {
+        string a = argv[i];
+        if (a == "-t") instantes = true;
+        else if (a == "-n" && i + 1 < argc) nivelMax = atoi(argv[++i]);
+        else if (!caminho && a[0] != '-') caminho = argv[i];
+        else { uso(argv[0]); return 1; }
+    }
+    if (!caminho) { uso(argv[0]); return 1; }
+
+    FILE* f = fopen(caminho, "rb");
+    if (!f) {
+        cerr << "Erro ao abrir " << caminho << endl;
+        return 1;
+    }
+    char assinatura[sizeof(ASSINATURA_TRACE)];
+    if (fread(assinatura, 1, sizeof(assinatura), f) != sizeof(assinatura) ||
+        memcmp(assinatura, ASSINATURA_TRACE, sizeof(assinatura)) != 0) {
+        cerr << caminho << " não é um trace do SLOW" << endl;
+        fclose(f);
+        return 1;
+    }
+
+    RegistroTrace r;
+    uint64_t inicio = 0;
+    bool primeiro = true;
+    while (fread(&r, sizeof(r), 1, f) == 1) {
+        if (primeiro) { inicio = r.instanteNs; primeiro = false; }
+        if (r.nivel > nivelMax) continue;
+        if (instantes)
+            cout << "[" << fixed << setprecision(3) << (r.instanteNs - inicio) / 1e6 << " ms] ";
+        formatarRegistro(r, cout);
+    }
+    fclose(f);
+    return 0;
+}
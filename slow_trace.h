@@ -0,0 +1,267 @@
+/*
+ * slow_trace.h
+ * Autores:
+ *  Enzo Tonon Morente - 14568476
+ *  João Pedro Alves Notari Godoy - 14582076
+ *  Letícia Barbosa Neves - 14582076
+ * Descrição: Trace binário do periférico. O caminho de dados só copia
+ *            registros de tamanho fixo para um anel; a formatação (a mesma
+ *            saída de printHeader) fica numa thread de dreno ou no
+ *            decodificador offline slow_trace
+ */
+
+#ifndef SLOW_TRACE_H
+#define SLOW_TRACE_H
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+#include <string>
+#include <sstream>
+#include <iostream>
+#include <cstring>
+#include <cstdint>
+#include <cstdio>
+
+#include "slow_protocol.h"
+
+// Níveis do trace: cada registro tem um nível e só é gravado se estiver
+// dentro do nível de execução e do teto de compilação
+enum NivelTrace : uint8_t {
+    TRACE_DESLIGADO = 0,
+    TRACE_EVENTO    = 1,  // reenvios, janela cheia, timeouts
+    TRACE_PACOTE    = 2,  // cabeçalho de cada pacote enviado/recebido
+    TRACE_PAYLOAD   = 3,  // prévia do payload de cada pacote
+};
+
+// Teto de compilação: -DSLOW_TRACE_NIVEL_MAX=0 remove todo o trace do binário
+#ifndef SLOW_TRACE_NIVEL_MAX
+#define SLOW_TRACE_NIVEL_MAX 3
+#endif
+
+// O que o registro descreve. Os eventos de cabeçalho têm o rótulo que o
+// printHeader usava no periférico.
+enum class EventoTrace : uint8_t {
+    ENVIADO_DATA, REENVIADO_DATA, RECEBIDO_ACK_DATA,
+    ENVIADO_CONNECT, RECEBIDO_SETUP, ENVIADO_ACK_HANDSHAKE,
+    ENVIADO_DISCONNECT, RECEBIDO_ACK_DISCONNECT,
+    ENVIADO_REVIVE, RECEBIDO_ACK_REVIVE,
+    PAYLOAD,          // valor1 = tamanho, prévia em "previa"
+    REENVIANDO,       // valor1 = seq, valor2 = tentativa
+    JANELA_CHEIA,
+    PACOTE_IGNORADO,  // valor1 = seq, valor2 = ack (resposta que não é a esperada)
+    TIMEOUT_ACK,
+    PACOTE_DESCARTADO, // valor1 = seq, valor2 = tentativas
+};
+
+inline const char* rotuloEvento(EventoTrace e) {
+    switch (e) {
+    case EventoTrace::ENVIADO_DATA:            return "Enviado - DATA";
+    case EventoTrace::REENVIADO_DATA:          return "REENVIADO - DATA";
+    case EventoTrace::RECEBIDO_ACK_DATA:       return "RECEBIDO - ACK (DATA)";
+    case EventoTrace::ENVIADO_CONNECT:         return "Enviado - CONNECT (1/3)";
+    case EventoTrace::RECEBIDO_SETUP:          return "Recebido - SETUP (2/3)";
+    case EventoTrace::ENVIADO_ACK_HANDSHAKE:   return "Enviado - ACK (3/3)";
+    case EventoTrace::ENVIADO_DISCONNECT:      return "Enviado - DISCONNECT";
+    case EventoTrace::RECEBIDO_ACK_DISCONNECT: return "Recebido - ACK(DISCONNECT)";
+    case EventoTrace::ENVIADO_REVIVE:          return "Enviado - REVIVE";
+    case EventoTrace::RECEBIDO_ACK_REVIVE:     return "Recebido - ACK(REVIVE)";
+    default:                                   return nullptr; // não é de cabeçalho
+    }
+}
+
+// Registro de tamanho fixo (dois cache lines), gravado sem formatação
+struct RegistroTrace {
+    static constexpr size_t PREVIA = 76;
+    uint64_t    instanteNs;          // steady_clock desde a época do relógio
+    EventoTrace evento;
+    uint8_t     nivel;
+    uint16_t    tamPrevia;           // bytes válidos em "previa"
+    uint32_t    valor1, valor2;
+    uint8_t     cabecalho[HDR_SIZE]; // cabeçalho serializado (eventos de cabeçalho)
+    char        previa[PREVIA];
+};
+static_assert(sizeof(RegistroTrace) == 128, "registro de trace deve ter 128 bytes");
+
+// Anel SPSC: produtor é a thread do periférico, consumidor é o dreno. Se o
+// anel estiver cheio o registro é descartado (e contado), nunca bloqueia.
+class AnelTrace {
+public:
+    explicit AnelTrace(size_t capacidade = 4096) {
+        size_t c = 1;
+        while (c < capacidade) c <<= 1;
+        buf.resize(c);
+        mascara = c - 1;
+    }
+
+    void setNivel(NivelTrace n) { nivel.store(n, std::memory_order_relaxed); }
+    NivelTrace nivelAtual() const { return (NivelTrace)nivel.load(std::memory_order_relaxed); }
+    bool ativo(NivelTrace n) const {
+        return n <= SLOW_TRACE_NIVEL_MAX && n <= nivel.load(std::memory_order_relaxed);
+    }
+    uint64_t descartados() const { return perdidos.load(std::memory_order_relaxed); }
+
+    void cabecalho(NivelTrace n, EventoTrace e, const uint8_t* hdr) {
+        if (!ativo(n)) return;
+        if (RegistroTrace* r = reservar(n, e)) {
+            memcpy(r->cabecalho, hdr, HDR_SIZE);
+            publicar();
+        }
+    }
+    void cabecalho(NivelTrace n, EventoTrace e, const Header& h) {
+        if (!ativo(n)) return;
+        uint8_t hdr[HDR_SIZE];
+        serialize(h, hdr);
+        cabecalho(n, e, hdr);
+    }
+    void payload(const uint8_t* dados, size_t len) {
+        if (!ativo(TRACE_PAYLOAD)) return;
+        if (RegistroTrace* r = reservar(TRACE_PAYLOAD, EventoTrace::PAYLOAD)) {
+            r->valor1 = (uint32_t)len;
+            r->tamPrevia = (uint16_t)std::min(len, RegistroTrace::PREVIA);
+            memcpy(r->previa, dados, r->tamPrevia);
+            publicar();
+        }
+    }
+    void evento(NivelTrace n, EventoTrace e, uint32_t v1 = 0, uint32_t v2 = 0) {
+        if (!ativo(n)) return;
+        if (RegistroTrace* r = reservar(n, e)) {
+            r->valor1 = v1;
+            r->valor2 = v2;
+            publicar();
+        }
+    }
+
+    // Lado do consumidor: copia o registro mais antigo, se houver
+    bool retirar(RegistroTrace& r) {
+        uint64_t c = cauda.load(std::memory_order_relaxed);
+        if (c == cabeca.load(std::memory_order_acquire)) return false;
+        r = buf[c & mascara];
+        cauda.store(c + 1, std::memory_order_release);
+        return true;
+    }
+    bool vazio() const {
+        return cauda.load(std::memory_order_acquire) == cabeca.load(std::memory_order_acquire);
+    }
+
+private:
+    RegistroTrace* reservar(NivelTrace n, EventoTrace e) {
+        uint64_t h = cabeca.load(std::memory_order_relaxed);
+        if (h - cauda.load(std::memory_order_acquire) > mascara) {
+            perdidos.fetch_add(1, std::memory_order_relaxed);
+            return nullptr;
+        }
+        RegistroTrace* r = &buf[h & mascara];
+        r->instanteNs = (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+        r->evento = e;
+        r->nivel = n;
+        r->tamPrevia = 0;
+        r->valor1 = r->valor2 = 0;
+        return r;
+    }
+    void publicar() { cabeca.store(cabeca.load(std::memory_order_relaxed) + 1, std::memory_order_release); }
+
+    std::vector<RegistroTrace> buf;
+    uint64_t mascara = 0;
+    alignas(64) std::atomic<uint64_t> cabeca{0}; // escrito pelo produtor
+    alignas(64) std::atomic<uint64_t> cauda{0};  // escrito pelo consumidor
+    std::atomic<uint64_t> perdidos{0};
+    std::atomic<uint8_t> nivel{TRACE_PAYLOAD};
+};
+
+// Texto de um registro, igual ao que o periférico imprimia diretamente
+inline void formatarRegistro(const RegistroTrace& r, std::ostream& out) {
+    if (const char* rotulo = rotuloEvento(r.evento)) {
+        Header h;
+        deserialize(h, r.cabecalho);
+        printHeader(h, rotulo, out);
+        return;
+    }
+    switch (r.evento) {
+    case EventoTrace::PAYLOAD: {
+        size_t n = std::min<size_t>(r.tamPrevia, 50);
+        out << "PAYLOAD (" << r.valor1 << " bytes): \"" << std::string(r.previa, n)
+            << (r.valor1 > 50 ? "..." : "") << "\"\n\n";
+        break;
+    }
+    case EventoTrace::REENVIANDO:
+        out << "Reenviando pacote seq=" << r.valor1 << " (tentativa " << r.valor2 << ")\n";
+        break;
+    case EventoTrace::JANELA_CHEIA:    out << "Janela cheia, esperando ACK...\n"; break;
+    case EventoTrace::PACOTE_IGNORADO:
+        out << "Pacote ignorado - seq = " << r.valor1 << ", ack = " << r.valor2 << "\n";
+        break;
+    case EventoTrace::TIMEOUT_ACK:     out << "Timeout esperando ACK\n"; break;
+    case EventoTrace::PACOTE_DESCARTADO:
+        out << "Pacote seq=" << r.valor1 << " descartado após " << r.valor2 << " tentativas.\n";
+        break;
+    default: break;
+    }
+}
+
+// Cabeçalho do arquivo de trace binário (seguido de RegistroTrace em sequência)
+static const char ASSINATURA_TRACE[8] = {'S', 'L', 'O', 'W', 'T', 'R', 'C', '1'};
+
+// Thread que esvazia o anel: formata em texto para "saida" ou grava os
+// registros crus num arquivo para o slow_trace decodificar depois
+class DrenoTrace {
+public:
+    DrenoTrace(AnelTrace& a, std::ostream& saida): anel(a), texto(&saida) { iniciar(); }
+    DrenoTrace(AnelTrace& a, FILE* arquivoBinario): anel(a), binario(arquivoBinario) {
+        fwrite(ASSINATURA_TRACE, 1, sizeof(ASSINATURA_TRACE), binario);
+        iniciar();
+    }
+    ~DrenoTrace() {
+        parar = true;
+        t.join();
+        esvaziar();
+        if (texto) texto->flush();
+        if (binario) fflush(binario);
+    }
+
+    // Espera o que já foi gravado no anel sair (antes de imprimir algo da
+    // própria aplicação, para não embaralhar a saída)
+    void sincronizar() {
+        while (!anel.vazio() || ocupado.load(std::memory_order_acquire))
+            std::this_thread::sleep_for(std::chrono::microseconds(200));
+        if (texto) texto->flush();
+        if (binario) fflush(binario);
+    }
+
+private:
+    void iniciar() {
+        t = std::thread([this] {
+            while (!parar) {
+                if (!esvaziar())
+                    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            }
+        });
+    }
+
+    // Retorna se havia algo para escrever
+    bool esvaziar() {
+        RegistroTrace r;
+        bool algum = false;
+        ocupado.store(true, std::memory_order_release);
+        std::ostringstream lote;
+        while (anel.retirar(r)) {
+            algum = true;
+            if (binario) fwrite(&r, sizeof(r), 1, binario);
+            else formatarRegistro(r, lote);
+        }
+        if (texto && algum) *texto << lote.str() << std::flush;
+        ocupado.store(false, std::memory_order_release);
+        return algum;
+    }
+
+    AnelTrace& anel;
+    std::ostream* texto = nullptr;
+    FILE* binario = nullptr;
+    std::atomic<bool> parar{false};
+    std::atomic<bool> ocupado{false};
+    std::thread t;
+};
+
+#endif // SLOW_TRACE_H
@@ -0,0 +1,317 @@
+/*
+ * slow_transporte.h
+ * Autores:
+ *  Enzo Tonon Morente - 14568476
+ *  João Pedro Alves Notari Godoy - 14582076
+ *  Letícia Barbosa Neves - 14582076
+ * Descrição: Interfaces de transporte e de relógio do periférico e uma rede
+ *            em memória com relógio virtual: os datagramas entre os pontos
+ *            sofrem perda (em rajadas), atraso, jitter, reordenação e um
+ *            gargalo de fila curta, sorteados com semente, e as esperas
+ *            só avançam o relógio. Um cenário com timeouts de segundos roda
+ *            em microssegundos.
+ */
+
+#ifndef SLOW_TRANSPORTE_H
+#define SLOW_TRANSPORTE_H
+
+#include <chrono>
+#include <optional>
+#include <vector>
+#include <deque>
+#include <memory>
+#include <random>
+#include <algorithm>
+#include <functional>
+#include <cstdint>
+#include <cstring>
+#include <sys/types.h>
+#include <sys/uio.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+// Fonte de tempo da sessão. Sem uma, o periférico usa steady_clock.
+class FonteTempo {
+public:
+    using Instante = std::chrono::steady_clock::time_point;
+    virtual ~FonteTempo() = default;
+    virtual Instante agora() const = 0;
+};
+
+// Transporte de datagramas com um destino só (a central). Sem um, o
+// periférico usa o próprio socket UDP (com sendmmsg/recvmmsg e GSO).
+class Transporte {
+public:
+    using Instante = FonteTempo::Instante;
+    // Bits devolvidos por esperar()
+    static const uint32_t PRONTO_DATAGRAMA = 1; // há datagrama para receber()
+    static const uint32_t PRONTO_PRAZO     = 2; // "prazo" chegou
+
+    virtual ~Transporte() = default;
+    // Envia um datagrama montado pelos iovecs; false se não saiu
+    virtual bool enviar(const iovec* iov, size_t n) = 0;
+    // Próximo datagrama já recebido, sem esperar; -1 se não há nenhum
+    virtual ssize_t receber(uint8_t* buf, size_t cap) = 0;
+    // Espera um datagrama, o "prazo" ou timeoutMs (-1 = sem limite)
+    virtual uint32_t esperar(std::optional<Instante> prazo, int timeoutMs) = 0;
+};
+
+// Relógio que só anda quando mandado (nunca volta)
+class RelogioVirtual : public FonteTempo {
+public:
+    Instante agora() const override { return t; }
+    void avancarAte(Instante ate) { if (ate > t) t = ate; }
+    void avancar(std::chrono::nanoseconds d) { t += std::chrono::duration_cast<Instante::duration>(d); }
+
+private:
+    Instante t{std::chrono::seconds(1)};
+};
+
+// Comportamento do enlace na saída de um ponto. Uma perda começa com
+// probabilidade "perda" e cada datagrama seguinte também se perde com
+// probabilidade 1 - 1/rajada (rajada = tamanho médio; 1 = perdas
+// independentes), enquanto o enlace não ficar parado mais que rajadaMs:
+// reenvios espaçados pelo RTO não caem todos na mesma rajada. "reordem"
+// segura o datagrama o bastante para ser ultrapassado pelos seguintes.
+// Com taxaMbps, os datagramas passam por um gargalo com fila drop-tail de
+// filaBytes antes do atraso.
+struct ModeloEnlace {
+    double perda    = 0.0;
+    double rajada   = 1.0;
+    double atrasoMs = 0.0;
+    double jitterMs = 0.0;
+    double reordem  = 0.0;
+    double taxaMbps = 0.0;        // 0 = sem gargalo
+    uint32_t filaBytes = 32 * 1024;
+    double rajadaMs = 50;         // pausa que encerra uma rajada de perdas
+};
+
+// Contadores de um ponto
+struct EstatisticasEnlace {
+    uint64_t enviados = 0;
+    uint64_t perdidos = 0;
+    uint64_t perdidosFila = 0;    // fila do gargalo cheia
+    uint64_t reordenados = 0;
+    uint64_t recebidos = 0;
+};
+
+class RedeVirtual;
+
+// Ponto da rede em memória. Os datagramas que chegam ficam numa caixa para
+// receber(), ou vão direto a "receptor" no instante da chegada (assim a
+// central emulada responde dentro da própria simulação).
+class TransporteMemoria : public Transporte {
+public:
+    using Receptor = std::function<void(const uint8_t*, size_t, const sockaddr_in&)>;
+
+    TransporteMemoria(RedeVirtual& r, uint32_t i, Receptor rec): rede(r), indice(i), receptor(std::move(rec)) {
+        end.sin_family = AF_INET;
+        end.sin_addr.s_addr = htonl(0x0A000000u | (i + 1)); // 10.x.y.z: um endereço por ponto
+        end.sin_port = htons(7033);
+        destino = end;
+    }
+
+    const sockaddr_in& endereco() const { return end; }
+    void conectar(const sockaddr_in& d) { destino = d; }
+    void setEnlace(const ModeloEnlace& m) { enlace = m; }
+    const EstatisticasEnlace& estatisticas() const { return est; }
+
+    bool enviarPara(const sockaddr_in& para, const iovec* iov, size_t n);
+    bool enviar(const iovec* iov, size_t n) override { return enviarPara(destino, iov, n); }
+    ssize_t receber(uint8_t* buf, size_t cap) override;
+    uint32_t esperar(std::optional<Instante> prazo, int timeoutMs) override;
+
+private:
+    friend class RedeVirtual;
+
+    struct Datagrama {
+        std::vector<uint8_t> dados;
+        sockaddr_in origem;
+    };
+
+    void chegou(Datagrama&& d) {
+        est.recebidos++;
+        if (receptor) receptor(d.dados.data(), d.dados.size(), d.origem);
+        else caixa.push_back(std::move(d));
+    }
+
+    RedeVirtual& rede;
+    uint32_t indice;
+    Receptor receptor;
+    sockaddr_in end{};
+    sockaddr_in destino{};
+    ModeloEnlace enlace;
+    bool emRajada = false;
+    Instante ultimoEnvio{};       // a rajada acaba com o enlace parado
+    Instante gargaloLivre{};      // quando o gargalo esvazia a fila atual
+    std::deque<Datagrama> caixa;
+    EstatisticasEnlace est;
+};
+
+// Rede em memória de uma thread: todos os pontos compartilham o relógio
+// virtual e a fila de datagramas em trânsito (ordenada pela chegada). Um
+// ponto que espera avança o relógio até a próxima chegada ou até o prazo
+// dele, entregando tudo o que chega no caminho. Com a mesma semente, a
+// mesma sequência de envios dá sempre o mesmo resultado.
+class RedeVirtual {
+public:
+    using Instante = FonteTempo::Instante;
+
+    explicit RedeVirtual(uint32_t semente = 1): rng(semente) {}
+    RedeVirtual(const RedeVirtual&) = delete;
+    RedeVirtual& operator=(const RedeVirtual&) = delete;
+
+    RelogioVirtual& relogio() { return tempo; }
+    const RelogioVirtual& relogio() const { return tempo; }
+
+    // Ponto novo com endereço próprio (válido enquanto a rede existir)
+    TransporteMemoria& novoPonto(TransporteMemoria::Receptor receptor = nullptr) {
+        pontos.push_back(std::make_unique<TransporteMemoria>(*this, (uint32_t)pontos.size(), std::move(receptor)));
+        return *pontos.back();
+    }
+
+    std::optional<Instante> proximaChegada() const {
+        if (emTransito.empty()) return std::nullopt;
+        return emTransito.front().quando;
+    }
+
+    // Entrega o que já chegou (os receptores podem enviar mais)
+    void entregarVencidas() {
+        while (!emTransito.empty() && emTransito.front().quando <= tempo.agora()) {
+            std::pop_heap(emTransito.begin(), emTransito.end(), std::greater<Chegada>());
+            Chegada c = std::move(emTransito.back());
+            emTransito.pop_back();
+            if (c.destino < pontos.size()) pontos[c.destino]->chegou(std::move(c.dados));
+        }
+    }
+
+    // Avança o relógio até "ate", entregando cada chegada no seu instante
+    void avancarAte(Instante ate) {
+        std::optional<Instante> c;
+        while ((c = proximaChegada()) && *c <= ate) {
+            tempo.avancarAte(*c);
+            entregarVencidas();
+        }
+        tempo.avancarAte(ate);
+    }
+
+private:
+    friend class TransporteMemoria;
+
+    struct Chegada {
+        Instante quando;
+        uint64_t ordem;   // desempate: mesma chegada, ordem de envio
+        uint32_t destino;
+        TransporteMemoria::Datagrama dados;
+        bool operator>(const Chegada& o) const {
+            return quando != o.quando ? quando > o.quando : ordem > o.ordem;
+        }
+    };
+
+    double sorteio() { return std::uniform_real_distribution<double>(0.0, 1.0)(rng); }
+
+    // Fila drop-tail do gargalo de "de": ms até o datagrama sair dele, ou
+    // nada se não couber
+    std::optional<double> passarPeloGargalo(TransporteMemoria& de, size_t len) {
+        const ModeloEnlace& m = de.enlace;
+        Instante agora = tempo.agora();
+        if (de.gargaloLivre < agora) de.gargaloLivre = agora;
+        double bytesPorSeg = m.taxaMbps * 1e6 / 8;
+        double naFila = std::chrono::duration<double>(de.gargaloLivre - agora).count() * bytesPorSeg;
+        if (naFila + len > m.filaBytes) return std::nullopt;
+        de.gargaloLivre += std::chrono::duration_cast<Instante::duration>(
+            std::chrono::duration<double>(len / bytesPorSeg));
+        return std::chrono::duration<double, std::milli>(de.gargaloLivre - agora).count();
+    }
+
+    // Aplica o enlace de "de" e põe o datagrama em trânsito
+    bool enviar(TransporteMemoria& de, const sockaddr_in& para, const iovec* iov, size_t n) {
+        de.est.enviados++;
+        const ModeloEnlace& m = de.enlace;
+        Instante agora = tempo.agora();
+        bool parado = agora - de.ultimoEnvio > std::chrono::duration<double, std::milli>(m.rajadaMs);
+        de.ultimoEnvio = agora;
+        bool continua = de.emRajada && !parado && m.rajada > 1 && sorteio() < 1.0 - 1.0 / m.rajada;
+        de.emRajada = continua || (m.perda > 0 && sorteio() < m.perda);
+        if (de.emRajada) {
+            de.est.perdidos++;
+            return true; // perdido na rede: para quem envia, saiu
+        }
+        size_t len = 0;
+        for (size_t i = 0; i < n; i++) len += iov[i].iov_len;
+        double ms = m.atrasoMs;
+        if (m.taxaMbps > 0) {
+            auto espera = passarPeloGargalo(de, len);
+            if (!espera) {
+                de.est.perdidosFila++;
+                return true;
+            }
+            ms += *espera;
+        }
+        if (m.jitterMs > 0) ms += sorteio() * m.jitterMs;
+        if (m.reordem > 0 && sorteio() < m.reordem) {
+            ms += std::max(2.0 * m.jitterMs, 5.0);
+            de.est.reordenados++;
+        }
+
+        Chegada c;
+        c.quando = tempo.agora() + std::chrono::duration_cast<Instante::duration>(
+                                       std::chrono::duration<double, std::milli>(ms));
+        c.ordem = ordem++;
+        c.destino = (ntohl(para.sin_addr.s_addr) & 0xFFFFFFu) - 1;
+        c.dados.origem = de.end;
+        c.dados.dados.reserve(len);
+        for (size_t i = 0; i < n; i++) {
+            const uint8_t* p = (const uint8_t*)iov[i].iov_base;
+            c.dados.dados.insert(c.dados.dados.end(), p, p + iov[i].iov_len);
+        }
+        emTransito.push_back(std::move(c));
+        std::push_heap(emTransito.begin(), emTransito.end(), std::greater<Chegada>());
+        return true;
+    }
+
+    std::vector<std::unique_ptr<TransporteMemoria>> pontos;
+    std::vector<Chegada> emTransito; // heap pelo instante de chegada
+    uint64_t ordem = 0;
+    std::mt19937_64 rng;
+    RelogioVirtual tempo;
+};
+
+inline bool TransporteMemoria::enviarPara(const sockaddr_in& para, const iovec* iov, size_t n) {
+    return rede.enviar(*this, para, iov, n);
+}
+
+inline ssize_t TransporteMemoria::receber(uint8_t* buf, size_t cap) {
+    rede.entregarVencidas();
+    if (caixa.empty()) return -1;
+    Datagrama& d = caixa.front();
+    size_t n = std::min(cap, d.dados.size()); // como no UDP, o excesso se perde
+    memcpy(buf, d.dados.data(), n);
+    caixa.pop_front();
+    return (ssize_t)n;
+}
+
+// Avança o relógio até a primeira chegada a este ponto ou até o limite
+// (o menor entre "prazo" e timeoutMs). Sem limite e sem nada em trânsito,
+// nada mais pode acontecer: volta sem avançar.
+inline uint32_t TransporteMemoria::esperar(std::optional<Instante> prazo, int timeoutMs) {
+    RelogioVirtual& t = rede.relogio();
+    std::optional<Instante> limite = prazo;
+    if (timeoutMs >= 0) {
+        Instante fim = t.agora() + std::chrono::milliseconds(timeoutMs);
+        if (!limite || fim < *limite) limite = fim;
+    }
+    rede.entregarVencidas();
+    while (caixa.empty()) {
+        std::optional<Instante> c = rede.proximaChegada();
+        if (!c || (limite && *c > *limite)) break;
+        t.avancarAte(*c);
+        rede.entregarVencidas();
+    }
+    if (caixa.empty() && limite) t.avancarAte(*limite);
+    uint32_t prontos = caixa.empty() ? 0 : PRONTO_DATAGRAMA;
+    if (prazo && *prazo <= t.agora()) prontos |= PRONTO_PRAZO;
+    return prontos;
+}
+
+#endif // SLOW_TRANSPORTE_H
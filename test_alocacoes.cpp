@@ -0,0 +1,116 @@
+/*
+ * test_alocacoes.cpp
+ * Autores:
+ *  Enzo Tonon Morente - 14568476
+ *  João Pedro Alves Notari Godoy - 14582076
+ *  Letícia Barbosa Neves - 14582076
+ * Descrição: Verifica que o caminho de envio não aloca memória em regime:
+ *            operator new é substituído por um contador (só da thread do
+ *            cliente; a central emulada roda em outra thread e aloca à vontade)
+ */
+
+#include <iostream>
+#include <string>
+#include <thread>
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+// os operadores abaixo substituem os globais de propósito (malloc/free)
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+
+#include "slow_peripheral.h"
+#include "slow_central.h"
+#include "test_comum.h"
+
+using namespace std;
+
+static thread_local bool contando = false;
+static thread_local uint64_t alocacoes = 0;
+
+void* operator new(size_t n) {
+    if (contando) alocacoes++;
+    if (void* p = malloc(n ? n : 1)) return p;
+    throw bad_alloc();
+}
+void* operator new[](size_t n) { return operator new(n); }
+void operator delete(void* p) noexcept { free(p); }
+void operator delete[](void* p) noexcept { free(p); }
+void operator delete(void* p, size_t) noexcept { free(p); }
+void operator delete[](void* p, size_t) noexcept { free(p); }
+
+static const int AQUECIMENTO = 200; // envios até o regime (pools e filas crescerem)
+static const int MEDIDOS = 1000;
+
+// Roda "enviar" AQUECIMENTO vezes sem contar e MEDIDOS vezes contando.
+// Falha se algum envio falhar ou se houver qualquer alocação medida.
+template <typename F>
+static bool medir(const char* nome, F enviar) {
+    for (int i = 0; i < AQUECIMENTO; i++)
+        if (!enviar()) { cout << nome << ": envio falhou no aquecimento" << endl; return false; }
+
+    alocacoes = 0;
+    contando = true;
+    bool ok = true;
+    for (int i = 0; i < MEDIDOS && ok; i++) ok = enviar();
+    contando = false;
+
+    cout << nome << ": " << alocacoes << " alocações em " << MEDIDOS << " envios"
+         << (ok ? "" : " (envio falhou)") << endl;
+    return ok && alocacoes == 0;
+}
+
+// Cliente conectado à central emulada, com "configurar" aplicado antes do connect
+template <typename Config>
+static bool comCliente(uint16_t janela, Config configurar, bool (*cenario)(UDPPeripheral&)) {
+    ConfigCentral cc;
+    cc.porta = 0;
+    cc.janela = janela;
+    CentralEmThread central(cc);
+
+    UDPPeripheral cli;
+    cli.setVerboso(false);
+    if (!cli.init("127.0.0.1", central.porta())) return false;
+    configurar(cli);
+    if (!cli.connect()) return false;
+    bool ok = cenario(cli);
+    cli.disconnect();
+    return ok;
+}
+
+int main() {
+    static const string pequena(1000, 'a');  // um fragmento
+    static const string media(5000, 'b');    // quatro fragmentos, cabe na janela padrão
+
+    auto semAjuste = [](UDPPeripheral&) {};
+
+    verificar(comCliente(5 * DATA_MAX, semAjuste, [](UDPPeripheral& c) {
+        return medir("sendData 1000 B", [&] { return c.sendData(pequena); });
+    }), "sendData 1000 B sem alocar");
+    verificar(comCliente(5 * DATA_MAX, semAjuste, [](UDPPeripheral& c) {
+        return medir("sendData 5000 B", [&] { return c.sendData(media); });
+    }), "sendData 5000 B sem alocar");
+    verificar(comCliente(5 * DATA_MAX, [](UDPPeripheral& c) { c.setLoteIO(false); },
+                         [](UDPPeripheral& c) {
+        return medir("sendData 5000 B por pacote", [&] { return c.sendData(media); });
+    }), "sendData 5000 B por pacote sem alocar");
+    verificar(comCliente(5 * DATA_MAX, [](UDPPeripheral& c) { c.setVerboso(true); },
+                         [](UDPPeripheral& c) {
+        return medir("sendData 5000 B com trace", [&] { return c.sendData(media); });
+    }), "sendData 5000 B com trace sem alocar");
+    // pipeline: oito mensagens enfileiradas por vez com submitView
+    verificar(comCliente(65535, semAjuste, [](UDPPeripheral& c) {
+        return medir("submitView x8 1000 B", [&] {
+            int pendentes = 0;
+            bool falhou = false;
+            for (int i = 0; i < 8; i++) {
+                pendentes++;
+                c.submitView(pequena, [&](uint64_t, bool r) { pendentes--; falhou |= !r; });
+            }
+            while (pendentes > 0 && c.isActive()) c.processarEventos(TIMEOUT_ESPERA_MS);
+            return !falhou && pendentes == 0;
+        });
+    }), "submitView x8 1000 B sem alocar");
+
+    return resultadoTeste();
+}
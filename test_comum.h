@@ -0,0 +1,32 @@
+/*
+ * test_comum.h
+ * Autores:
+ *  Enzo Tonon Morente - 14568476
+ *  João Pedro Alves Notari Godoy - 14582076
+ *  Letícia Barbosa Neves - 14582076
+ * Descrição: Verificação e resultado compartilhados pelos testes (test_*.cpp);
+ *            a central emulada numa thread fica em slow_central.h
+ */
+
+#ifndef TEST_COMUM_H
+#define TEST_COMUM_H
+
+#include <iostream>
+
+static int falhas = 0;
+
+// Registra a falha e segue com o teste
+static void verificar(bool cond, const char* oque) {
+    if (!cond) {
+        std::cout << "FALHA: " << oque << std::endl;
+        falhas++;
+    }
+}
+
+// Fim do main: imprime o resultado e devolve o código de saída
+static int resultadoTeste() {
+    std::cout << (falhas == 0 ? "Teste concluído com sucesso." : "Teste FALHOU.") << std::endl;
+    return falhas == 0 ? 0 : 1;
+}
+
+#endif // TEST_COMUM_H
@@ -0,0 +1,51 @@
+#!/bin/bash
+# Teste contra a central local (slow_central) em loopback: mensagem pequena,
+# mensagem fragmentada, lote em pipeline, disconnect e revive. Opções extras são repassadas
+# ao slow_central (ex.: ./test_local.sh --loss 0.05 --delay 5).
+
+PORTA=${PORTA:-17033}
+LOG=$(mktemp)
+
+./slow_central --port "$PORTA" -q "$@" > "$LOG" 2>&1 &
+CENTRAL=$!
+sleep 0.2
+
+GRANDE=$(head -c 5000 /dev/zero | tr '\0' 'x')
+
+echo "Teste local na porta $PORTA..."
+
+SAIDA=$({
+    echo "data"
+    echo "teste pequeno"
+    echo "data"
+    echo "$GRANDE"
+    echo "batch"
+    echo "um"
+    echo "dois"
+    echo "tres"
+    echo ""
+    echo "disconnect"
+    echo "revive"
+    echo "mensagem do revive"
+    echo "exit"
+} | timeout 60 ./slow_peripheral 127.0.0.1 "$PORTA" 2>&1)
+
+kill -INT "$CENTRAL"
+wait "$CENTRAL"
+
+FALHOU=0
+echo "$SAIDA" | grep -q "Conectado ao servidor." || { echo "FALHA: handshake"; FALHOU=1; }
+echo "$SAIDA" | grep -q "Erro ao enviar dados" && { echo "FALHA: envio de dados"; FALHOU=1; }
+echo "$SAIDA" | grep -q "Mensagem 5 confirmada." || { echo "FALHA: batch"; FALHOU=1; }
+echo "$SAIDA" | grep -q "Desconectado com sucesso." || { echo "FALHA: disconnect"; FALHOU=1; }
+echo "$SAIDA" | grep -q "Sessao revivida." || { echo "FALHA: revive"; FALHOU=1; }
+grep -q "mensagens=6 bytes=5041" "$LOG" || { echo "FALHA: central não remontou as 6 mensagens"; FALHOU=1; }
+
+tail -2 "$LOG"
+rm -f "$LOG"
+
+if [ $FALHOU -eq 0 ]; then
+    echo "Teste concluído com sucesso."
+else
+    exit 1
+fi
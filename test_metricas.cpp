@@ -0,0 +1,170 @@
+/*
+ * test_metricas.cpp
+ * Autores:
+ *  Enzo Tonon Morente - 14568476
+ *  João Pedro Alves Notari Godoy - 14582076
+ *  Letícia Barbosa Neves - 14582076
+ * Descrição: Testa as métricas: baldes do histograma, contadores de uma
+ *            sessão com perda, o formato do retrato (arquivo e socket Unix)
+ *            e os totais depois que a sessão sai do registro
+ */
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <map>
+
+#include "slow_peripheral.h"
+#include "slow_central.h"
+#include "test_comum.h"
+
+using namespace std;
+
+static void testarHistograma() {
+    Histograma h;
+    using us = Histograma::us;
+    h.registrar(us(0));        // balde 0 (até 1 µs)
+    h.registrar(us(1));        // balde 0
+    h.registrar(us(3));        // balde 2 (até 4 µs)
+    h.registrar(us(4));        // balde 2
+    h.registrar(us(1000));     // balde 10 (até 1024 µs)
+    h.registrar(us(100000000)); // além do último: +Inf
+    ValoresHistograma v = h.valores();
+    verificar(v.baldes[0] == 2 && v.baldes[2] == 2 && v.baldes[10] == 1, "baldes em potências de 2");
+    verificar(v.baldes[ValoresHistograma::BALDES] == 1, "balde +Inf");
+    verificar(v.n == 6 && v.soma == 100001008, "contagem e soma");
+    verificar(v.quantil(0.5) == 4 && v.quantil(0.7) == 1024, "quantis pelo limite do balde");
+}
+
+// Lê o retrato todo de um socket Unix
+static string lerSocket(const string& caminho) {
+    int c = socket(AF_UNIX, SOCK_STREAM, 0);
+    sockaddr_un sa{};
+    sa.sun_family = AF_UNIX;
+    strncpy(sa.sun_path, caminho.c_str(), sizeof(sa.sun_path) - 1);
+    string s;
+    if (connect(c, (sockaddr*)&sa, sizeof(sa)) == 0) {
+        char buf[4096];
+        ssize_t n;
+        while ((n = read(c, buf, sizeof(buf))) > 0) s.append(buf, (size_t)n);
+    }
+    close(c);
+    return s;
+}
+
+// Confere o formato de texto e devolve as amostras (nome com rótulos -> valor)
+static bool interpretar(const string& texto, map<string, double>& amostras) {
+    istringstream in(texto);
+    string linha, ultimoBalde;
+    double anterior = -1;
+    while (getline(in, linha)) {
+        if (linha.empty()) return false;
+        if (linha[0] == '#') {
+            if (linha.rfind("# HELP ", 0) != 0 && linha.rfind("# TYPE ", 0) != 0) return false;
+            continue;
+        }
+        size_t esp = linha.rfind(' ');
+        if (esp == string::npos || esp == 0) return false;
+        string nome = linha.substr(0, esp);
+        char* fim;
+        double v = strtod(linha.c_str() + esp + 1, &fim);
+        if (*fim != '\0') return false;
+        amostras[nome] = v;
+        // baldes cumulativos: nunca diminuem dentro do mesmo histograma
+        size_t b = nome.find("_bucket{");
+        if (b != string::npos) {
+            string base = nome.substr(0, b);
+            if (base == ultimoBalde && v < anterior) return false;
+            ultimoBalde = base;
+            anterior = v;
+        }
+    }
+    return true;
+}
+
+static void testarSessao() {
+    const size_t N = 200, TAM = 3000;
+    ConfigCentral cfg;
+    cfg.porta = 0;
+    cfg.perda = 0.03;
+    cfg.semente = 7;
+    CentralEmThread central(cfg);
+
+    RegistroMetricas registro;
+    {
+        UDPPeripheral cli;
+        cli.setVerboso(false);
+        cli.setRegistroMetricas(registro, "a\"b");
+        if (!cli.init("127.0.0.1", central.porta()) || !cli.connect()) {
+            verificar(false, "conexão com a central");
+            return;
+        }
+        string msg(TAM, 'm');
+        for (size_t i = 0; i < N; i++) cli.submitView(msg, nullptr);
+        verificar(cli.aguardarEnvios(), "mensagens entregues com perda");
+
+        const MetricasSessao& m = cli.metricasSessao();
+        verificar(m.mensagensConfirmadas.valor() == N && m.bytesConfirmados.valor() == N * TAM,
+                  "mensagens e bytes confirmados");
+        verificar(m.bytesEnviados.valor() == N * TAM, "bytes enviados sem reenvios");
+        verificar(m.retransmissoes.valor() > 0 && m.retransmissoes.valor() == cli.estatisticasIO().retransmissoes,
+                  "retransmissões contadas");
+        verificar(m.handshakes.valor() == 1 && m.latenciaHandshake.valores().n == 1, "handshake e latência");
+        verificar(m.latenciaMensagem.valores().n == N, "uma latência por mensagem");
+        verificar(m.rtt.valores().n > 0 && m.srttUs.valor() > 0, "amostras de RTT e SRTT");
+        verificar(m.bytesEmTransito.valor() == 0, "nada em trânsito no fim");
+
+        string sock = "/tmp/slow_metricas_" + to_string(getpid()) + ".sock";
+        string arq = "/tmp/slow_metricas_" + to_string(getpid()) + ".prom";
+        ConfigExportador ce;
+        ce.arquivo = arq;
+        ce.periodo = chrono::milliseconds(50);
+        ce.socketUnix = sock;
+        ce.porSessao = true;
+        ExportadorMetricas exp(registro);
+        verificar(exp.iniciar(ce), "exportador iniciado");
+
+        map<string, double> viaSocket;
+        verificar(interpretar(lerSocket(sock), viaSocket), "formato do retrato no socket");
+        verificar(viaSocket["slow_mensagens_confirmadas_total"] == N, "total no socket");
+        verificar(viaSocket["slow_sessao_mensagens_confirmadas_total{sessao=\"a\\\"b\"}"] == N,
+                  "contador por sessão com rótulo escapado");
+        verificar(viaSocket["slow_rtt_segundos_bucket{le=\"+Inf\"}"] == viaSocket["slow_rtt_segundos_count"],
+                  "+Inf igual à contagem");
+        verificar(viaSocket["slow_latencia_mensagem_segundos_count"] == N, "histograma de latência exportado");
+
+        this_thread::sleep_for(chrono::milliseconds(120));
+        exp.parar();
+        ifstream f(arq);
+        stringstream conteudo;
+        conteudo << f.rdbuf();
+        map<string, double> viaArquivo;
+        verificar(interpretar(conteudo.str(), viaArquivo), "formato do retrato no arquivo");
+        verificar(viaArquivo["slow_bytes_confirmados_total"] == N * TAM, "total no arquivo");
+        verificar(viaArquivo.count("slow_goodput_bytes_por_segundo") == 1, "goodput no arquivo");
+        verificar(access(sock.c_str(), F_OK) != 0, "socket removido ao parar");
+        unlink(arq.c_str());
+        cli.disconnect();
+    }
+
+    // a sessão saiu do registro, mas continua nos totais
+    RegistroMetricas::Totais t = registro.totais();
+    verificar(t.sessoes == 0, "sessão removida do registro");
+    const ValoresHistograma& rtt = t.histogramas[indiceMetrica(&MetricasSessao::rtt)];
+    const ValoresHistograma& lat = t.histogramas[indiceMetrica(&MetricasSessao::latenciaMensagem)];
+    verificar(t.contadores[indiceMetrica(&MetricasSessao::mensagensConfirmadas)] == N && lat.n == N,
+              "totais mantidos depois da sessão");
+    cout << "métricas: " << t.contadores[indiceMetrica(&MetricasSessao::retransmissoes)]
+         << " retransmissões, RTT p50 <= " << rtt.quantil(0.5) << " us, mensagem p99 <= "
+         << lat.quantil(0.99) << " us" << endl;
+}
+
+int main() {
+    testarHistograma();
+    testarSessao();
+    return resultadoTeste();
+}
@@ -0,0 +1,114 @@
+/*
+ * test_motor.cpp
+ * Autores:
+ *  Enzo Tonon Morente - 14568476
+ *  João Pedro Alves Notari Godoy - 14582076
+ *  Letícia Barbosa Neves - 14582076
+ * Descrição: Testa o motor de sessões: mil sessões em quatro trabalhadores,
+ *            mensagens submetidas de várias threads (inclusive antes do
+ *            handshake terminar), encerramento e parada com handshakes
+ *            pendentes
+ */
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <thread>
+#include <atomic>
+
+#include "slow_motor.h"
+#include "slow_central.h"
+#include "test_comum.h"
+
+using namespace std;
+
+// Espera "cond" por até "segundos"
+template <typename F>
+static bool esperar(F cond, int segundos) {
+    auto limite = chrono::steady_clock::now() + chrono::seconds(segundos);
+    while (!cond()) {
+        if (chrono::steady_clock::now() > limite) return false;
+        this_thread::sleep_for(chrono::milliseconds(5));
+    }
+    return true;
+}
+
+static void testarMuitasSessoes() {
+    const uint32_t SESSOES = 1000, PRODUTORES = 4;
+    ConfigCentral cfg;
+    cfg.porta = 0;
+    CentralEmThread central(cfg);
+
+    MotorSessoes motor(4);
+    if (!motor.iniciar("127.0.0.1", central.porta())) {
+        verificar(false, "motor iniciado");
+        return;
+    }
+
+    // cada produtor abre um quarto das sessões e já submete três mensagens
+    // (uma fragmentada), sem esperar o handshake
+    atomic<uint32_t> abertas{0}, confirmadas{0}, erros{0};
+    atomic<uint64_t> bytes{0};
+    vector<uint32_t> ids(SESSOES);
+    vector<thread> produtores;
+    for (uint32_t p = 0; p < PRODUTORES; p++) {
+        produtores.emplace_back([&, p] {
+            for (uint32_t i = p; i < SESSOES; i += PRODUTORES) {
+                ids[i] = motor.abrirSessao([&](uint32_t, bool ok) { (ok ? abertas : erros)++; });
+                string msgs[3] = {"sessao " + to_string(i), string(3000 + i, 'a' + i % 26), "fim"};
+                for (string& m : msgs) {
+                    bytes += m.size();
+                    motor.submit(ids[i], std::move(m), [&](uint64_t, bool ok) { (ok ? confirmadas : erros)++; });
+                }
+            }
+        });
+    }
+    for (thread& t : produtores) t.join();
+
+    bool tudo = esperar([&] { return confirmadas + erros >= 3 * SESSOES &&abertas + erros >= SESSOES; }, 60);
+    verificar(tudo, "todas as mensagens concluídas a tempo");
+    verificar(abertas == SESSOES && confirmadas == 3 * SESSOES && erros == 0,
+              "todas as sessões abertas e mensagens confirmadas");
+
+    for (uint32_t id : ids) motor.fecharSessao(id);
+    verificar(esperar([&] { return motor.estatisticas().sessoesEncerradas == SESSOES; }, 10),
+              "todas as sessões encerradas");
+
+    // sessão inexistente: o trabalhador dela responde com erro
+    atomic<int> respostaInvalida{-1};
+    motor.submit(ids.back() + 1000, "x", [&](uint64_t, bool ok) { respostaInvalida = ok; });
+    verificar(esperar([&] { return respostaInvalida >= 0; }, 5) && respostaInvalida == 0,
+              "submit para sessão inexistente falha");
+    verificar(!motor.submit(0, "x", nullptr), "submit para o id 0 falha na hora");
+
+    EstatisticasMotor e = motor.estatisticas();
+    motor.parar();
+    central.encerrar();
+    const EstatisticasCentral& c = central.estatisticas();
+    verificar(c.sessoes == SESSOES, "central aceitou um handshake por sessão");
+    verificar(c.mensagens == 3 * SESSOES && c.bytes == bytes, "central remontou todas as mensagens");
+    cout << "motor: " << SESSOES << " sessões em " << motor.numeroTrabalhadores() << " trabalhadores, "
+         << confirmadas << " mensagens, " << e.datagramasRecebidos << " datagramas recebidos em "
+         << e.chamadasRecepcao << " recvmmsg, " << e.reenviosConnect << " CONNECTs reenviados" << endl;
+}
+
+// Parar com handshakes sem resposta conclui tudo com erro
+static void testarParada() {
+    MotorSessoes motor(2);
+    verificar(motor.iniciar("127.0.0.1", 9), "motor iniciado contra porta sem central");
+    atomic<int> abertasComErro{0}, enviosComErro{0};
+    for (int i = 0; i < 10; i++) {
+        uint32_t id = motor.abrirSessao([&](uint32_t, bool ok) { if (!ok) abertasComErro++; });
+        motor.submit(id, "sem resposta", [&](uint64_t, bool ok) { if (!ok) enviosComErro++; });
+    }
+    this_thread::sleep_for(chrono::milliseconds(50));
+    motor.parar();
+    verificar(abertasComErro == 10 && enviosComErro == 10, "parada falha handshakes e envios pendentes");
+    verificar(motor.abrirSessao() == 0, "motor parado não abre sessões");
+}
+
+int main() {
+    testarMuitasSessoes();
+    testarParada();
+    return resultadoTeste();
+}
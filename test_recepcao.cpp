@@ -0,0 +1,144 @@
+/*
+ * test_recepcao.cpp
+ * Autores:
+ *  Enzo Tonon Morente - 14568476
+ *  João Pedro Alves Notari Godoy - 14582076
+ *  Letícia Barbosa Neves - 14582076
+ * Descrição: Testa a remontagem das mensagens vindas da central: fragmentos
+ *            fora de ordem e repetidos, pool cheio, prazo, fo inválido e a
+ *            janela anunciada; depois ponta a ponta com a central em modo eco
+ */
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <algorithm>
+
+#include "slow_peripheral.h"
+#include "slow_central.h"
+#include "test_comum.h"
+
+using namespace std;
+
+// Cabeçalho de um fragmento vindo da central
+static Header fragmento(uint8_t fid, uint8_t fo, bool mais) {
+    Header h;
+    h.sf = FLAG_ACK | (mais ? FLAG_MB : 0);
+    h.fid = fid;
+    h.fo = fo;
+    return h;
+}
+
+// Mensagem de teste com conteúdo diferente em cada posição
+static string conteudo(size_t n, char semente) {
+    string s(n, '\0');
+    for (size_t i = 0; i < n; i++) s[i] = (char)(semente + i % 23);
+    return s;
+}
+
+// Entrega os fragmentos de "msg" (fragmentos de DATA_MAX) na ordem dada
+static void entregarEm(Remontador& r, uint8_t fid, const string& msg, const vector<int>& ordem) {
+    size_t total = (msg.size() + DATA_MAX - 1) / DATA_MAX;
+    for (int fo : ordem) {
+        size_t off = (size_t)fo * DATA_MAX;
+        size_t n = min<size_t>(DATA_MAX, msg.size() - off);
+        r.receber(fragmento(fid, (uint8_t)fo, (size_t)fo + 1 < total),
+                  (const uint8_t*)msg.data() + off, n);
+    }
+}
+
+static void testarRemontador() {
+    vector<string> recebidas;
+    const void* primeiroTrecho = nullptr;
+    Remontador r(8, chrono::milliseconds(50));
+    r.setCallback([&](const MensagemRecebida& m) {
+        recebidas.push_back(m.str());
+        primeiroTrecho = m.partes[0].data();
+    });
+    verificar(r.janelaLivre() == 8 * DATA_MAX, "janela inicial é o pool inteiro");
+
+    // um fragmento só: entregue direto do datagrama
+    string curta = "mensagem curta";
+    r.receber(fragmento(0, 0, false), (const uint8_t*)curta.data(), curta.size());
+    verificar(recebidas.size() == 1 && recebidas[0] == curta, "mensagem de um fragmento");
+    verificar(primeiroTrecho == curta.data(), "mensagem de um fragmento entregue sem cópia");
+
+    // fora de ordem, com repetido; a janela cai enquanto remonta
+    string longa = conteudo(4 * DATA_MAX + 100, 'a');
+    entregarEm(r, 7, longa, {3, 0});
+    verificar(r.janelaLivre() == 6 * DATA_MAX, "janela desconta os slots ocupados");
+    entregarEm(r, 7, longa, {4, 0, 1});
+    verificar(r.estatisticas().duplicados == 1, "fragmento repetido contado");
+    verificar(recebidas.size() == 1, "incompleta não é entregue");
+    entregarEm(r, 7, longa, {2});
+    verificar(recebidas.size() == 2 && recebidas[1] == longa, "remontagem fora de ordem");
+    verificar(r.janelaLivre() == 8 * DATA_MAX, "slots voltam ao pool após a entrega");
+
+    // duas mensagens intercaladas
+    string a = conteudo(2 * DATA_MAX, 'A'), b = conteudo(3 * DATA_MAX - 7, 'B');
+    entregarEm(r, 1, a, {1});
+    entregarEm(r, 2, b, {2, 0});
+    entregarEm(r, 1, a, {0});
+    entregarEm(r, 2, b, {1});
+    verificar(recebidas.size() == 4 && recebidas[2] == a && recebidas[3] == b, "fids intercalados");
+
+    // fo depois do último fragmento descarta a remontagem
+    entregarEm(r, 3, conteudo(3 * DATA_MAX, 'x'), {2});
+    r.receber(fragmento(3, 5, true), (const uint8_t*)a.data(), DATA_MAX);
+    verificar(r.estatisticas().invalidos == 1, "fo além do fim é inválido");
+    verificar(r.janelaLivre() == 8 * DATA_MAX, "remontagem inválida libera os slots");
+
+    // pool cheio: o excedente é descartado; o prazo devolve os slots
+    string enorme = conteudo(10 * DATA_MAX, 'z');
+    entregarEm(r, 9, enorme, {0, 1, 2, 3, 4, 5, 6, 7, 8, 9});
+    verificar(r.estatisticas().semBuffer == 2 && r.janelaLivre() == 0, "pool cheio descarta");
+    verificar(recebidas.size() == 4, "mensagem sem espaço não é entregue");
+    this_thread::sleep_for(chrono::milliseconds(120));
+    r.expirar(chrono::steady_clock::now());
+    verificar(r.estatisticas().expiradas == 1 && r.janelaLivre() == 8 * DATA_MAX,
+              "remontagem parada expira e libera o pool");
+}
+
+// A central devolve cada mensagem, com a saída reordenada
+static void testarEco() {
+    ConfigCentral cfg;
+    cfg.porta = 0;
+    cfg.eco = true;
+    cfg.jitterMs = 2;
+    cfg.reordem = 0.3;
+    CentralEmThread central(cfg);
+
+    UDPPeripheral cli;
+    cli.setVerboso(false);
+    vector<string> ecos;
+    cli.setReceptor([&](const MensagemRecebida& m) { ecos.push_back(m.str()); });
+    if (!cli.init("127.0.0.1", central.porta()) || !cli.connect()) {
+        verificar(false, "conexão com a central em modo eco");
+        return;
+    }
+
+    vector<string> enviadas;
+    for (int i = 0; i < 20; i++) {
+        enviadas.push_back(conteudo(1 + i * 997, (char)('a' + i)));
+        verificar(cli.sendData(enviadas.back()), "envio para a central em modo eco");
+    }
+    auto limite = chrono::steady_clock::now() + chrono::seconds(5);
+    while (ecos.size() < enviadas.size() && chrono::steady_clock::now() < limite)
+        cli.aguardarDatagramas(50);
+    cli.disconnect();
+
+    sort(enviadas.begin(), enviadas.end());
+    sort(ecos.begin(), ecos.end());
+    verificar(ecos == enviadas, "todas as mensagens voltaram íntegras");
+    const EstatisticasRecepcao& e = cli.estatisticasRecepcao();
+    cout << "eco: " << ecos.size() << " mensagens, " << e.fragmentos << " fragmentos, "
+         << e.duplicados << " repetidos, " << e.expiradas << " expiradas" << endl;
+}
+
+int main() {
+    testarRemontador();
+    testarEco();
+    return resultadoTeste();
+}
@@ -0,0 +1,64 @@
+#!/bin/bash
+# Cache de sessões (--session) contra a central local: a segunda execução faz
+# revive em vez do handshake; com o STTL vencido, o arquivo corrompido ou o
+# revive recusado, volta ao handshake. Opções extras são repassadas ao slow_central.
+
+PORTA=${PORTA:-17035}
+LOG=$(mktemp)
+SESSAO=$(mktemp -u)
+
+./slow_central --port "$PORTA" -q --sttl 1500 "$@" > "$LOG" 2>&1 &
+CENTRAL=$!
+sleep 0.2
+
+echo "Teste do cache de sessões na porta $PORTA..."
+
+# Uma execução do cliente: envia uma mensagem e sai (exit desconecta)
+executar() {
+    printf 'data\n%s\nexit\n' "$1" | timeout 20 ./slow_peripheral 127.0.0.1 "$PORTA" --session "$SESSAO" 2>&1
+}
+
+FALHOU=0
+esperar() { # $1 = texto esperado, $2 = saída, $3 = descrição
+    echo "$2" | grep -q "$1" || { echo "FALHA: $3"; FALHOU=1; }
+}
+
+esperar "Conectado ao servidor." "$(executar primeira)" "primeira execução faz o handshake"
+esperar "Sessao revivida do cache." "$(executar segunda)" "segunda execução faz revive"
+esperar "Sessao revivida do cache." "$(executar terceira)" "revive de uma sessão já revivida"
+
+sleep 1.7 # STTL de 1500 ms vencido
+esperar "Conectado ao servidor." "$(executar quarta)" "STTL vencido volta ao handshake"
+
+# Entradas com checksum errado são ignoradas
+printf 'x' | dd of="$SESSAO" bs=1 seek=80 conv=notrunc 2>/dev/null
+esperar "Conectado ao servidor." "$(executar quinta)" "entrada corrompida volta ao handshake"
+esperar "Sessao revivida do cache." "$(executar sexta)" "cache regravado depois do handshake"
+
+kill -INT "$CENTRAL"
+wait "$CENTRAL"
+
+grep -q "sessoes=3 revives=3" "$LOG" \
+    || { echo "FALHA: central deveria ter 3 handshakes e 3 revives"; FALHOU=1; }
+grep -q "mensagens=6 " "$LOG" \
+    || { echo "FALHA: central deveria ter recebido 6 mensagens"; FALHOU=1; }
+tail -1 "$LOG"
+
+# Central reiniciada não conhece o SID: revive recusado, handshake em seguida
+./slow_central --port "$PORTA" -q "$@" > "$LOG" 2>&1 &
+CENTRAL=$!
+sleep 0.2
+esperar "Conectado ao servidor." "$(executar setima)" "revive recusado volta ao handshake"
+kill -INT "$CENTRAL"
+wait "$CENTRAL"
+grep -q "sessoes=1 revives=0 revives_recusados=1 mensagens=1 " "$LOG" \
+    || { echo "FALHA: central reiniciada deveria recusar o revive e aceitar o handshake"; FALHOU=1; }
+tail -1 "$LOG"
+
+rm -f "$LOG" "$SESSAO"
+
+if [ $FALHOU -eq 0 ]; then
+    echo "Teste concluído com sucesso."
+else
+    exit 1
+fi
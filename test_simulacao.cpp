@@ -0,0 +1,290 @@
+/*
+ * test_simulacao.cpp
+ * Autores:
+ *  Enzo Tonon Morente - 14568476
+ *  João Pedro Alves Notari Godoy - 14582076
+ *  Letícia Barbosa Neves - 14582076
+ * Descrição: Testa o periférico sobre a rede em memória com relógio virtual
+ *            (slow_transporte.h): milhares de cenários connect/envio/
+ *            disconnect/revive com perda, rajadas e reordenação sorteadas,
+ *            o revive com uma janela de dados (e a volta ao handshake
+ *            quando recusado), o lote com submit recusado, a
+ *            reprodutibilidade pela semente e o abandono após os RTOs sem
+ *            esperar o tempo real
+ */
+
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <random>
+
+#include "slow_peripheral.h"
+#include "slow_central.h"
+#include "test_comum.h"
+
+using namespace std;
+
+// Sessões pequenas: um cenário cria e destrói a sua
+static PerfilSessao perfilPequeno() {
+    PerfilSessao p;
+    p.registrosTrace = 16;
+    p.slotsRecepcao = 8;
+    return p;
+}
+
+// Rede, central e periférico de um cenário
+struct Cenario {
+    RedeVirtual rede;
+    CentralEmulador central;
+    UDPPeripheral cli;
+    TransporteMemoria* ponto = nullptr;
+
+    Cenario(uint32_t semente, const ConfigCentral& cfg, const ModeloEnlace& ida, const ModeloEnlace& volta)
+        : rede(semente), central(cfg), cli(perfilPequeno()) {
+        central.abrir(rede);
+        central.pontoRede()->setEnlace(volta);
+        ponto = &rede.novoPonto();
+        ponto->conectar(central.pontoRede()->endereco());
+        ponto->setEnlace(ida);
+        cli.setVerboso(false);
+        cli.usarTransporte(*ponto, rede.relogio());
+    }
+
+    chrono::duration<double> decorrido(FonteTempo::Instante desde) const {
+        return rede.relogio().agora() - desde;
+    }
+};
+
+// Handshake e revive não reenviam: tentam de novo algumas vezes
+template <typename F>
+static bool tentar(F f) {
+    for (int i = 0; i < 5; i++)
+        if (f()) return true;
+    return false;
+}
+
+struct Totais {
+    uint64_t cenarios = 0, mensagens = 0, bytes = 0, entregues = 0;
+    uint64_t revives = 0, retransmissoes = 0, rapidas = 0;
+    double segundosVirtuais = 0;
+};
+
+// Um cenário: connect, mensagens, disconnect, revive e mais mensagens.
+// Devolve false se algo que devia funcionar com essa perda falhou.
+static bool rodarCenario(uint32_t semente, Totais& t) {
+    mt19937 rng(semente);
+    uniform_real_distribution<double> u(0, 1);
+    ModeloEnlace ida, volta;
+    ida.perda = u(rng) * 0.05;
+    ida.rajada = 1;
+    ida.atrasoMs = 1 + u(rng) * 40;
+    ida.jitterMs = u(rng) * 5;
+    ida.reordem = u(rng) * 0.05;
+    volta = ida;
+    volta.perda = u(rng) * 0.05;
+    ConfigCentral cfg;
+    cfg.janela = (uint16_t)(DATA_MAX * (2 + rng() % 20));
+    cfg.semente = semente;
+
+    Cenario c(semente, cfg, ida, volta);
+    auto inicio = c.rede.relogio().agora();
+    if (!tentar([&] { return c.cli.connect(); })) return false;
+
+    auto enviar = [&](int n) {
+        for (int i = 0; i < n; i++) {
+            size_t tam = 1 + rng() % (6 * DATA_MAX);
+            string msg(tam, (char)('a' + i));
+            t.mensagens++;
+            t.bytes += tam;
+            if (!c.cli.sendData(msg)) return false;
+        }
+        return true;
+    };
+    if (!enviar(3)) return false;
+
+    c.cli.storeSession();
+    c.cli.disconnect(); // com o ACK perdido a central já pode ter encerrado: o revive resolve
+    string primeira(1 + rng() % (6 * DATA_MAX), 'z'); // vai junto com o revive
+    if (!tentar([&] { return c.cli.zeroWay(primeira); })) return false;
+    t.mensagens++;
+    t.bytes += primeira.size();
+    t.revives++;
+    if (!enviar(2)) return false;
+    c.cli.disconnect();
+
+    t.cenarios++;
+    t.entregues += c.central.estatisticas().bytes;
+    t.retransmissoes += c.cli.estatisticasIO().retransmissoes;
+    t.rapidas += c.cli.estatisticasIO().retransmissoesRapidas;
+    t.segundosVirtuais += c.decorrido(inicio).count();
+    return true;
+}
+
+static void testarCenarios() {
+    const uint32_t N = 2000;
+    Totais t;
+    uint32_t falhos = 0;
+    auto t0 = chrono::steady_clock::now();
+    for (uint32_t s = 1; s <= N; s++)
+        if (!rodarCenario(s, t)) falhos++;
+    double realMs = chrono::duration<double, milli>(chrono::steady_clock::now() - t0).count();
+
+    verificar(falhos == 0, "cenários com perda de até 5% concluídos");
+    verificar(t.entregues == t.bytes, "central remontou todos os bytes confirmados");
+    verificar(t.retransmissoes > 0 && t.rapidas > 0, "perdas exercitaram timeout e retransmissão rápida");
+    verificar(t.segundosVirtuais > 100 * realMs / 1000, "tempo virtual muito maior que o real");
+    cout << fixed << setprecision(0) << "simulação: " << t.cenarios << " cenários (" << t.mensagens
+         << " mensagens, " << t.revives << " revives, " << t.retransmissoes << " retransmissões) em "
+         << realMs << " ms reais, " << t.segundosVirtuais << " s virtuais" << endl;
+}
+
+// Revive levando 8 fragmentos: tudo sai junto com o R+ACK, então a mensagem
+// é confirmada em uma ida e volta (e não duas, como revive e depois envio)
+static void testarReviveComDados() {
+    ModeloEnlace m;
+    m.atrasoMs = 20;
+    ConfigCentral cfg;
+    cfg.janela = 20 * DATA_MAX;
+    Cenario c(11, cfg, m, m);
+    verificar(c.cli.connect(), "handshake");
+    verificar(c.cli.sendData("antes"), "envio antes do revive");
+    c.cli.storeSession();
+    verificar(c.cli.disconnect(), "disconnect");
+
+    string msg(8 * DATA_MAX, 'v');
+    auto inicio = c.rede.relogio().agora();
+    verificar(c.cli.zeroWay(msg), "revive com 8 fragmentos");
+    double ms = chrono::duration<double, milli>(c.decorrido(inicio)).count();
+    verificar(c.cli.foiRevivida(), "sessão reaberta pelo revive");
+    verificar(ms < 1.5 * 40, "revive e mensagem confirmados em uma ida e volta");
+    verificar(c.central.estatisticas().bytes == 5 + msg.size(), "central remontou a mensagem do revive");
+    verificar(c.cli.sendData("depois"), "envio depois do revive");
+}
+
+// Pacotes de dados que ultrapassam o R+ACK ficam guardados na central até ele
+static void testarReviveUltrapassado() {
+    ModeloEnlace m;
+    m.atrasoMs = 10;
+    m.jitterMs = 10;
+    m.reordem = 0.5;
+    ConfigCentral cfg;
+    cfg.janela = 20 * DATA_MAX;
+    uint32_t revividas = 0, erradas = 0;
+    uint64_t guardados = 0;
+    for (uint32_t semente = 1; semente <= 50; semente++) {
+        Cenario c(semente, cfg, m, m);
+        if (!c.cli.connect()) continue;
+        c.cli.storeSession();
+        c.cli.disconnect();
+        string msg(6 * DATA_MAX, 'u');
+        if (!c.cli.zeroWay(msg)) continue;
+        revividas++;
+        if (c.central.estatisticas().bytes != msg.size()) erradas++;
+        guardados += c.central.estatisticas().foraDeOrdem;
+    }
+    verificar(revividas >= 45 && erradas == 0, "mensagem do revive entregue uma vez, mesmo reordenada");
+    verificar(guardados > 0, "fragmentos chegaram antes do R+ACK e foram guardados");
+}
+
+// Sessão vencida na central: o revive é recusado, o connect() reabre a
+// sessão e a mensagem vai inteira, uma vez só
+static void testarReviveRecusado() {
+    ConfigCentral cfg;
+    cfg.sttlMs = 1000;
+    ModeloEnlace m;
+    m.atrasoMs = 5;
+    Cenario c(12, cfg, m, m);
+    verificar(c.cli.connect(), "handshake");
+    c.cli.storeSession();
+    verificar(c.cli.disconnect(), "disconnect");
+    c.rede.avancarAte(c.rede.relogio().agora() + chrono::seconds(2)); // STTL vencido
+
+    string msg(5 * DATA_MAX + 7, 'x');
+    verificar(c.cli.zeroWay(msg), "revive recusado volta ao handshake");
+    verificar(c.cli.isActive() && !c.cli.foiRevivida(), "sessão aberta por handshake");
+    const EstatisticasCentral& e = c.central.estatisticas();
+    verificar(e.revivesRecusados == 1 && e.sessoes == 2, "uma recusa e um handshake novo");
+    verificar(e.bytes == msg.size() && e.mensagens == 1, "mensagem entregue uma vez, na sessão nova");
+}
+
+// Lote com uma mensagem recusada na hora (grande demais): aguardarEnvios
+// acusa a falha, e a chamada seguinte só vê o lote dela
+static void testarLoteRecusado() {
+    Cenario c(13, ConfigCentral{}, ModeloEnlace{}, ModeloEnlace{});
+    verificar(c.cli.connect(), "handshake");
+    int falhas = 0, confirmadas = 0;
+    auto cb = [&](uint64_t, bool ok) { ok ? confirmadas++ : falhas++; };
+    c.cli.submit(string(10, 'a'), cb);
+    c.cli.submit(string(MAX_MENSAGEM + 1, 'b'), cb);
+    verificar(!c.cli.aguardarEnvios() && falhas == 1 && confirmadas == 1, "submit recusado falha o lote");
+    c.cli.submit(string(10, 'c'), cb);
+    verificar(c.cli.aguardarEnvios() && confirmadas == 2, "lote seguinte sem falhas");
+    verificar(c.cli.disconnect(), "disconnect");
+    c.cli.submit(string(10, 'd'), cb);
+    verificar(!c.cli.aguardarEnvios() && falhas == 2, "submit com a sessão inativa falha o lote");
+}
+
+// Resultado completo de uma execução, para comparar duas com a mesma semente
+static vector<uint64_t> assinatura(uint32_t semente) {
+    ModeloEnlace m;
+    m.perda = 0.08;
+    m.rajada = 3;
+    m.atrasoMs = 10;
+    m.jitterMs = 8;
+    m.reordem = 0.1;
+    ConfigCentral cfg;
+    cfg.janela = 20 * DATA_MAX;
+    Cenario c(semente, cfg, m, m);
+    verificar(tentar([&] { return c.cli.connect(); }), "handshake com perdas em rajada");
+    string msg(50000, 'r');
+    for (int i = 0; i < 10; i++) c.cli.submitView(msg, nullptr);
+    verificar(c.cli.aguardarEnvios(), "mensagens confirmadas com perdas em rajada");
+    verificar(c.central.estatisticas().bytes == 10 * msg.size(), "central remontou as 10 mensagens");
+    const EstatisticasIO& io = c.cli.estatisticasIO();
+    const EstatisticasEnlace& e = c.ponto->estatisticas();
+    return {io.retransmissoes, io.retransmissoesRapidas, e.enviados, e.perdidos, e.reordenados,
+            c.central.estatisticas().bytes,
+            (uint64_t)c.rede.relogio().agora().time_since_epoch().count()};
+}
+
+static void testarReprodutivel() {
+    verificar(assinatura(42) == assinatura(42), "mesma semente, mesma execução");
+    verificar(assinatura(42) != assinatura(43), "semente diferente muda a execução");
+    verificar(assinatura(42)[3] > 0 && assinatura(42)[4] > 0, "perdas e reordenações sorteadas");
+}
+
+// Tudo perdido depois do handshake: o pacote é abandonado depois de
+// MAX_TENTATIVAS RTOs dobrando, na hora em tempo real
+static void testarAbandono() {
+    Cenario c(7, ConfigCentral{}, ModeloEnlace{}, ModeloEnlace{});
+    verificar(c.cli.connect(), "handshake sem perda");
+    ModeloEnlace mudo;
+    mudo.perda = 1;
+    c.ponto->setEnlace(mudo);
+
+    auto inicio = c.rede.relogio().agora();
+    auto t0 = chrono::steady_clock::now();
+    verificar(!c.cli.sendData("perdida"), "envio falha sem ACKs");
+    double real = chrono::duration<double>(chrono::steady_clock::now() - t0).count();
+    double virtual_ = c.decorrido(inicio).count();
+    verificar(c.cli.ultimaFalha().ocorreu && c.cli.ultimaFalha().tentativas == MAX_TENTATIVAS,
+              "pacote abandonado após MAX_TENTATIVAS");
+    verificar(!c.cli.isActive(), "sessão inativa após o abandono");
+    // RTT ~0 no handshake: o RTO parte de RTO_MIN e dobra a cada tentativa
+    double rtos = chrono::duration<double>(EstimadorRTT::RTO_MIN).count() * ((1 << MAX_TENTATIVAS) - 1);
+    verificar(virtual_ >= 0.99 * rtos && real < 0.5, "RTOs dobrando passam no relógio virtual");
+    verificar(c.ponto->estatisticas().perdidos == MAX_TENTATIVAS, "cada tentativa saiu pelo transporte");
+}
+
+int main() {
+    testarAbandono();
+    testarReviveComDados();
+    testarReviveUltrapassado();
+    testarReviveRecusado();
+    testarLoteRecusado();
+    testarReprodutivel();
+    testarCenarios();
+    return resultadoTeste();
+}
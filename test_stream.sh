@@ -0,0 +1,40 @@
+#!/bin/bash
+# Envio em fluxo (--send) contra a central local: arquivo mapeado com mmap e
+# pipe pelo stdin, com mensagens pequenas o bastante para o fid dar a volta.
+# Opções extras são repassadas ao slow_central (ex.: ./test_stream.sh --loss 0.02).
+
+PORTA=${PORTA:-17034}
+LOG=$(mktemp)
+ENTRADA=$(mktemp)
+
+./slow_central --port "$PORTA" -q "$@" > "$LOG" 2>&1 &
+CENTRAL=$!
+sleep 0.2
+
+# 4 MiB: 12 mensagens cheias pelo arquivo + 1024 mensagens de 4 KiB pelo pipe
+head -c 4194304 /dev/urandom > "$ENTRADA"
+TOTAL=$((4194304 * 2))
+MENSAGENS=$((12 + 1024))
+
+echo "Teste de envio em fluxo na porta $PORTA..."
+
+FALHOU=0
+timeout 120 ./slow_peripheral 127.0.0.1 "$PORTA" --send "$ENTRADA" \
+    || { echo "FALHA: envio do arquivo"; FALHOU=1; }
+cat "$ENTRADA" | timeout 120 ./slow_peripheral 127.0.0.1 "$PORTA" --send - --msg 4096 \
+    || { echo "FALHA: envio pelo pipe"; FALHOU=1; }
+
+kill -INT "$CENTRAL"
+wait "$CENTRAL"
+
+grep -q "mensagens=$MENSAGENS bytes=$TOTAL" "$LOG" \
+    || { echo "FALHA: central não remontou $MENSAGENS mensagens / $TOTAL bytes"; FALHOU=1; }
+
+tail -1 "$LOG"
+rm -f "$LOG" "$ENTRADA"
+
+if [ $FALHOU -eq 0 ]; then
+    echo "Teste concluído com sucesso."
+else
+    exit 1
+fi